@@ -7,4 +7,8 @@
 
 Encoder_internal_state_t * Encoder::interruptArgs[];
 
+#ifdef ENCODER_PCINT_PORTS
+Encoder_internal_state_t * Encoder_pcint_args[ENCODER_PCINT_PORTS][ENCODER_PCINT_ARGS];
+#endif
+
 
@@ -39,6 +39,7 @@
 #endif
 
 #include "utility/direct_pin_read.h"
+#include "utility/quadrature_table.h"
 
 #if defined(ENCODER_USE_INTERRUPTS) || !defined(ENCODER_DO_NOT_USE_INTERRUPTS)
 #define ENCODER_USE_INTERRUPTS
@@ -51,12 +52,30 @@
 #define ENCODER_ARGLIST_SIZE 0
 #endif
 
+// ENCODER_USE_PCINT: Pins without an external interrupt use the pin change
+// interrupts (PCINT0..2, one per port), so that both pins of an encoder are
+// interrupt driven, and read() never needs to poll. The interrupt of a port
+// updates all encoders with a pin on that port. Like the interrupt routines
+// of ENCODER_OPTIMIZE_INTERRUPTS, this must be defined only in the sketch,
+// before Encoder.h is included. It conflicts with other users of the pin
+// change interrupts, e.g. SoftwareSerial.
+#if defined(PCICR) || defined(ARDUINO_NATIVE)
+#define ENCODER_PCINT_PORTS 3
+#define ENCODER_PCINT_ARGS 4
+#endif
+#if defined(ENCODER_USE_PCINT) \
+  && (!defined(ENCODER_USE_INTERRUPTS) || !defined(ENCODER_PCINT_PORTS))
+#undef ENCODER_USE_PCINT
+#endif
+
 
 
 // All the data needed by interrupts is consolidated into this ugly struct
 // to facilitate assembly language optimizing of the speed critical update.
 // The assembly code uses auto-incrementing addressing modes, so the struct
 // must remain in exactly this order.
+// double_transitions counts the updates in which both pins changed (the
+// +2/-2 entries of the table below): an edge was missed. It wraps around.
 typedef struct {
 	volatile IO_REG_TYPE * pin1_register;
 	volatile IO_REG_TYPE * pin2_register;
@@ -64,8 +83,16 @@ typedef struct {
 	IO_REG_TYPE            pin2_bitmask;
 	uint8_t                state;
 	int32_t                position;
+	uint16_t               double_transitions;
 } Encoder_internal_state_t;
 
+#ifdef ENCODER_PCINT_PORTS
+// The encoders of each pin change interrupt, the unused entries are 0.
+// Defined in Encoder.cpp, which does not see ENCODER_USE_PCINT of the
+// sketch, so it is declared whenever the chip has pin change interrupts.
+extern Encoder_internal_state_t * Encoder_pcint_args[ENCODER_PCINT_PORTS][ENCODER_PCINT_ARGS];
+#endif
+
 class Encoder
 {
 public:
@@ -84,6 +111,7 @@ public:
 		encoder.pin2_register = PIN_TO_BASEREG(pin2);
 		encoder.pin2_bitmask = PIN_TO_BITMASK(pin2);
 		encoder.position = 0;
+		encoder.double_transitions = 0;
 		// allow time for a passive R-C filter to charge
 		// through the pullup resistors, before reading
 		// the initial state
@@ -112,6 +140,20 @@ public:
 		interrupts();
 		return ret;
 	}
+	// Like read(), but must be called with interrupts disabled, for example
+	// in an interrupt handler, and leaves them disabled. Several encoders
+	// can then be read at the same instant.
+	inline int32_t readLocked() {
+		if (interrupts_in_use < 2) {
+			update(&encoder);
+		}
+		return encoder.position;
+	}
+	// The number of double transitions, see Encoder_internal_state_t.
+	// Must be called with interrupts disabled.
+	inline uint16_t readDoubleTransitionsLocked() {
+		return encoder.double_transitions;
+	}
 	inline void write(int32_t p) {
 		noInterrupts();
 		encoder.position = p;
@@ -122,6 +164,13 @@ public:
 		update(&encoder);
 		return encoder.position;
 	}
+	inline int32_t readLocked() {
+		update(&encoder);
+		return encoder.position;
+	}
+	inline uint16_t readDoubleTransitionsLocked() {
+		return encoder.double_transitions;
+	}
 	inline void write(int32_t p) {
 		encoder.position = p;
 	}
@@ -185,8 +234,13 @@ public:
 	// update() is not meant to be called from outside Encoder,
 	// but it is public to allow static interrupt routines.
 	// DO NOT call update() directly from sketches.
+	// ENCODER_PORTABLE_UPDATE: use the C++ version with the transition
+	// table also on AVR, instead of the assembly. The assembly is kept
+	// because it is faster: 43 cycles without movement, 55 to 57 for one
+	// step, 67 for two. The C++ version takes 92 to 102 cycles, see
+	// test/encoder-decoder-benchmark for how they were counted.
 	static void update(Encoder_internal_state_t *arg) {
-#if defined(__AVR__)
+#if defined(__AVR__) && !defined(ENCODER_PORTABLE_UPDATE)
 		// The compiler believes this is just 1 line of code, so
 		// it will inline this function into each interrupt
 		// handler.  That's a tiny bit faster, but grows the code.
@@ -226,39 +280,52 @@ public:
 			// TODO move this table to another static function,
 			// so it doesn't get needlessly duplicated.  Easier
 			// said than done, due to linker issues and inlining
+			// The targets are generated from the transition
+			// table (utility/quadrature_table.h): L%=d0 to L%=d4
+			// for the movement -2 to +2.
 		"L%=table:"				"\n\t"
-			"rjmp	L%=end"			"\n\t"	// 0
-			"rjmp	L%=plus1"		"\n\t"	// 1
-			"rjmp	L%=minus1"		"\n\t"	// 2
-			"rjmp	L%=plus2"		"\n\t"	// 3
-			"rjmp	L%=minus1"		"\n\t"	// 4
-			"rjmp	L%=end"			"\n\t"	// 5
-			"rjmp	L%=minus2"		"\n\t"	// 6
-			"rjmp	L%=plus1"		"\n\t"	// 7
-			"rjmp	L%=plus1"		"\n\t"	// 8
-			"rjmp	L%=minus2"		"\n\t"	// 9
-			"rjmp	L%=end"			"\n\t"	// 10
-			"rjmp	L%=minus1"		"\n\t"	// 11
-			"rjmp	L%=plus2"		"\n\t"	// 12
-			"rjmp	L%=minus1"		"\n\t"	// 13
-			"rjmp	L%=plus1"		"\n\t"	// 14
-			"rjmp	L%=end"			"\n\t"	// 15
-		"L%=minus2:"				"\n\t"
+			"rjmp	L%=d%[t0]"		"\n\t"	// 0
+			"rjmp	L%=d%[t1]"		"\n\t"	// 1
+			"rjmp	L%=d%[t2]"		"\n\t"	// 2
+			"rjmp	L%=d%[t3]"		"\n\t"	// 3
+			"rjmp	L%=d%[t4]"		"\n\t"	// 4
+			"rjmp	L%=d%[t5]"		"\n\t"	// 5
+			"rjmp	L%=d%[t6]"		"\n\t"	// 6
+			"rjmp	L%=d%[t7]"		"\n\t"	// 7
+			"rjmp	L%=d%[t8]"		"\n\t"	// 8
+			"rjmp	L%=d%[t9]"		"\n\t"	// 9
+			"rjmp	L%=d%[t10]"		"\n\t"	// 10
+			"rjmp	L%=d%[t11]"		"\n\t"	// 11
+			"rjmp	L%=d%[t12]"		"\n\t"	// 12
+			"rjmp	L%=d%[t13]"		"\n\t"	// 13
+			"rjmp	L%=d%[t14]"		"\n\t"	// 14
+			"rjmp	L%=d%[t15]"		"\n\t"	// 15
+		"L%=d0:"				"\n\t"	// -2
+			"ld	r30, X+"		"\n\t"	// double_transitions++
+			"ld	r31, X"			"\n\t"	// (X points behind
+			"adiw	r30, 1"			"\n\t"	// position)
+			"st	X, r31"			"\n\t"
+			"st	-X, r30"		"\n\t"
 			"subi	r22, 2"			"\n\t"
 			"sbci	r23, 0"			"\n\t"
 			"sbci	r24, 0"			"\n\t"
 			"sbci	r25, 0"			"\n\t"
 			"rjmp	L%=store"		"\n\t"
-		"L%=minus1:"				"\n\t"
+		"L%=d1:"				"\n\t"	// -1
 			"subi	r22, 1"			"\n\t"
 			"sbci	r23, 0"			"\n\t"
 			"sbci	r24, 0"			"\n\t"
 			"sbci	r25, 0"			"\n\t"
 			"rjmp	L%=store"		"\n\t"
-		"L%=plus2:"				"\n\t"
+		"L%=d4:"				"\n\t"	// +2
+			"ld	r30, X+"		"\n\t"	// double_transitions++
+			"ld	r31, X"			"\n\t"	// (X points behind
+			"adiw	r30, 1"			"\n\t"	// position)
+			"st	X, r31"			"\n\t"
+			"st	-X, r30"		"\n\t"
 			"subi	r22, 254"		"\n\t"
 			"rjmp	L%=z"			"\n\t"
-		"L%=plus1:"				"\n\t"
+		"L%=d3:"				"\n\t"	// +1
 			"subi	r22, 255"		"\n\t"
 		"L%=z:"	"sbci	r23, 255"		"\n\t"
 			"sbci	r24, 255"		"\n\t"
@@ -268,29 +335,33 @@ public:
 			"st	-X, r24"		"\n\t"
 			"st	-X, r23"		"\n\t"
 			"st	-X, r22"		"\n\t"
-		"L%=end:"				"\n"
-		: : "x" (arg) : "r22", "r23", "r24", "r25", "r30", "r31");
+		"L%=d2:"				"\n"	// 0
+		: : "x" (arg),
+		  [t0] "i" (encoder_jump<0>::target),
+		  [t1] "i" (encoder_jump<1>::target),
+		  [t2] "i" (encoder_jump<2>::target),
+		  [t3] "i" (encoder_jump<3>::target),
+		  [t4] "i" (encoder_jump<4>::target),
+		  [t5] "i" (encoder_jump<5>::target),
+		  [t6] "i" (encoder_jump<6>::target),
+		  [t7] "i" (encoder_jump<7>::target),
+		  [t8] "i" (encoder_jump<8>::target),
+		  [t9] "i" (encoder_jump<9>::target),
+		  [t10] "i" (encoder_jump<10>::target),
+		  [t11] "i" (encoder_jump<11>::target),
+		  [t12] "i" (encoder_jump<12>::target),
+		  [t13] "i" (encoder_jump<13>::target),
+		  [t14] "i" (encoder_jump<14>::target),
+		  [t15] "i" (encoder_jump<15>::target)
+		: "r22", "r23", "r24", "r25", "r30", "r31");
 #else
+		// Without branches: the movement comes from the transition table.
 		uint8_t p1val = DIRECT_PIN_READ(arg->pin1_register, arg->pin1_bitmask);
 		uint8_t p2val = DIRECT_PIN_READ(arg->pin2_register, arg->pin2_bitmask);
-		uint8_t state = arg->state & 3;
-		if (p1val) state |= 4;
-		if (p2val) state |= 8;
+		uint8_t state = (arg->state & 3) | (p1val << 2) | (p2val << 3);
 		arg->state = (state >> 2);
-		switch (state) {
-			case 1: case 7: case 8: case 14:
-				arg->position++;
-				return;
-			case 2: case 4: case 11: case 13:
-				arg->position--;
-				return;
-			case 3: case 12:
-				arg->position += 2;
-				return;
-			case 6: case 9:
-				arg->position -= 2;
-				return;
-		}
+		arg->position += encoder_table_read(encoder_delta_table, state);
+		if (encoder_double_transition(state)) arg->double_transitions++;
 #endif
 	}
 private:
@@ -722,12 +793,46 @@ private:
 				break;
 		#endif
 			default:
+		#ifdef ENCODER_USE_PCINT
+				return attach_pcint(pin, state);
+		#else
 				return 0;
+		#endif
 		}
 		return 1;
 	}
 #endif // ENCODER_USE_INTERRUPTS
 
+#ifdef ENCODER_USE_PCINT
+	static uint8_t attach_pcint(uint8_t pin, Encoder_internal_state_t *state) {
+		volatile uint8_t *pcicr = digitalPinToPCICR(pin);
+		if (!pcicr) return 0;
+		uint8_t port = digitalPinToPCICRbit(pin);
+		for (uint8_t i = 0; i < ENCODER_PCINT_ARGS; i++) {
+			// Both pins of an encoder can be on the same port.
+			if (Encoder_pcint_args[port][i] == 0
+			  || Encoder_pcint_args[port][i] == state) {
+				Encoder_pcint_args[port][i] = state;
+				*digitalPinToPCMSK(pin) |= (1 << digitalPinToPCMSKbit(pin));
+				*pcicr |= (1 << port);
+				return 1;
+			}
+		}
+		return 0;
+	}
+public:
+	// Called by the pin change interrupt of `port`. The encoders whose
+	// pins did not change are updated without movement.
+	static inline void update_pcint(uint8_t port) {
+		for (uint8_t i = 0; i < ENCODER_PCINT_ARGS; i++) {
+			Encoder_internal_state_t *arg = Encoder_pcint_args[port][i];
+			if (arg == 0) return;
+			update(arg);
+		}
+	}
+private:
+#endif // ENCODER_USE_PCINT
+
 
 #if defined(ENCODER_USE_INTERRUPTS) && !defined(ENCODER_OPTIMIZE_INTERRUPTS)
 	#ifdef CORE_INT0_PIN
@@ -947,5 +1052,18 @@ ISR(INT7_vect) { Encoder::update(Encoder::interruptArgs[SCRAMBLE_INT_ORDER(7)]);
 #endif
 #endif // ENCODER_OPTIMIZE_INTERRUPTS
 
+#ifdef ENCODER_USE_PCINT
+// With ENCODER_OPTIMIZE_INTERRUPTS on AVR, update() is inlined here too.
+#if defined(PCINT0_vect)
+ISR(PCINT0_vect) { Encoder::update_pcint(0); }
+#endif
+#if defined(PCINT1_vect)
+ISR(PCINT1_vect) { Encoder::update_pcint(1); }
+#endif
+#if defined(PCINT2_vect)
+ISR(PCINT2_vect) { Encoder::update_pcint(2); }
+#endif
+#endif // ENCODER_USE_PCINT
+
 
 #endif
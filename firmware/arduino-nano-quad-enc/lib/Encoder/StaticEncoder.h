@@ -0,0 +1,193 @@
+/* Encoder with pins that are known at compile time.
+ *
+ * StaticEncoder<Pin1, Pin2> has the interface of Encoder (read, readLocked,
+ * readDoubleTransitionsLocked, write), but the port registers and bit
+ * masks of its pins are constants. update() reads the pins with single
+ * `in` instructions, without the pointer loads of
+ * Encoder_internal_state_t, and takes the movement from the transition
+ * table (utility/quadrature_table.h). The state is static: there is one
+ * encoder per pin pair.
+ *
+ * Pin1 must be an external interrupt pin (2 or 3 on the Nano), which is
+ * enabled for any edge. With Pin2Interrupt, Pin2 gets the pin change
+ * interrupt of its port, otherwise read() polls it. The sketch defines the
+ * interrupt routines, so that they contain only the update:
+ *
+ *   StaticEncoder<2, 4> enc_1;
+ *   ISR(INT0_vect) { enc_1.update(); }
+ *
+ * Several encoders on one port can share a snapshot of the port, with
+ * update_from(): one interrupt routine reads the port once and updates
+ * all of them.
+ *
+ * The resolution can be reduced at runtime with setEdges(): 4 counts every
+ * edge of both pins (default), 2 only the edges of Pin1, 1 one edge of Pin1
+ * per cycle. Then Pin2 is neither polled nor interrupt driven, it is only
+ * read at the edges of Pin1, which halves the interrupts with Pin2Interrupt.
+ * The position keeps its unit, steps of the 4x decoding.
+ *
+ * Only for the ATmega328 (Arduino Nano, Uno) and the host-native build.
+ * Encoder.h with ENCODER_OPTIMIZE_INTERRUPTS defines the same vectors, the
+ * two can't be used together.
+ */
+
+#ifndef StaticEncoder_h_
+#define StaticEncoder_h_
+
+#include "Arduino.h"
+#include "utility/quadrature_table.h"
+
+#if !defined(__AVR_ATmega328P__) && !defined(__AVR_ATmega168__) \
+	&& !defined(ARDUINO_NATIVE)
+#error "StaticEncoder supports only the ATmega328 and ATmega168."
+#endif
+
+// A digital pin of the ATmega328, with constant registers.
+template <uint8_t Pin>
+struct StaticPin {
+	static_assert(Pin < 20, "no digital pin");
+	// Bit in the port: D0..D7 port D, D8..D13 port B, A0..A5 port C.
+	static const uint8_t bit = Pin < 8 ? Pin : (Pin < 14 ? Pin - 8 : Pin - 14);
+	static const uint8_t mask = 1 << bit;
+	// Index of the pin change interrupt: PCINT0 port B, 1 port C, 2 port D.
+	static const uint8_t pcint = Pin < 8 ? 2 : (Pin < 14 ? 0 : 1);
+
+	static inline uint8_t read() {
+		return (Pin < 8 ? PIND : (Pin < 14 ? PINB : PINC)) & mask;
+	}
+	static inline void enable_pin_change_interrupt() {
+		(Pin < 8 ? PCMSK2 : (Pin < 14 ? PCMSK0 : PCMSK1)) |= mask;
+		PCICR |= 1 << pcint;
+	}
+	// The interrupt of the port stays enabled, for other pins.
+	static inline void disable_pin_change_interrupt() {
+		(Pin < 8 ? PCMSK2 : (Pin < 14 ? PCMSK0 : PCMSK1)) &= ~mask;
+	}
+};
+
+template <uint8_t Pin1, uint8_t Pin2, bool Pin2Interrupt = false>
+class StaticEncoder
+{
+public:
+	static_assert(Pin1 == 2 || Pin1 == 3, "Pin1 must be D2 or D3 (INT0, INT1)");
+
+	StaticEncoder() {
+		pinMode(Pin1, INPUT_PULLUP);
+		pinMode(Pin2, INPUT_PULLUP);
+		position = 0;
+		double_transitions = 0;
+		edges = 4;
+		table = encoder_entry_table;
+		// allow time for a passive R-C filter to charge
+		// through the pullup resistors, before reading
+		// the initial state
+		delayMicroseconds(2000);
+		state = pins() >> 2;
+		// Any edge of INT0 or INT1
+		uint8_t const interrupt = Pin1 - 2;
+		EICRA = (EICRA & ~(3 << (2 * interrupt))) | (1 << (2 * interrupt));
+		EIMSK |= 1 << interrupt;
+		if (Pin2Interrupt) {
+			StaticPin<Pin2>::enable_pin_change_interrupt();
+		}
+	}
+
+	static inline int32_t read() {
+		noInterrupts();
+		if (!Pin2Interrupt && edges == 4) update();
+		int32_t ret = position;
+		interrupts();
+		return ret;
+	}
+	// Like read(), but must be called with interrupts disabled, and leaves
+	// them disabled.
+	static inline int32_t readLocked() {
+		if (!Pin2Interrupt && edges == 4) update();
+		return position;
+	}
+	// Updates in which both pins changed: an edge was missed. Only with 4
+	// edges per cycle. Wraps around. Must be called with interrupts
+	// disabled.
+	static inline uint16_t readDoubleTransitionsLocked() {
+		return double_transitions;
+	}
+	static inline void write(int32_t p) {
+		noInterrupts();
+		position = p;
+		interrupts();
+	}
+	// Set the counted edges per cycle: 1, 2 or 4, other values are ignored.
+	// Must be called with interrupts disabled.
+	static void setEdges(uint8_t e) {
+		if (e != 1 && e != 2 && e != 4) return;
+		edges = e;
+		table = e == 4 ? encoder_entry_table
+		      : (e == 2 ? encoder_entry_table_2x : encoder_entry_table_1x);
+		if (Pin2Interrupt) {
+			if (e == 4) {
+				StaticPin<Pin2>::enable_pin_change_interrupt();
+			} else {
+				StaticPin<Pin2>::disable_pin_change_interrupt();
+			}
+		}
+		// Pin2 was not updated with fewer edges, this is no double
+		// transition.
+		state = pins() >> 2;
+	}
+	static inline uint8_t getEdges() {
+		return edges;
+	}
+
+	// For the interrupt routines of the sketch, and with interrupts
+	// disabled.
+	static inline void update() {
+		update_state(state | pins());
+	}
+	// Like update(), with the value of the input register of the port of
+	// both pins, e.g. PIND.
+	static inline void update_from(uint8_t port) {
+		static_assert(StaticPin<Pin1>::pcint == StaticPin<Pin2>::pcint,
+			"both pins must be on the same port");
+		update_state(state
+			| ((port & StaticPin<Pin1>::mask) ? 4 : 0)
+			| ((port & StaticPin<Pin2>::mask) ? 8 : 0));
+	}
+
+private:
+	// The movement and the double transition from the update table of the
+	// resolution.
+	static inline void update_state(uint8_t s) {
+		state = s >> 2;
+		int8_t const entry = encoder_table_read(table, s);
+		position += entry >> 1;
+		if (entry & 1) double_transitions++;
+	}
+	// The new pins in the bits 2 and 3 of the state.
+	static inline uint8_t pins() {
+		return (StaticPin<Pin1>::read() ? 4 : 0)
+		     | (StaticPin<Pin2>::read() ? 8 : 0);
+	}
+
+	// The old pins: bit 0 pin1, bit 1 pin2.
+	static volatile uint8_t state;
+	static volatile int32_t position;
+	static volatile uint16_t double_transitions;
+	// Counted edges per cycle, see setEdges().
+	static volatile uint8_t edges;
+	// Update table of `edges` (utility/quadrature_table.h), only changed
+	// with interrupts disabled.
+	static const int8_t * table;
+};
+
+template <uint8_t Pin1, uint8_t Pin2, bool Pin2Interrupt>
+volatile uint8_t StaticEncoder<Pin1, Pin2, Pin2Interrupt>::state;
+template <uint8_t Pin1, uint8_t Pin2, bool Pin2Interrupt>
+volatile int32_t StaticEncoder<Pin1, Pin2, Pin2Interrupt>::position;
+template <uint8_t Pin1, uint8_t Pin2, bool Pin2Interrupt>
+volatile uint16_t StaticEncoder<Pin1, Pin2, Pin2Interrupt>::double_transitions;
+template <uint8_t Pin1, uint8_t Pin2, bool Pin2Interrupt>
+volatile uint8_t StaticEncoder<Pin1, Pin2, Pin2Interrupt>::edges;
+template <uint8_t Pin1, uint8_t Pin2, bool Pin2Interrupt>
+const int8_t * StaticEncoder<Pin1, Pin2, Pin2Interrupt>::table;
+
+#endif
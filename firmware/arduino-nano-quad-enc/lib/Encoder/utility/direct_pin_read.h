@@ -8,6 +8,14 @@
 #define PIN_TO_BITMASK(pin)             (digitalPinToBitMask(pin))
 #define DIRECT_PIN_READ(base, mask)     (((*(base)) & (mask)) ? 1 : 0)
 
+/* Host-native build with the simulated Arduino Nano (firmware/native) */
+#elif defined(ARDUINO_NATIVE)
+
+#define IO_REG_TYPE			uint8_t
+#define PIN_TO_BASEREG(pin)             (portInputRegister(digitalPinToPort(pin)))
+#define PIN_TO_BITMASK(pin)             (digitalPinToBitMask(pin))
+#define DIRECT_PIN_READ(base, mask)     (((*(base)) & (mask)) ? 1 : 0)
+
 #elif defined(TEENSYDUINO) && (defined(KINETISK) || defined(KINETISL))
 
 #define IO_REG_TYPE			uint8_t
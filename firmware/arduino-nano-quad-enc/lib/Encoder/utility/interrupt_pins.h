@@ -37,6 +37,12 @@
   #define CORE_INT0_PIN		2
   #define CORE_INT1_PIN		3
 
+// Host-native build with the simulated Arduino Nano (firmware/native)
+#elif defined(ARDUINO_NATIVE)
+  #define CORE_NUM_INTERRUPT	2
+  #define CORE_INT0_PIN		2
+  #define CORE_INT1_PIN		3
+
 // Arduino Mega
 #elif defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
   #define CORE_NUM_INTERRUPT	6
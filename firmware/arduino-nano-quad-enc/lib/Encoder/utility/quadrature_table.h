@@ -0,0 +1,154 @@
+#ifndef quadrature_table_h_
+#define quadrature_table_h_
+
+#include <stdint.h>
+
+// Transition table of the quadrature decoder, generated at compile time.
+//
+// The index is the state of Encoder::update(): bit 0 old pin1, bit 1 old
+// pin2, bit 2 new pin1, bit 3 new pin2. The entry is the movement, the next
+// state is the index shifted right by 2. When both pins changed, the pin2
+// edge is assumed to come first (the pin1 edges are never missed), which
+// gives the +2/-2 entries. Both versions of Encoder::update() use it, the
+// assembly for AVR through the targets of its jump table.
+//
+// Plain C++11 without Arduino headers, the host benchmark in
+// test/encoder-decoder-benchmark includes it too. On AVR the tables are in
+// flash (a `const` array would be copied to the RAM of every translation
+// unit that includes this header), read them with encoder_table_read().
+
+#if defined(__AVR__)
+#include <avr/pgmspace.h>
+#define ENCODER_TABLE_STORAGE PROGMEM
+#else
+#define ENCODER_TABLE_STORAGE
+#endif
+
+// Position (0..3) of the pins `g` (bit 0 pin1, bit 1 pin2) in the positive
+// direction, which is 00, 10, 11, 01 (pin2 pin1).
+constexpr int8_t encoder_phase(uint8_t g) {
+	return (((g & 1) << 1) | (g >> 1)) ^ (g & 1);
+}
+
+// Movement between two pin states that differ in at most one pin.
+constexpr int8_t encoder_step(uint8_t from, uint8_t to) {
+	return ((encoder_phase(to) - encoder_phase(from) + 5) & 3) - 1;
+}
+
+// Movement for state `s`: through the intermediate state with the new pin2
+// and the old pin1.
+constexpr int8_t encoder_delta(uint8_t s) {
+	return encoder_step(s & 3, (s & 1) | ((s >> 2) & 2))
+	     + encoder_step((s & 1) | ((s >> 2) & 2), s >> 2);
+}
+
+// Did both pins change in state `s`? Then an edge was missed, and the
+// movement of the table is inferred.
+constexpr bool encoder_double_transition(uint8_t s) {
+	return ((s ^ (s >> 2)) & 3) == 3;
+}
+
+static constexpr int8_t encoder_delta_table[16] ENCODER_TABLE_STORAGE = {
+	encoder_delta(0),  encoder_delta(1),  encoder_delta(2),  encoder_delta(3),
+	encoder_delta(4),  encoder_delta(5),  encoder_delta(6),  encoder_delta(7),
+	encoder_delta(8),  encoder_delta(9),  encoder_delta(10), encoder_delta(11),
+	encoder_delta(12), encoder_delta(13), encoder_delta(14), encoder_delta(15)
+};
+
+// Target of the jump table of the assembly in Encoder::update(), which is
+// generated from the table: 0..4 for the movement -2..+2. An enum, so that
+// it is a constant for the "i" operands of the assembly also without
+// optimization.
+template <uint8_t s> struct encoder_jump {
+	enum { target = encoder_delta(s) + 2 };
+};
+
+// Reduced resolutions: Only the edges of pin1 are counted (2x), or only
+// the edges of pin1 while pin2 is high (1x), one edge per cycle in both
+// directions. The movement is in steps of the 4x decoding, 2 or 4 per
+// counted edge, so that the unit of the position does not change with the
+// resolution. The old pin2 is not used: pin2 is not updated between the
+// edges of pin1.
+constexpr int8_t encoder_delta_2x(uint8_t s) {
+	return ((s ^ (s >> 2)) & 1) == 0 ? 0
+	     : (((s >> 2) ^ (s >> 3)) & 1) == 0 ? 2 : -2;
+}
+constexpr int8_t encoder_delta_1x(uint8_t s) {
+	return (s & 8) == 0 ? 0 : 2 * encoder_delta_2x(s);
+}
+
+
+// Update tables of StaticEncoder, one per resolution, so that an update 
+// needs no branch on the resolution: The entry is the movement times 2, 
+// plus 1 for a double transition (only counted with all edges).
+constexpr int8_t encoder_entry(uint8_t s) {
+	return encoder_delta(s) * 2 + (encoder_double_transition(s) ? 1 : 0);
+}
+constexpr int8_t encoder_entry_2x(uint8_t s) {
+	return encoder_delta_2x(s) * 2;
+}
+constexpr int8_t encoder_entry_1x(uint8_t s) {
+	return encoder_delta_1x(s) * 2;
+}
+
+static constexpr int8_t encoder_entry_table[16] ENCODER_TABLE_STORAGE = {
+	encoder_entry(0),  encoder_entry(1),  encoder_entry(2),  encoder_entry(3),
+	encoder_entry(4),  encoder_entry(5),  encoder_entry(6),  encoder_entry(7),
+	encoder_entry(8),  encoder_entry(9),  encoder_entry(10), encoder_entry(11),
+	encoder_entry(12), encoder_entry(13), encoder_entry(14), encoder_entry(15)
+};
+static constexpr int8_t encoder_entry_table_2x[16] ENCODER_TABLE_STORAGE = {
+	encoder_entry_2x(0),  encoder_entry_2x(1),  encoder_entry_2x(2),  encoder_entry_2x(3),
+	encoder_entry_2x(4),  encoder_entry_2x(5),  encoder_entry_2x(6),  encoder_entry_2x(7),
+	encoder_entry_2x(8),  encoder_entry_2x(9),  encoder_entry_2x(10), encoder_entry_2x(11),
+	encoder_entry_2x(12), encoder_entry_2x(13), encoder_entry_2x(14), encoder_entry_2x(15)
+};
+static constexpr int8_t encoder_entry_table_1x[16] ENCODER_TABLE_STORAGE = {
+	encoder_entry_1x(0),  encoder_entry_1x(1),  encoder_entry_1x(2),  encoder_entry_1x(3),
+	encoder_entry_1x(4),  encoder_entry_1x(5),  encoder_entry_1x(6),  encoder_entry_1x(7),
+	encoder_entry_1x(8),  encoder_entry_1x(9),  encoder_entry_1x(10), encoder_entry_1x(11),
+	encoder_entry_1x(12), encoder_entry_1x(13), encoder_entry_1x(14), encoder_entry_1x(15)
+};
+
+static inline int8_t encoder_table_read(const int8_t *table, uint8_t s) {
+#if defined(__AVR__)
+	return (int8_t)pgm_read_byte(table + s);
+#else
+	return table[s];
+#endif
+}
+
+// The documented table of Encoder.h.
+static_assert(encoder_delta(1) == 1 && encoder_delta(2) == -1
+	&& encoder_delta(3) == 2 && encoder_delta(6) == -2
+	&& encoder_delta(9) == -2 && encoder_delta(12) == 2
+	&& encoder_delta(5) == 0 && encoder_delta(13) == -1,
+	"quadrature transition table");
+static_assert(encoder_double_transition(3) && encoder_double_transition(6)
+	&& encoder_double_transition(9) && encoder_double_transition(12)
+	&& !encoder_double_transition(1) && !encoder_double_transition(15),
+	"double transitions");
+// The assembly in Encoder::update() counts the double transitions at the
+// targets of +2 and -2.
+constexpr bool encoder_double_transitions_are_steps_of_2(uint8_t s) {
+	return s == 16 || (encoder_double_transition(s)
+		== (encoder_delta(s) == 2 || encoder_delta(s) == -2)
+		&& encoder_double_transitions_are_steps_of_2(s + 1));
+}
+static_assert(encoder_double_transitions_are_steps_of_2(0),
+	"double transitions are the steps of 2");
+// Positive direction 00, 10, 11, 01 (pin2 pin1): pin1 rises with pin2 high
+// (state 2 | 3 << 2 = 14), and falls with pin2 low (1 | 0 << 2 = 1).
+static_assert(encoder_delta_2x(14) == 2 && encoder_delta_2x(1) == 2
+	&& encoder_delta_2x(11) == -2 && encoder_delta_2x(4) == -2
+	&& encoder_delta_2x(8) == 0 && encoder_delta_2x(13) == 0
+	&& encoder_delta_1x(14) == 4 && encoder_delta_1x(11) == -4
+	&& encoder_delta_1x(1) == 0 && encoder_delta_1x(4) == 0,
+	"reduced resolutions");
+// The movement is the entry shifted right by 1, also when it is negative.
+static_assert((encoder_entry(6) >> 1) == -2 && (encoder_entry(6) & 1)
+	&& (encoder_entry(2) >> 1) == -1 && !(encoder_entry(2) & 1)
+	&& (encoder_entry_1x(11) >> 1) == -4 && (encoder_entry(12) >> 1) == 2,
+	"entries of the update tables");
+
+#endif
@@ -3,9 +3,64 @@
 // ============================================================================
 
 // This program is an I2C device, that counts pulses from 2 quadrature encoders.
+//
+// When both pins of an encoder changed between two updates, an edge was 
+// missed, and the movement is inferred. These double transitions are 
+// counted, with the iterations of `loop()` that took too long 
+// (`REG_DIAGNOSTICS`). The host can then tell when the encoders are faster 
+// than the board.
+//
+// With `USE_STATIC_ENCODERS`, the resolution can be switched at runtime 
+// (`REG_COUNT_MODE`): At high speed only the edges of the first pins are 
+// counted, then the second pins need neither polling nor interrupts. The 
+// counters keep their unit.
+//
+// The I2C address, the order and directions of the encoders, and the 
+// resolution can be stored in the EEPROM (`REG_CONFIG`), the master writes
+// them over I2C. The jumpers are the fallback for boards without a 
+// configuration, and closed jumpers override it.
 
-#include "Encoder.h"
+// The flags can also be set in `platformio.ini`, e.g. 
+// `-D USE_PIN_CHANGE_INTERRUPTS=true`.
+
+// Decode the second pins of the encoders (D4, D5) in the pin change interrupt
+// of port D, instead of polling them in `loop()` and `Encoder::read()`. 
+// Both pins of both encoders are then interrupt driven (4x decoding in 
+// interrupts), at the price of twice as many interrupts.
+#ifndef USE_PIN_CHANGE_INTERRUPTS
+  #define USE_PIN_CHANGE_INTERRUPTS false
+#endif
+// Use `StaticEncoder`, with the pins as compile time constants, and the 
+// interrupt routines below, instead of `Encoder`.
+#ifndef USE_STATIC_ENCODERS
+  #define USE_STATIC_ENCODERS false
+#endif
+// One interrupt routine for all pins of both encoders (all on port D): It
+// reads PIND once and updates both encoders. Edges of both encoders, that
+// arrive while the routine waits or runs, then cost only one interrupt.
+// Needs `USE_STATIC_ENCODERS`.
+#ifndef BATCH_ENCODER_INTERRUPTS
+  #define BATCH_ENCODER_INTERRUPTS false
+#endif
+
+#if BATCH_ENCODER_INTERRUPTS && !USE_STATIC_ENCODERS
+  #error "BATCH_ENCODER_INTERRUPTS needs USE_STATIC_ENCODERS."
+#endif
+
+#if USE_STATIC_ENCODERS
+  #include "StaticEncoder.h"
+#else
+  // Configuration of the Encoder library: Its own interrupt routines, with 
+  // the update inlined as assembly.
+  #define ENCODER_OPTIMIZE_INTERRUPTS
+  #if USE_PIN_CHANGE_INTERRUPTS
+    #define ENCODER_USE_PCINT
+  #endif
+  #include "Encoder.h"
+#endif
 #include <Wire.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
 
 // --- Quadrature Encoder Constants -------------------------------------------
 // Interrupt capable pins on Arduino Nano: D2, D3
@@ -35,9 +90,76 @@ byte const REG_WHOAMI = 0x01;
 byte const REG_RESET = 0x0C;
 // The counters, readable, 2 long
 byte const REG_COUNT = 0x10;
+// Shadow registers, readable, 3 long: The time of the latch (microseconds)
+// and the 2 counters. Writing 1 byte (any value) latches: The time and the
+// counters are copied into the shadow registers. Written to the general 
+// call address (0), all boards on the bus latch at the same moment.
+byte const REG_LATCH = 0x62;
+// Diagnostics, readable, 4 uint16_t:
+// * Overruns: The iterations of `loop()` that took longer than 
+//   `LOOP_OVERRUN_US`.
+// * The longest iteration of `loop()` since the previous read of this 
+//   register, in microseconds, saturated.
+// * For each encoder, in the order of `REG_COUNT`: The double 
+//   transitions, see `Encoder`. Without pin change interrupts, they are 
+//   the edges of the second pin that were not polled in time; the movement
+//   is then still right. With pin change interrupts, an edge was lost and 
+//   the direction is a guess.
+// The counters wrap around, the master uses their differences. Double 
+// transitions are only counted with 4 edges per cycle.
+byte const REG_DIAGNOSTICS = 0x63;
+// Counted edges per cycle of the encoders, r/w, 1 byte: 4 all edges of 
+// both pins (default), 2 the edges of the first pins (D2, D3), 1 one edge 
+// of the first pins per cycle. The counters are always in steps of 4 per 
+// cycle, with fewer edges they step by 2 or 4. Other values are ignored. 
+// Needs `USE_STATIC_ENCODERS`: `Encoder` counts only 4, without it the 
+// register is unknown, writes are ignored and reads return 0.
+byte const REG_COUNT_MODE = 0x65;
+// The configuration in the EEPROM, r/w, `CONFIG_LENGTH` bytes, the same 
+// layout as in the simple pulse firmware:
+// * The version of the layout, `CONFIG_VERSION`.
+// * The I2C address, 0 for `I2C_ADDR_BASE`. Closed address jumpers 
+//   override it.
+// * The position of encoder 1 and 2 in `REG_COUNT`, 0 or 1, and 2 unused 
+//   bytes.
+// * Inverted encoders: bit 0 encoder 1, bit 1 encoder 2. Closed direction 
+//   jumpers invert their encoder again.
+// * The count mode, see `REG_COUNT_MODE`, 0 for the default. Ignored 
+//   without `USE_STATIC_ENCODERS`.
+// * 1 unused byte. (The glitch filter of the simple pulse firmware.)
+// * CRC-16 of the previous bytes (`_crc16_update`, start value 0xFFFF).
+// A valid block is written into the EEPROM in the background, while 
+// `loop()` runs, and is used at the next start. Blocks with an other 
+// version, invalid values or a wrong CRC are ignored. A read returns the 
+// stored block, and 1 byte: the number of bytes that are not yet written 
+// into the EEPROM.
+byte const REG_CONFIG = 0x66;
 
 // Response string for CMD_WHOAMI
 byte const WHOAMI_RESP[] = {"odqe01"};
+// Length of the counters, in `REG_COUNT` and `REG_LATCH`.
+byte const COUNT_LENGTH = 2 * sizeof(int32_t);
+// Length of the time in `REG_LATCH`.
+byte const TIME_LENGTH = sizeof(uint32_t);
+// Length of `REG_DIAGNOSTICS`.
+byte const DIAGNOSTICS_LENGTH = 4 * sizeof(uint16_t);
+
+// --- Configuration Constants ------------------------------------------------
+// Version of the layout of `REG_CONFIG`.
+byte const CONFIG_VERSION = 1;
+// Offsets of the fields in `REG_CONFIG`, and its length.
+byte const CONFIG_ADDRESS = 1;
+byte const CONFIG_MAP = 2;
+byte const CONFIG_INVERTED = 6;
+byte const CONFIG_COUNT_MODE = 7;
+byte const CONFIG_CRC = 9;
+byte const CONFIG_LENGTH = CONFIG_CRC + sizeof(uint16_t);
+// Address of the configuration in the EEPROM. It is fixed, so that other 
+// versions of the firmware find it.
+uintptr_t const CONFIG_EEPROM_ADDRESS = 0;
+// Range of the I2C addresses that are not reserved.
+byte const I2C_ADDR_MIN = 0x08;
+byte const I2C_ADDR_MAX = 0x77;
 
 // --- Constants for low frequency activity LED -------------------------------
 // Time between checks for activity, in microseconds. Also blink frequency / 2.
@@ -45,17 +167,41 @@ unsigned long const BLINK_US = 250000L;
 // Estimated average duration of the main loop in microseconds.
 unsigned long const LOOP_US = 20;
 unsigned long const LOOP_COUNTER_START = BLINK_US / LOOP_US;
+// An iteration of the main loop that is longer is an overrun, in 
+// microseconds.
+unsigned long const LOOP_OVERRUN_US = 100;
 
 // --- Global Variables -------------------------------------------------------
 // Selector for the internal registers.
 byte cmdReg = REG_NONE;
 // The reader objects for the encoders.
-Encoder enc_1(ENC_1_PIN_1, ENC_1_PIN_2);
-Encoder enc_2(ENC_2_PIN_1, ENC_2_PIN_2);
-// Temporary counters for sending on I2C-Bus.
-// `Encoder::read` can't be called inside `requestEvent`.
-long temp_counter_1 = 0;
-long temp_counter_2 = 0;
+#if USE_STATIC_ENCODERS
+  StaticEncoder<ENC_1_PIN_1, ENC_1_PIN_2, USE_PIN_CHANGE_INTERRUPTS> enc_1;
+  StaticEncoder<ENC_2_PIN_1, ENC_2_PIN_2, USE_PIN_CHANGE_INTERRUPTS> enc_2;
+#else
+  Encoder enc_1(ENC_1_PIN_1, ENC_1_PIN_2);
+  Encoder enc_2(ENC_2_PIN_1, ENC_2_PIN_2);
+#endif
+// Counting direction of the encoders, set with the configuration and the 
+// direction jumpers: 1, -1
+int32_t enc_1_direction = 1;
+int32_t enc_2_direction = 1;
+// Positions of the encoders in the counter buffer, set with the 
+// configuration.
+byte enc_1_index = 0;
+byte enc_2_index = sizeof(int32_t);
+// Image of the configuration in the EEPROM, see `REG_CONFIG`, and the 
+// number of bytes at its end, that are not yet written into the EEPROM.
+byte config_block[CONFIG_LENGTH];
+byte config_unwritten = 0;
+// Shadow registers, see `REG_LATCH`: The time and the counters at the last
+// latch, in the format that is sent over I2C.
+byte latch_buffer[TIME_LENGTH + COUNT_LENGTH] = {0};
+// Diagnostics, see `REG_DIAGNOSTICS`: Overruns, the start of the previous 
+// iteration of the main loop, and the longest iteration in microseconds.
+uint16_t overruns = 0;
+unsigned long last_loop_us = 0;
+unsigned long max_loop_us = 0;
 // Low frequency activity LED: state and counters.
 bool led_state = LOW;
 unsigned long loop_counter = LOOP_COUNTER_START;
@@ -63,9 +209,154 @@ long old_counter_1 = 0;
 long old_counter_2 = 0;
 
 
+#if USE_STATIC_ENCODERS && BATCH_ENCODER_INTERRUPTS
+// Update both encoders from one snapshot of port D.
+// The pending interrupts of the encoder pins are cleared first: The 
+// snapshot contains their edges. Edges after the clear trigger the next 
+// interrupt.
+inline void update_encoders() {
+  EIFR = _BV(INTF0) | _BV(INTF1);
+  #if USE_PIN_CHANGE_INTERRUPTS
+    PCIFR = _BV(PCIF2);
+  #endif
+  byte const pins = PIND;
+  enc_1.update_from(pins);
+  enc_2.update_from(pins);
+}
+
+ISR(INT0_vect) { update_encoders(); }
+ISR(INT1_vect) { update_encoders(); }
+#if USE_PIN_CHANGE_INTERRUPTS
+ISR(PCINT2_vect) { update_encoders(); }
+#endif
+
+#elif USE_STATIC_ENCODERS
+// Interrupt routines of the encoders: D2 (INT0) encoder 1, D3 (INT1) 
+// encoder 2, D4 and D5 (PCINT2) both encoders.
+ISR(INT0_vect) { enc_1.update(); }
+ISR(INT1_vect) { enc_2.update(); }
+#if USE_PIN_CHANGE_INTERRUPTS
+ISR(PCINT2_vect) { enc_1.update(); enc_2.update(); }
+#endif
+#endif
+
+
+// Function to convert a int32_t into bytes in network order.
+void convert_to_network(int32_t const num, byte * buf) {
+  buf[3] = num & 0xFF;
+  buf[2] = (num >> 8) & 0xFF;
+  buf[1] = (num >> 16) & 0xFF;
+  buf[0] = (num >> 24) & 0xFF;
+}
+
+// Fill the buffer with both counters, taken at the same instant, in the 
+// format that is sent over I2C.
+// Must be called with interrupts disabled, e.g. in the I2C events. 
+// (`Encoder::read` would enable them.)
+void fill_counter_buffer(byte * buf) {
+  convert_to_network(enc_1_direction * enc_1.readLocked(), &buf[enc_1_index]);
+  convert_to_network(enc_2_direction * enc_2.readLocked(), &buf[enc_2_index]);
+}
+
+// Function to convert a uint16_t into bytes in network order.
+void convert_to_network_16(uint16_t const num, byte * buf) {
+  buf[1] = num & 0xFF;
+  buf[0] = (num >> 8) & 0xFF;
+}
+
+// Set the counted edges per cycle of both encoders, see `REG_COUNT_MODE`.
+// Must be called with interrupts disabled.
+void set_count_mode(byte edges) {
+  #if USE_STATIC_ENCODERS
+    enc_1.setEdges(edges);
+    enc_2.setEdges(edges);
+  #else
+    (void)edges;
+  #endif
+}
+
+#if USE_STATIC_ENCODERS
+// The counted edges per cycle.
+byte get_count_mode() {
+  return enc_1.getEdges();
+}
+#endif
+
+// CRC-16 of the configuration `block`, without its CRC.
+uint16_t config_crc(byte const * block) {
+  uint16_t crc = 0xFFFF;
+  for (byte i = 0; i < CONFIG_CRC; ++i) {
+    crc = _crc16_update(crc, block[i]);
+  }
+  return crc;
+}
+
+// Is `block` a configuration of this version, with valid values and CRC?
+bool is_config_valid(byte const * block) {
+  if (block[0] != CONFIG_VERSION) { return false; }
+  byte const address = block[CONFIG_ADDRESS];
+  if (address != 0 && (address < I2C_ADDR_MIN || address > I2C_ADDR_MAX)) {
+    return false;
+  }
+  // Each position in `REG_COUNT` must be used once.
+  if (block[CONFIG_MAP] + block[CONFIG_MAP + 1] != 1
+      || block[CONFIG_MAP] > 1) {
+    return false;
+  }
+  byte const mode = block[CONFIG_COUNT_MODE];
+  if (mode != 0 && mode != 1 && mode != 2 && mode != 4) { return false; }
+  uint16_t const crc = (block[CONFIG_CRC] << 8) | block[CONFIG_CRC + 1];
+  return crc == config_crc(block);
+}
+
+// Store the configuration `block` that the master wrote, if it is valid.
+// `loop()` writes it into the EEPROM.
+void write_config(byte const * block) {
+  if (!is_config_valid(block)) { return; }
+  memcpy(config_block, block, CONFIG_LENGTH);
+  config_unwritten = CONFIG_LENGTH;
+}
+
+// Write the next byte of the configuration into the EEPROM, if the EEPROM 
+// is ready. Writing a byte takes 3.4 ms, `loop()` does not wait for it.
+// The CRC is written last: An interrupted write leaves an invalid block.
+void write_config_step() {
+  if (config_unwritten == 0 || !eeprom_is_ready()) { return; }
+  noInterrupts();
+  byte const index = CONFIG_LENGTH - config_unwritten;
+  --config_unwritten;
+  eeprom_update_byte((uint8_t *)(CONFIG_EEPROM_ADDRESS + index), 
+                     config_block[index]);
+  interrupts();
+}
+
+// Fill the buffer with the diagnostics, and restart the longest iteration.
+// Must be called with interrupts disabled.
+void read_diagnostics(byte * buf) {
+  convert_to_network_16(overruns, &buf[0]);
+  convert_to_network_16(max_loop_us < 0xFFFF ? max_loop_us : 0xFFFF, &buf[2]);
+  max_loop_us = 0;
+  // In the order of the counters in `REG_COUNT`.
+  convert_to_network_16(enc_1.readDoubleTransitionsLocked(), 
+                        &buf[4 + enc_1_index / 2]);
+  convert_to_network_16(enc_2.readDoubleTransitionsLocked(), 
+                        &buf[4 + enc_2_index / 2]);
+}
+
+// Measure the time since the previous iteration of the main loop.
+// Must be called with interrupts disabled.
+void check_loop_time() {
+  unsigned long const now = micros();
+  unsigned long const loop_us = now - last_loop_us;
+  last_loop_us = now;
+  if (loop_us > LOOP_OVERRUN_US) { ++overruns; }
+  if (loop_us > max_loop_us) { max_loop_us = loop_us; }
+}
+
+
 // Function that executes whenever data is received from master.
 // This function is registered as an event, see `setup()`.
-void receiveEvent(int _) {
+void receiveEvent(int) {
   while (Wire.available() > 0) {
     switch (cmdReg) {
       // If the register is not set, the current byte is
@@ -74,24 +365,20 @@ void receiveEvent(int _) {
         cmdReg = Wire.read();
         //Serial.print("Register: ");
         //Serial.println(cmdReg, HEX);
- 
-        // Also read the counters because we can't read them in the `requestEvent` function.
-        temp_counter_1 = enc_1.read();
-        temp_counter_2 = enc_2.read();
         break;
 
       // Command: Reset the counters to a specified value.
       case REG_RESET:
       {
-        byte buf[4]; // long is 4 bytes
+        byte buf[4]; // int32_t is 4 bytes
         buf[3] = Wire.read();
         buf[2] = Wire.read();
         buf[1] = Wire.read();
         buf[0] = Wire.read();
         // TODO: No copying, make `buf` only a pointer to `newPosition`.
-        long newPosition = *(long *)buf;
-        enc_1.write(newPosition);
-        enc_2.write(newPosition);
+        int32_t newPosition = *(int32_t *)buf;
+        enc_1.write(enc_1_direction * newPosition);
+        enc_2.write(enc_2_direction * newPosition);
         //Serial.print("Reset. Receive new value: ");
         //Serial.println(newPosition, DEC);
  
@@ -99,6 +386,62 @@ void receiveEvent(int _) {
         cmdReg = REG_NONE;
         break;
       }
+      // Command: Latch the counters into the shadow registers.
+      case REG_LATCH:
+        if (Wire.available() == 1) {
+          Wire.read(); // The value is ignored.
+          convert_to_network(micros(), &latch_buffer[0]);
+          fill_counter_buffer(&latch_buffer[TIME_LENGTH]);
+          //Serial.println("Latch.");
+        }
+        else {
+          // A wrong length is an error, ignore the bytes.
+          while (0 < Wire.available()) {
+            Wire.read();
+          }
+        }
+
+        // The command is finished, reset the register state
+        cmdReg = REG_NONE;
+        break;
+
+      // Command: Set the counted edges per cycle.
+      // (`Encoder` can't, the register is unknown without static encoders.)
+      #if USE_STATIC_ENCODERS
+      case REG_COUNT_MODE:
+        if (Wire.available() == 1) {
+          set_count_mode(Wire.read());
+        }
+        else {
+          // A wrong length is an error, ignore the bytes.
+          while (0 < Wire.available()) {
+            Wire.read();
+          }
+        }
+        // The command is finished, reset the register state
+        cmdReg = REG_NONE;
+        break;
+      #endif
+
+      // Command: Store a new configuration.
+      case REG_CONFIG:
+        if (Wire.available() == CONFIG_LENGTH) {
+          byte buf[CONFIG_LENGTH];
+          for (byte i = 0; i < CONFIG_LENGTH; ++i) {
+            buf[i] = Wire.read();
+          }
+          write_config(buf);
+        }
+        else {
+          // A wrong length is an error, ignore the bytes.
+          while (0 < Wire.available()) {
+            Wire.read();
+          }
+        }
+        // The command is finished, reset the register state
+        cmdReg = REG_NONE;
+        break;
+
       // Error: Read all bytes in this transaction
       default:
       {
@@ -134,30 +477,58 @@ void requestEvent() {
 
     // Command: Send the counter values
     case REG_COUNT:
+    {
+      // The snapshot is taken when the master reads, not when it selects
+      // the register.
+      byte buf[COUNT_LENGTH];
+      fill_counter_buffer(buf);
+      Wire.write(buf, COUNT_LENGTH);
       //Serial.print("Send counter values. 1: ");
       //Serial.println(enc_1.read(), DEC);
-      byte buf[4]; // long is 4 bytes
-      //*(long *)buf = enc_1.read();
-      // TODO: No copying, make `buf` only a pointer to `newPosition`.
-      *(long *)buf = temp_counter_1;
-      Wire.write(buf[3]);
-      Wire.write(buf[2]);
-      Wire.write(buf[1]);
-      Wire.write(buf[0]);
- 
-      //Serial.print(", 2: ");
-      //Serial.println(enc_2.read(), DEC);
-      //*(long *)buf = enc_2.read();
-      // TODO: No copying, make `buf` only a pointer to `newPosition`.
-      *(long *)buf = temp_counter_2;
-      Wire.write(buf[3]);
-      Wire.write(buf[2]);
-      Wire.write(buf[1]);
-      Wire.write(buf[0]);
  
       // The command is finished, reset the register state
       cmdReg = REG_NONE;
       break;
+    }
+
+    // Command: Send the shadow registers
+    case REG_LATCH:
+      Wire.write(latch_buffer, sizeof(latch_buffer));
+      // The command is finished, reset the register state
+      cmdReg = REG_NONE;
+      break;
+
+    // Command: Send the diagnostics
+    case REG_DIAGNOSTICS:
+    {
+      byte buf[DIAGNOSTICS_LENGTH];
+      read_diagnostics(buf);
+      Wire.write(buf, DIAGNOSTICS_LENGTH);
+      // The command is finished, reset the register state
+      cmdReg = REG_NONE;
+      break;
+    }
+
+    // Command: Send the counted edges per cycle
+    #if USE_STATIC_ENCODERS
+    case REG_COUNT_MODE:
+      Wire.write(get_count_mode());
+      // The command is finished, reset the register state
+      cmdReg = REG_NONE;
+      break;
+    #endif
+
+    // Command: Send the configuration and the bytes not yet written
+    case REG_CONFIG:
+    {
+      byte buf[CONFIG_LENGTH + 1];
+      memcpy(buf, config_block, CONFIG_LENGTH);
+      buf[CONFIG_LENGTH] = config_unwritten;
+      Wire.write(buf, CONFIG_LENGTH + 1);
+      // The command is finished, reset the register state
+      cmdReg = REG_NONE;
+      break;
+    }
 
     // Error
     default:
@@ -173,22 +544,36 @@ void requestEvent() {
 // --- Startup -----------------------------------------------------------------
 // Function that is called once at startup.
 void setup() {
+    // Read the configuration ---------
+    // The whole block at once, see `REG_CONFIG`. Reading the EEPROM needs 
+    // no delay.
+    eeprom_read_block(config_block, (void const *)CONFIG_EEPROM_ADDRESS,
+                      CONFIG_LENGTH);
+    bool const configured = is_config_valid(config_block);
+
     // Init I2C -----------------------
-    // Compute I2C address, respecting address jumpers.
+    // Compute I2C address, from the configuration or the address jumpers.
     // Address jumpers must be connected to ground.
     pinMode(I2C_ADDR_PIN_1, INPUT_PULLUP);
     pinMode(I2C_ADDR_PIN_2, INPUT_PULLUP);
-    byte i2c_address = I2C_ADDR_BASE;
+    byte jumpers = 0;
     if (digitalRead(I2C_ADDR_PIN_1) == LOW) {
-        i2c_address += 1;
+        jumpers += 1;
     }
     if (digitalRead(I2C_ADDR_PIN_2) == LOW) {
-        i2c_address += 2;
+        jumpers += 2;
+    }
+    byte i2c_address = I2C_ADDR_BASE + jumpers;
+    // Closed jumpers override the configured address.
+    if (configured && config_block[CONFIG_ADDRESS] != 0 && jumpers == 0) {
+        i2c_address = config_block[CONFIG_ADDRESS];
     }
     // Init I2C subsystem
     Wire.begin(i2c_address);         // join i2c bus as slave
     Wire.onReceive(receiveEvent); // register event
     Wire.onRequest(requestEvent); // register event
+    // Also receive the general call, for `REG_LATCH`.
+    TWAR |= _BV(TWGCE);
     // Switch the pullup resistors off for the I2C pins.
     digitalWrite(SDA, LOW);
     digitalWrite(SCL, LOW);
@@ -196,37 +581,54 @@ void setup() {
     // Init activity LED --------------
     pinMode(LED_BUILTIN, OUTPUT);
 
-    // Init encoder library --------------
+    // Init encoder order, direction and resolution ----------
+    if (configured) {
+        enc_1_index = config_block[CONFIG_MAP] * sizeof(int32_t);
+        enc_2_index = config_block[CONFIG_MAP + 1] * sizeof(int32_t);
+        if (config_block[CONFIG_INVERTED] & 1) {
+            enc_1_direction = -1;
+        }
+        if (config_block[CONFIG_INVERTED] & 2) {
+            enc_2_direction = -1;
+        }
+        noInterrupts();
+        set_count_mode(config_block[CONFIG_COUNT_MODE]);
+        interrupts();
+    }
     // Direction jumpers must be connected to ground.
+    // The encoders are not created again with exchanged pins: The interrupts 
+    // would then update the destroyed temporary objects.
     pinMode(ENC_1_DIRECTION_PIN, INPUT_PULLUP);
     pinMode(ENC_2_DIRECTION_PIN, INPUT_PULLUP);
     if (digitalRead(ENC_1_DIRECTION_PIN) == LOW) {
-        enc_1 = Encoder(ENC_1_PIN_2, ENC_1_PIN_1);
+        enc_1_direction = -enc_1_direction;
     }
-    else {
-        enc_1 = Encoder(ENC_1_PIN_1, ENC_1_PIN_2);
-    }
-    if (digitalRead(ENC_2_DIRECTION_PIN) == LOW)
-    {
-        enc_2 = Encoder(ENC_2_PIN_2, ENC_2_PIN_2);
-    }
-    else {
-        enc_2 = Encoder(ENC_2_PIN_1, ENC_2_PIN_2);
+    if (digitalRead(ENC_2_DIRECTION_PIN) == LOW) {
+        enc_2_direction = -enc_2_direction;
     }
 
     // start serial for output --------
     //Serial.begin(9600);
     //Serial.println("I2C Test");
+
+    // The first iteration is not an overrun.
+    last_loop_us = micros();
 }
 
 
 // --- Run --------------------------------------------------------------------
 // Function that is called forever in a loop.
 void loop() {
-  // Read the encoders because they have only one interrupt pin.
+  // Read the encoders. Without pin change interrupts, this also polls the 
+  // second pins (only with 4 edges per cycle).
   long counter_1, counter_2;
   counter_1 = enc_1.read();
   counter_2 = enc_2.read();
+
+  // Measure the iteration, for the diagnostics.
+  noInterrupts();
+  check_loop_time();
+  interrupts();
  
   // Decrement counter for low frequency LED.
   -- loop_counter;
@@ -247,4 +649,7 @@ void loop() {
         //Serial.println(counter_2, DEC);
     }
   }
+
+  // Store the configuration.
+  write_config_step();
 }
@@ -5,26 +5,182 @@
 // This program is an I2C device, that counts pulses from four (Hall) sensors.
 //
 // This program uses polling, to read four pins, which is fast enough and
-// simple.
+// simple. All four pins are on port D, so the whole port is read at once
+// (`PIND`) and the changed pins are found with a single XOR against the
+// previous snapshot.
 //
 // Polling does also not interfere with I2C, which uses interrupts internally.
 // However I2C interferes with polling, because it uses considerable amounts of
-// time and makes the program potentially miss counts.
+// time and makes the program potentially miss counts. Therefore the I2C 
+// callbacks can be interrupted (`NESTED_I2C_CALLBACKS`): They mask the TWI 
+// interrupt and enable the others again, and the pin change interrupt of 
+// port D counts while they run. Interrupts are only disabled while a 
+// callback copies the counters, and at the beginning and the end of the TWI
+// interrupt. The latency of counting no longer depends on the length of 
+// the callbacks, see "I2C Functions" for its bound.
 //
 // The 16 MHz Arduino Nano was tested with 5kHz pulses on each pin and worked 
-// well. A 8 MHz version might start to miss pulses at 5 kHz, during I2C
-// communication.
+// well, when the pins were still read with `digitalRead`. A 8 MHz version
+// might start to miss pulses at 5 kHz, during I2C communication. See
+// `test/arduino-nano-count-benchmark` for the cycle counts of both
+// algorithms. `test/simavr-benchmark` is meant to measure the highest 
+// pulse rate without lost counts reproducibly, in a cycle accurate 
+// simulator, but has not been run yet. The host-native build estimates, 
+// with guessed costs: 26 kHz on each input without I2C, 21.6 kHz while the 
+// counters are read with 1 kHz (see `firmware/native/src/benchmark.cpp`).
 //
 // The Arduino Nano has only two Pins with fast "Pin Interrupts": D2, D3.
 // Additionally the Nano has "Pin Change Interrupts" which work on all pins,
 // but are more complicated and slower.
+//
+// Alternatively the pulses can be counted in the "Pin Change Interrupt" of
+// port D (`PCINT2`), see `COUNT_IN_INTERRUPT`. The interrupt handler
+// decodes all changed pins in one pass, the main loop only does
+// housekeeping. I2C can then only delay counting, but pulses are not lost
+// as long as each pin changes at most once while the interrupts are 
+// disabled.
+//
+// Two inputs can be counted entirely in hardware, by the timers of the
+// ATmega328: D5 (T1) clocks Timer1 and D4 (T0) clocks Timer0, see
+// `COUNT_T1_IN_HARDWARE` and `COUNT_T0_IN_HARDWARE`. These inputs are
+// independent of the CPU load and work up to several MHz. The timers count
+// only one edge per pulse, the counter value is computed from the timer and
+// the current level of the pin.
+//
+// For each input the time of the last edge and the period between the last
+// two edges are recorded (`REG_EDGE_TIMES`). From these values the host
+// can compute the speed precisely, even when the wheels turn slowly.
+//
+// For the highest precision one input can additionally be connected to D8 
+// (ICP1) with a wire, see `MEASURE_PERIODS_ON_ICP1`. The input capture unit 
+// of Timer1 then measures its periods with the resolution of the CPU clock 
+// (62.5 ns), independent of the latency of the loop or of interrupts.
+//
+// The I2C interface is a map of registers: A read starts at the selected
+// register and continues with the following registers. The master can read
+// status, counters and edge times in one transaction.
+//
+// The counters can also be sampled at a fixed rate, by the interrupt of 
+// Timer2. The samples are stored in a FIFO, which the master can read in
+// batches (`REG_FIFO_DATA`).
+//
+// For frequent polling there are compact delta counters (`REG_DELTA`): The
+// changes since the previous read, as int8_t or int16_t if they fit.
+//
+// Polling can't see an edge that is followed by a second edge of the same
+// pin before the next poll. The firmware counts the situations in which
+// this can happen (`REG_DIAGNOSTICS`): Long iterations of `loop()`, and 
+// inputs that change as fast as they are polled. The host can then tell
+// when the pulses exceed the capacity of the board.
+//
+// Ringing and interference of the motors can produce short pulses, which 
+// would be counted. The polled inputs can be filtered (`REG_FILTER`): A new
+// level is only counted after it was stable for a minimum time. The filter
+// is a vertical counter, which debounces all inputs at once with a few 
+// bitwise operations per poll.
+//
+// The inputs count both edges of a pulse, or only the rising edges 
+// (`REG_COUNT_MODE`). Counting only the rising edges halves the work per 
+// pulse, and the edge times then measure whole periods, independent of the
+// duty cycle of the sensors.
+//
+// The I2C address, the mapping of the inputs to the counters, the count 
+// mode and the glitch filter can be stored in the EEPROM (`REG_CONFIG`), 
+// the master writes them over I2C. `setup()` reads them in one pass. The 
+// jumpers are the fallback for boards without a configuration, and closed 
+// jumpers override it.
+//
+// A profiling build (`RECORD_TIMING`) records the timing on a deployed car
+// (`REG_TIMING`): Histograms of the loop periods and of the durations of 
+// the I2C callbacks, measured in CPU cycles with Timer1, in buckets of 
+// powers of 2.
 
 #include "Arduino.h"
+#include <avr/eeprom.h>
+#include <util/crc16.h>
 #include <Wire.h>
+extern "C" {
+  #include "utility/twi.h"
+}
+
+
+// The flags can also be set in `platformio.ini`, e.g. `-D DEBUG_RL_PINS=true`.
+
+// Use the RL-Pins for debug and test output: D6 is high while `loop()` runs,
+// D7 while the I2C callbacks run. (`RECORD_TIMING` measures the same 
+// without an oscilloscope, and keeps the RL jumpers.)
+#ifndef DEBUG_RL_PINS
+  #define DEBUG_RL_PINS false
+#endif
+// Count the pulses in the pin change interrupt of port D, instead of polling
+// the pins in `loop()`.
+#ifndef COUNT_IN_INTERRUPT
+  #define COUNT_IN_INTERRUPT false
+#endif
+// Run the I2C callbacks with interrupts enabled, so that counting preempts
+// them, see `begin_i2c_callback()`. With polling, the pin change interrupt 
+// of port D counts while a callback runs.
+#ifndef NESTED_I2C_CALLBACKS
+  #define NESTED_I2C_CALLBACKS true
+#endif
+// Count the pulses on D5 (`PLUG_1_PIN_2`) with Timer1.
+#ifndef COUNT_T1_IN_HARDWARE
+  #define COUNT_T1_IN_HARDWARE false
+#endif
+// Count the pulses on D4 (`PLUG_2_PIN_2`) with Timer0.
+// Timer0 is also used by `millis()`, `micros()` and `delay()`, which don't
+// work in this mode.
+#ifndef COUNT_T0_IN_HARDWARE
+  #define COUNT_T0_IN_HARDWARE false
+#endif
+// Record the time of the last edge and the period of each input.
+// (Not for the inputs that are counted in hardware.) Needs Timer0 for the
+// time.
+#ifndef RECORD_EDGE_TIMES
+  #define RECORD_EDGE_TIMES (!COUNT_T0_IN_HARDWARE)
+#endif
+
+// Measure the periods of the signal on D8 (ICP1) with Timer1.
+#ifndef MEASURE_PERIODS_ON_ICP1
+  #define MEASURE_PERIODS_ON_ICP1 false
+#endif
 
+// Count overruns and fast inputs, see `REG_DIAGNOSTICS`.
+#ifndef RECORD_DIAGNOSTICS
+  #define RECORD_DIAGNOSTICS true
+#endif
 
-// Use the RL-Pins for debug and test output
-#define DEBUG_RL_PINS false
+// Record histograms of the loop periods and of the durations of the I2C 
+// callbacks, see `REG_TIMING`. Needs Timer1, with the CPU clock. Off by 
+// default: It takes Timer1 from the period measurement, and adds a critical
+// section with a 32 bit read of the timer to every iteration of `loop()`. 
+// Build the firmware for profiling with `-D RECORD_TIMING=true`.
+#ifndef RECORD_TIMING
+  #define RECORD_TIMING false
+#endif
+
+// Filter glitches on the polled inputs, see `REG_FILTER`. Needs Timer0 
+// for the time. Pin change interrupts would not sample the inputs again 
+// after a glitch, the filter works only with polling.
+#ifndef FILTER_GLITCHES
+  #define FILTER_GLITCHES (!COUNT_IN_INTERRUPT && !COUNT_T0_IN_HARDWARE)
+#endif
+
+#if MEASURE_PERIODS_ON_ICP1 && COUNT_T1_IN_HARDWARE
+  #error "MEASURE_PERIODS_ON_ICP1 and COUNT_T1_IN_HARDWARE both need Timer1."
+#endif
+#if RECORD_TIMING && COUNT_T1_IN_HARDWARE
+  #error "RECORD_TIMING needs Timer1, which counts pulses."
+#endif
+#if RECORD_EDGE_TIMES && COUNT_T0_IN_HARDWARE
+  #error "RECORD_EDGE_TIMES needs Timer0, which counts pulses."
+#endif
+#if FILTER_GLITCHES && COUNT_T0_IN_HARDWARE
+  #error "FILTER_GLITCHES needs Timer0, which counts pulses."
+#endif
+#if FILTER_GLITCHES && COUNT_IN_INTERRUPT
+  #error "FILTER_GLITCHES works only with polling, not with COUNT_IN_INTERRUPT."
+#endif
 
 // --- Constants ---------------------------------------------------------------
 // --- Pulse Input Constants ------------------------------
@@ -34,6 +190,25 @@ byte const PLUG_1_PIN_1 = 3;
 byte const PLUG_1_PIN_2 = 5;
 byte const PLUG_2_PIN_1 = 2;
 byte const PLUG_2_PIN_2 = 4;
+// Bit masks of the pulse counter pins in port D.
+// (On the Arduino Nano D0 - D7 are bits 0 - 7 of port D.)
+byte const PLUG_1_PIN_1_MASK = _BV(PLUG_1_PIN_1);
+byte const PLUG_1_PIN_2_MASK = _BV(PLUG_1_PIN_2);
+byte const PLUG_2_PIN_1_MASK = _BV(PLUG_2_PIN_1);
+byte const PLUG_2_PIN_2_MASK = _BV(PLUG_2_PIN_2);
+byte const PLUG_PINS_MASK = PLUG_1_PIN_1_MASK | PLUG_1_PIN_2_MASK 
+                          | PLUG_2_PIN_1_MASK | PLUG_2_PIN_2_MASK;
+// The pins that are counted in software (by polling or pin change interrupt).
+byte const SOFT_PINS_MASK = PLUG_PINS_MASK
+  #if COUNT_T1_IN_HARDWARE
+    & ~PLUG_1_PIN_2_MASK
+  #endif
+  #if COUNT_T0_IN_HARDWARE
+    & ~PLUG_2_PIN_2_MASK
+  #endif
+  ;
+// Input capture pin of Timer1, for period measurements.
+byte const ICP1_PIN = 8;
 // RL-Pins: Pins for jumpers to swap left and right side on each plug.
 byte const PLUG_1_RL_PIN = 6;
 byte const PLUG_2_RL_PIN = 7;
@@ -46,60 +221,419 @@ byte const I2C_ADDR_BASE = 0x28;
 byte const I2C_ADDR_PIN_1 = 11;
 byte const I2C_ADDR_PIN_2 = 12;
 
-// --- Commands that the odometer understands -------------
-// No command is executing
-byte const CMD_NONE = 0;
-// Identifies the device, sends 6 bytes over I2C.
-byte const CMD_WHOAMI = 0x01;
-// Reset all counters to a certain value, reads 1 int32_t.
-byte const CMD_RESET = 0x0C;
-// Send the counter values, sends 4 int32_t over I2C.
-byte const CMD_GET_COUNT = 0x10;
-
-// Response string for CMD_WHOAMI
+// --- I2C Registers --------------------------------------
+// Each address of the register map is one byte. A read starts at the 
+// selected register, and continues with the following addresses, up to 
+// `I2C_BURST_LENGTH` bytes. The register stays selected until the master 
+// selects an other one, repeated reads don't need to select it again.
+//
+//  Address  Length  Access  Register
+//  0x01      7      read    REG_WHOAMI
+//  0x08      4      read    REG_STATUS
+//  0x0B      1      write   REG_SAMPLE_PERIOD
+//  0x0C      4      read    REG_TIME
+//  0x0C      4      write   REG_RESET
+//  0x10     16      read    REG_COUNT
+//  0x20     32      read    REG_EDGE_TIMES
+//  0x40     32      read    REG_PERIODS
+//  0x60      *      read    REG_FIFO_DATA
+//  0x61      *      read    REG_DELTA
+//  0x62     20      r/w     REG_LATCH
+//  0x63     12      read    REG_DIAGNOSTICS
+//  0x64      1      r/w     REG_FILTER
+//  0x65      1      r/w     REG_COUNT_MODE
+//  0x66     11      r/w     REG_CONFIG
+//  0x67     61      r/w     REG_TIMING
+//
+// Addresses that are not in the table read as 0. All values are in network 
+// order. For example a read of 56 bytes at `REG_STATUS` returns the status, 
+// the time, the counters and the edge times.
+
+// No register is selected
+byte const REG_NONE = 0;
+// Identifies the device, readable, 7 bytes ("odsp01" and a null byte).
+byte const REG_WHOAMI = 0x01;
+// Status, readable, 4 bytes: 
+// * The counting methods of the firmware (`STATUS_*` bits).
+// * The number of samples in the FIFO.
+// * The number of samples that were lost, because the FIFO was full.
+//   (Saturates at 255, reset by writing `REG_SAMPLE_PERIOD`.)
+// * The sample period, see `REG_SAMPLE_PERIOD`.
+byte const REG_STATUS = 0x08;
+// Period between two samples in milliseconds, writable, 1 byte. 0 switches
+// sampling off (default). Writing clears the FIFO.
+byte const REG_SAMPLE_PERIOD = 0x0B;
+// Time of the odometer, readable, 1 uint32_t in microseconds. 
+// (0 with `COUNT_T0_IN_HARDWARE`)
+byte const REG_TIME = 0x0C;
+// Reset all counters to a certain value, writable, 1 int32_t.
+byte const REG_RESET = 0x0C;
+// The counter values, readable, 4 int32_t.
+byte const REG_COUNT = 0x10;
+// The edge times, readable, 4 * 2 uint32_t. For each counter: The time 
+// since its last edge, and the period between its last two edges. 
+// Both in microseconds, the period is 0 before the second edge.
+byte const REG_EDGE_TIMES = 0x20;
+// The periods measured on ICP1, readable, 1 + 7 uint32_t: The number of 
+// rising edges, and the periods between the last 8 rising edges, the 
+// newest first. The periods are in CPU cycles (62.5 ns), 0 is invalid.
+byte const REG_PERIODS = 0x40;
+// Length of the register map.
+byte const REG_MAP_LENGTH = 0x60;
+// The samples in the FIFO, readable, behind the register map. The first 
+// byte is the number of samples that follow. Each sample contains the lower
+// 16 bits of the 4 counters, 4 uint16_t in the order of `REG_COUNT`. The 
+// samples are removed from the FIFO when they are sent: The master must 
+// read all of them. To limit the number of samples, write it (1 byte) into
+// this register, in the same transaction as the read (repeated start): The
+// selection of a register restores the default, at most 
+// `FIFO_BURST_SAMPLES`.
+byte const REG_FIFO_DATA = 0x60;
+// The changes of the counters since the previous read of this register, 
+// readable, behind the register map. The first byte is the width of the 
+// deltas in bytes (1, 2, 4), then follow 4 deltas with this width, in the 
+// order of `REG_COUNT`. The width is the smallest that all deltas fit in, 
+// but at most the maximum width. A delta that doesn't fit is sent 
+// saturated, the rest is sent with the next read. The maximum width is 
+// `DELTA_DEFAULT_WIDTH`, the master can write it (1 byte) into this 
+// register. The master should read 1 + 4 * 4 bytes and decode with the 
+// width sent, it may have been set by another master or reset by a 
+// restart. The bytes after narrower deltas read as 0xFF.
+byte const REG_DELTA = 0x61;
+// Shadow registers, readable, behind the register map: The time of the 
+// latch (1 uint32_t in microseconds, see `REG_TIME`), and the 4 counters 
+// (int32_t, in the order of `REG_COUNT`). Writing 1 byte (any value) latches:
+// The time and the counters are copied into the shadow registers. Written 
+// to the general call address (0), all boards on the bus latch at the same 
+// moment, the master then reads the boards one after another.
+byte const REG_LATCH = 0x62;
+// Diagnostics, readable, behind the register map, 2 + 4 uint16_t:
+// * Overruns: With polling, the iterations of `loop()` that took longer 
+//   than `LOOP_OVERRUN_US`. With `COUNT_IN_INTERRUPT`, the pin change 
+//   interrupts that found no changed input: An input changed twice before 
+//   it was read.
+// * The longest time between two polls of the pins since the previous read
+//   of this register, in microseconds, saturated. (0 with 
+//   `COUNT_IN_INTERRUPT`.)
+// * For each input, in the order of `REG_COUNT`: Edges in two consecutive
+//   polls. The edges of the input are closer than two polls, it is at the
+//   limit of polling and edges can be lost. (Only with polling, not for the
+//   inputs that are counted in hardware.)
+// The counters wrap around, the master uses their differences. Overruns 
+// and times are 0 with `COUNT_T0_IN_HARDWARE`. Only with 
+// `RECORD_DIAGNOSTICS`.
+byte const REG_DIAGNOSTICS = 0x63;
+// Minimum stable time of the glitch filter in microseconds, r/w, 1 byte,
+// behind the register map. A level of a polled input, that is shorter, is
+// not counted. A level that is longer is counted with a delay of at most 
+// 1.5 times the minimum stable time. (The time is measured in steps of the
+// filter clock, 2 * 4 us or more.) Edge times are then recorded when the 
+// level is counted. 0 switches the filter off (default). Not for the inputs
+// that are counted in hardware, only with `FILTER_GLITCHES`.
+byte const REG_FILTER = 0x64;
+// Counted edges per pulse, r/w, 1 byte, behind the register map: 2 both 
+// edges (default), 1 only the rising edges. The counters keep their unit, 
+// with 1 they step by 2 at each rising edge, and the edge times are those 
+// of the rising edges. Other values are ignored. Not for the inputs that 
+// are counted in hardware, they always count both edges.
+byte const REG_COUNT_MODE = 0x65;
+// The configuration in the EEPROM, r/w, behind the register map, 
+// `CONFIG_LENGTH` bytes:
+// * The version of the layout, `CONFIG_VERSION`.
+// * The I2C address, 0 for `I2C_ADDR_BASE`. Closed address jumpers 
+//   override it.
+// * The mapping of the inputs 1_1, 1_2, 2_1, 2_2: The position of each in
+//   `REG_COUNT`, 0 - 3. Closed RL jumpers swap the inputs of their plug.
+// * Inverted inputs, not used. (The encoder directions of the quadrature 
+//   encoder, which has the same layout.)
+// * The count mode, see `REG_COUNT_MODE`, 0 for the default.
+// * The minimum stable time of the glitch filter, see `REG_FILTER`.
+// * CRC-16 of the previous bytes (`_crc16_update`, start value 0xFFFF).
+// A valid block is written into the EEPROM in the background, while 
+// `loop()` runs, and is used at the next start. Blocks with an other 
+// version, invalid values or a wrong CRC are ignored. A read returns the 
+// stored block, and 1 byte: the number of bytes that are not yet written 
+// into the EEPROM. Without a valid block in the EEPROM, the jumpers and 
+// the defaults are used.
+byte const REG_CONFIG = 0x66;
+// Timing histograms, r/w, behind the register map: The loop periods (from
+// the start of one iteration of `loop()` to the start of the next), and 
+// the durations of `receiveEvent` and of `requestEvent` (without the TWI 
+// interrupt handler around them, with the interrupts that preempt them, see
+// `NESTED_I2C_CALLBACKS`). The times are measured in CPU cycles with
+// Timer1. Bucket i counts the times from 2^(i + 4) to 2^(i + 5) - 1 cycles,
+// e.g. bucket 1 from 2 to 4 us. Bucket 0 also counts the shorter times, the
+// last bucket the longer ones (from 16 ms). Writing 1 byte selects the 
+// histogram of the next reads: `TIMING_LOOP` (default), `TIMING_RECEIVE`, 
+// `TIMING_REQUEST`; with `TIMING_CLEAR` added, all histograms are cleared.
+// A read returns the selected histogram (1 byte), and its `TIMING_BUCKETS`
+// counts (uint32_t). The counts wrap around, the master can also use their
+// differences. Only with `RECORD_TIMING`.
+byte const REG_TIMING = 0x67;
+
+// Length of the status and time registers.
+byte const STATUS_LENGTH = 4;
+byte const TIME_LENGTH = sizeof(uint32_t);
+// Bits in the first byte of REG_STATUS.
+byte const STATUS_COUNT_IN_INTERRUPT = 0x01;
+byte const STATUS_COUNT_T1_IN_HARDWARE = 0x02;
+byte const STATUS_COUNT_T0_IN_HARDWARE = 0x04;
+byte const STATUS_RECORD_EDGE_TIMES = 0x08;
+byte const STATUS_MEASURE_PERIODS_ON_ICP1 = 0x10;
+byte const STATUS_RECORD_DIAGNOSTICS = 0x20;
+byte const STATUS_FILTER_GLITCHES = 0x40;
+byte const STATUS_RECORD_TIMING = 0x80;
+byte const STATUS_FLAGS = 
+    (COUNT_IN_INTERRUPT ? STATUS_COUNT_IN_INTERRUPT : 0)
+  | (COUNT_T1_IN_HARDWARE ? STATUS_COUNT_T1_IN_HARDWARE : 0)
+  | (COUNT_T0_IN_HARDWARE ? STATUS_COUNT_T0_IN_HARDWARE : 0)
+  | (RECORD_EDGE_TIMES ? STATUS_RECORD_EDGE_TIMES : 0)
+  | (MEASURE_PERIODS_ON_ICP1 ? STATUS_MEASURE_PERIODS_ON_ICP1 : 0)
+  | (RECORD_DIAGNOSTICS ? STATUS_RECORD_DIAGNOSTICS : 0)
+  | (FILTER_GLITCHES ? STATUS_FILTER_GLITCHES : 0)
+  | (RECORD_TIMING ? STATUS_RECORD_TIMING : 0);
+
+// Maximum length of a read. The buffers of the TWI driver are enlarged in
+// `platformio.ini`, the buffers of `Wire` have only 32 bytes.
+byte const I2C_BURST_LENGTH = TWI_BUFFER_LENGTH;
+
+// Default maximum width of the deltas in `REG_DELTA`, in bytes.
+byte const DELTA_DEFAULT_WIDTH = sizeof(int16_t);
+// Length of the shadow registers, see `REG_LATCH`.
+byte const LATCH_LENGTH = TIME_LENGTH + 4 * sizeof(int32_t);
+// Length of the diagnostics, see `REG_DIAGNOSTICS`.
+byte const DIAGNOSTICS_LENGTH = (2 + 4) * sizeof(uint16_t);
+
+// --- Configuration Constants ----------------------------
+// Version of the layout of `REG_CONFIG`.
+byte const CONFIG_VERSION = 1;
+// Offsets of the fields in `REG_CONFIG`, and its length.
+byte const CONFIG_ADDRESS = 1;
+byte const CONFIG_MAP = 2;
+byte const CONFIG_INVERTED = 6;
+byte const CONFIG_COUNT_MODE = 7;
+byte const CONFIG_FILTER = 8;
+byte const CONFIG_CRC = 9;
+byte const CONFIG_LENGTH = CONFIG_CRC + sizeof(uint16_t);
+// Address of the configuration in the EEPROM. It is fixed, so that other 
+// versions of the firmware find it.
+uintptr_t const CONFIG_EEPROM_ADDRESS = 0;
+// Range of the I2C addresses that are not reserved.
+byte const I2C_ADDR_MIN = 0x08;
+byte const I2C_ADDR_MAX = 0x77;
+
+// --- Diagnostics Constants ------------------------------
+// An iteration of `loop()` that is longer is an overrun. Pulses with 5 kHz,
+// which were tested, have an edge every 100 microseconds.
+unsigned long const LOOP_OVERRUN_US = 100;
+
+// --- Timing Constants -----------------------------------
+// Number of buckets of each histogram, see `REG_TIMING`.
+byte const TIMING_BUCKETS = 15;
+// Bucket 0 counts the times below 2^(TIMING_MIN_LOG2 + 1) CPU cycles.
+byte const TIMING_MIN_LOG2 = 4;
+// The histograms.
+byte const TIMING_LOOP = 0;
+byte const TIMING_RECEIVE = 1;
+byte const TIMING_REQUEST = 2;
+byte const TIMING_HISTOGRAMS = 3;
+// Added to the selected histogram, clears all histograms.
+byte const TIMING_CLEAR = 0x80;
+// Length of a read of `REG_TIMING`.
+byte const TIMING_LENGTH = 1 + TIMING_BUCKETS * sizeof(uint32_t);
+
+// --- Glitch Filter Constants ----------------------------
+// A new level is counted after this number of clocks of the filter. The 
+// first clock can come right after the edge: The level must be stable for
+// at least `FILTER_CLOCKS - 1` periods of the clock.
+byte const FILTER_CLOCKS = 3;
+// Duration of one tick of Timer0 (CPU clock / 64), in microseconds.
+byte const TIMER0_TICK_US = 64 / clockCyclesPerMicrosecond();
+
+// --- Sample FIFO Constants ------------------------------
+// Length of one sample: The lower 16 bits of the 4 counters.
+byte const SAMPLE_LENGTH = 4 * sizeof(uint16_t);
+// Number of samples in the FIFO. Must be a power of 2.
+byte const FIFO_LENGTH = 32;
+// Maximum number of samples in one read of `REG_FIFO_DATA`.
+byte const FIFO_BURST_SAMPLES = (I2C_BURST_LENGTH - 1) / SAMPLE_LENGTH;
+// Compare value of Timer2, for an interrupt every millisecond:
+// 16 MHz / 128 / (124 + 1) = 1 kHz
+byte const SAMPLE_TIMER_TOP = F_CPU / 128 / 1000 - 1;
+
+// Response string for REG_WHOAMI
 byte const WHOAMI_RESP[] = {"odsp01"};
 
 // --- Low frequency activity LED -------------------------
 // Pause between invocations of the blink algorithm. 
 // One blink cycle is two pauses.
 unsigned long const ACTIVITY_BLINK_MILLIS = 500;
+#if COUNT_T0_IN_HARDWARE
+  // `millis()` does not work: Count loop iterations instead.
+  // Estimated average duration of the main loop in microseconds.
+  unsigned long const LOOP_US = 10;
+  unsigned long const ACTIVITY_BLINK_LOOPS = ACTIVITY_BLINK_MILLIS * 1000 / LOOP_US;
+#endif
 
 // --- Global Variables --------------------------------------------------------
 // I2C ---------------------------------------------------
-// Command that is currently executed.
-byte cmdState = CMD_NONE;
+// The selected register.
+byte reg_address = REG_NONE;
+
+// Delta counters -----------------------------------------
+// Counter values at the previous read of `REG_DELTA`, in the order of 
+// `REG_COUNT`.
+int32_t delta_base[4] = {0};
+// Maximum width of the deltas in bytes: 1, 2, 4
+byte delta_max_width = DELTA_DEFAULT_WIDTH;
+
+// Shadow registers ---------------------------------------
+// Time and counters at the last latch, in the format that is sent over I2C.
+byte latch_buffer[LATCH_LENGTH] = {0};
+
+// Configuration ------------------------------------------
+// Image of the configuration in the EEPROM, see `REG_CONFIG`.
+byte config_block[CONFIG_LENGTH];
+// Number of bytes at the end of `config_block`, that are not yet written 
+// into the EEPROM.
+byte config_unwritten = 0;
+
+// Diagnostics --------------------------------------------
+#if RECORD_DIAGNOSTICS
+  // Overruns and edges in consecutive polls, see `REG_DIAGNOSTICS`.
+  uint16_t overruns = 0;
+  // Inputs 1_1, 1_2, 2_1, 2_2.
+  uint16_t fast_edges[4] = {0};
+  // Inputs that changed at the previous poll, bits of port D.
+  byte last_changed = 0;
+  // Time of the previous poll, and the longest time between two polls 
+  // since the previous read, in microseconds.
+  unsigned long last_poll_us = 0;
+  unsigned long max_poll_gap_us = 0;
+#endif
+
+// Timing histograms --------------------------------------
+#if RECORD_TIMING
+  // Counts of the buckets, see `REG_TIMING`.
+  uint32_t timing_histograms[TIMING_HISTOGRAMS][TIMING_BUCKETS] = {{0}};
+  // The histogram that `REG_TIMING` reads.
+  byte timing_selected = TIMING_LOOP;
+  // Start of the previous iteration of `loop()`, in CPU cycles.
+  uint32_t last_loop_cycles = 0;
+#endif
+
+// Glitch filter ------------------------------------------
+#if FILTER_GLITCHES
+  // Minimum stable time in microseconds, see `REG_FILTER`.
+  byte filter_time_us = 0;
+  // Period of the filter clock in ticks of Timer0, 0 is off.
+  byte filter_period = 0;
+  // Value of `TCNT0` at the last clock.
+  byte filter_clock = 0;
+  // Vertical counter: bit 0 and bit 1 of the 2 bit counters of all inputs,
+  // the number of clocks for which an input differed from `pin_states`.
+  byte filter_count_0 = 0;
+  byte filter_count_1 = 0;
+#endif
+
+// Sample FIFO --------------------------------------------
+// Period between two samples in milliseconds, 0 is off.
+byte sample_period_ms = 0;
+// Milliseconds until the next sample.
+byte sample_countdown = 0;
+// The samples, each in the format that is sent over I2C.
+byte fifo[FIFO_LENGTH][SAMPLE_LENGTH];
+// Index of the oldest sample, and number of samples in the FIFO.
+byte fifo_tail = 0;
+byte fifo_count = 0;
+// Number of samples that were lost because the FIFO was full.
+byte fifo_lost = 0;
+// Maximum number of samples that are sent in one read of `REG_FIFO_DATA`.
+byte fifo_read_limit = FIFO_BURST_SAMPLES;
 
 // Counting -----------------------------------------------
-// Current pin state
-bool pin_state_1_1 = false;
-bool pin_state_1_2 = false;
-bool pin_state_2_1 = false;
-bool pin_state_2_2 = false;
+// State of the pulse counter pins: Snapshot of port D, masked with 
+// `SOFT_PINS_MASK`.
+byte pin_states = 0;
+// Count only the rising edges, see `REG_COUNT_MODE`.
+bool count_rising_only = false;
 // The main counters of the odometer.
+// For the inputs that are counted in hardware, these are offsets that are
+// added to the pulses counted by the timer. Use `get_counter_1_2()` and
+// `get_counter_2_2()` to read them.
 int32_t counter_1_1 = 0;
 int32_t counter_1_2 = 0;
 int32_t counter_2_1 = 0;
 int32_t counter_2_2 = 0;
-// Buffers to convert the counters to network order, for I2C.
+// Length of the buffer that contains the counters in network order, for I2C.
 int const COUNTER_BUFFER_LENGTH = 4 * sizeof(int32_t);
-byte counter_buffer_1[COUNTER_BUFFER_LENGTH] = {0};
-byte counter_buffer_2[COUNTER_BUFFER_LENGTH] = {0};
+// Length of the buffer that contains the edge times.
+int const EDGE_TIMES_BUFFER_LENGTH = 4 * 2 * sizeof(uint32_t);
 // Indexes into the buffer for each counter.
-// They are not constants because they can be swapped during initialization.
+// (Multiply by 2 for the edge times buffer.)
+// They are not constants because the configuration and the RL jumpers set
+// them during initialization.
 int buf_index_1_1 = 0 * sizeof(int32_t);
 int buf_index_1_2 = 1 * sizeof(int32_t);
 int buf_index_2_1 = 2 * sizeof(int32_t);
 int buf_index_2_2 = 3 * sizeof(int32_t);
-// Pointer to buffer that is currently filled.
-byte * new_buffer = &counter_buffer_1[0];
-// Pointer to buffer that can be written over I2C.
-byte * active_buffer = &counter_buffer_2[0];
+
+// Edge times ---------------------------------------------
+#if RECORD_EDGE_TIMES
+  // Indexes of the inputs in the edge time arrays.
+  byte const EDGE_1_1 = 0;
+  byte const EDGE_1_2 = 1;
+  byte const EDGE_2_1 = 2;
+  byte const EDGE_2_2 = 3;
+  // Time of the last edge of each input, in microseconds.
+  unsigned long last_edge_us[4] = {0};
+  // Period between the last two edges of each input, in microseconds.
+  unsigned long edge_period_us[4] = {0};
+#endif
+// Overflows of Timer0 are counted by the Arduino core, for `millis()`.
+extern volatile unsigned long timer0_overflow_count;
+
+// Input capture ------------------------------------------
+#if MEASURE_PERIODS_ON_ICP1
+  // Number of periods in the ring buffer.
+  byte const PERIOD_RING_LENGTH = 7;
+  // Ring buffer of the last periods, in CPU cycles.
+  uint32_t period_ring[PERIOD_RING_LENGTH] = {0};
+  // Index of the newest period in the ring buffer.
+  byte period_ring_index = 0;
+  // Number of rising edges on ICP1.
+  uint32_t capture_count = 0;
+  // Time of the last rising edge, in CPU cycles.
+  uint32_t last_capture = 0;
+  // Length of the buffer that contains the periods.
+  int const PERIODS_BUFFER_LENGTH = (1 + PERIOD_RING_LENGTH) * sizeof(uint32_t);
+#endif
+
+// Hardware counting ----------------------------------------
+#if COUNT_T1_IN_HARDWARE || MEASURE_PERIODS_ON_ICP1 || RECORD_TIMING
+  // Overflows of Timer1, the upper 16 bits of the pulse count, or of the 
+  // time in CPU cycles.
+  volatile uint16_t t1_overflow_count = 0;
+#endif
+#if COUNT_T1_IN_HARDWARE
+  // Level of the input when counting started.
+  byte t1_start_level = 0;
+#endif
+#if COUNT_T0_IN_HARDWARE
+  // Level of the input when counting started.
+  byte t0_start_level = 0;
+#endif
 
 // Low frequency activity LED -----------------------------
 // LED state
 bool led_state = LOW;
-//  Value of `millis()` at last blink.
-unsigned long last_activity_blink = 0;
+#if COUNT_T0_IN_HARDWARE
+  // Loop iterations until the next blink.
+  unsigned long loop_counter = ACTIVITY_BLINK_LOOPS;
+#else
+  //  Value of `millis()` at last blink.
+  unsigned long last_activity_blink = 0;
+#endif
 //  Old values of the counters.
 int32_t old_counter_1_1 = 0; // Plug 1
 int32_t old_counter_1_2 = 0;
@@ -107,7 +641,332 @@ int32_t old_counter_2_1 = 0; // Plug 2
 int32_t old_counter_2_2 = 0;
 
 
+// Counting Functions ----------------------------------------------------------
+#if !COUNT_T0_IN_HARDWARE
+// The same as `micros()`, but faster, because it is inlined.
+// Must be called with interrupts disabled.
+inline unsigned long time_us() {
+  unsigned long overflows = timer0_overflow_count;
+  uint8_t count = TCNT0;
+  // The overflow interrupt might be pending.
+  if ((TIFR0 & _BV(TOV0)) && count < 0xFF) { ++overflows; }
+  // Timer0 counts with 1/64 of the CPU clock.
+  return ((overflows << 8) | count) * (64 / clockCyclesPerMicrosecond());
+}
+#endif
+
+#if RECORD_EDGE_TIMES
+
+// Record an edge of input `edge_index` at time `now`.
+inline void record_edge(byte edge_index, unsigned long now) {
+  edge_period_us[edge_index] = now - last_edge_us[edge_index];
+  last_edge_us[edge_index] = now;
+}
+#endif
+
+#if RECORD_DIAGNOSTICS
+#if !COUNT_T0_IN_HARDWARE
+// Measure the time since the previous poll of the pins, and count it as 
+// overrun if it is too long. Must be called with interrupts disabled.
+inline void check_poll_gap() {
+  unsigned long const now = time_us();
+  unsigned long const gap = now - last_poll_us;
+  last_poll_us = now;
+  if (gap > LOOP_OVERRUN_US) { ++overruns; }
+  if (gap > max_poll_gap_us) { max_poll_gap_us = gap; }
+}
+#endif
+
+// Count the inputs that changed at this and at the previous poll.
+inline void count_fast_edges(byte changed) {
+  byte const fast = changed & last_changed;
+  last_changed = changed;
+  if (fast) {
+    if (fast & PLUG_1_PIN_1_MASK) { ++fast_edges[0]; }
+    if (fast & PLUG_1_PIN_2_MASK) { ++fast_edges[1]; }
+    if (fast & PLUG_2_PIN_1_MASK) { ++fast_edges[2]; }
+    if (fast & PLUG_2_PIN_2_MASK) { ++fast_edges[3]; }
+  }
+}
+#endif
+
+#if FILTER_GLITCHES
+// Set the minimum stable time of the glitch filter, see `REG_FILTER`.
+// Must be called with interrupts disabled.
+void set_filter_time(byte time_us) {
+  filter_time_us = time_us;
+  // The level must be stable for `FILTER_CLOCKS - 1` periods, round up.
+  byte const clocks_us = (FILTER_CLOCKS - 1) * TIMER0_TICK_US;
+  filter_period = (time_us + clocks_us - 1) / clocks_us;
+  filter_count_0 = 0;
+  filter_count_1 = 0;
+}
+
+// Filter the snapshot `curr_states` of the inputs: Returns the inputs, 
+// whose new level was stable for `FILTER_CLOCKS` clocks of the filter.
+// The vertical counters count the clocks of all inputs at once.
+inline byte filter_glitches(byte curr_states) {
+  byte const differs = pin_states ^ curr_states;
+  if (filter_period == 0) { return differs; }
+  // The inputs at their old level restart their counters.
+  byte count_0 = filter_count_0 & differs;
+  byte count_1 = filter_count_1 & differs;
+  byte const now = TCNT0;
+  if ((byte)(now - filter_clock) >= filter_period) {
+    filter_clock = now;
+    // Increment the counters of the differing inputs.
+    count_1 ^= count_0;
+    count_0 = ~count_0 & differs;
+  }
+  // The counters are 3 (`FILTER_CLOCKS`): The inputs change.
+  byte const changed = count_0 & count_1;
+  filter_count_0 = count_0 & ~changed;
+  filter_count_1 = count_1 & ~changed;
+  return changed;
+}
+#endif
+
+// Add `Step` to the counters of the inputs in `edges`, bits of port D, and
+// record their edge times.
+template <byte Step>
+inline void count_edges(byte edges) {
+  if (!edges) { return; }
+  #if RECORD_EDGE_TIMES
+    unsigned long const now = time_us();
+    if (edges & PLUG_1_PIN_1_MASK) { counter_1_1 += Step; record_edge(EDGE_1_1, now); }
+    if (edges & PLUG_1_PIN_2_MASK) { counter_1_2 += Step; record_edge(EDGE_1_2, now); }
+    if (edges & PLUG_2_PIN_1_MASK) { counter_2_1 += Step; record_edge(EDGE_2_1, now); }
+    if (edges & PLUG_2_PIN_2_MASK) { counter_2_2 += Step; record_edge(EDGE_2_2, now); }
+  #else
+    if (edges & PLUG_1_PIN_1_MASK) { counter_1_1 += Step; }
+    if (edges & PLUG_1_PIN_2_MASK) { counter_1_2 += Step; }
+    if (edges & PLUG_2_PIN_1_MASK) { counter_2_1 += Step; }
+    if (edges & PLUG_2_PIN_2_MASK) { counter_2_2 += Step; }
+  #endif
+}
+
+// Update the counters from a snapshot of port D.
+// Called from `loop()` (`Polled`), or from the pin change interrupt handler.
+template <bool Polled>
+inline void count_pulses(byte port_d) {
+  // The bits that are different from the previous snapshot belong to pins 
+  // that have changed: increment their counters.
+  byte curr_states = port_d & SOFT_PINS_MASK;
+  #if FILTER_GLITCHES
+    byte changed = filter_glitches(curr_states);
+  #else
+    byte changed = pin_states ^ curr_states;
+  #endif
+  #if RECORD_DIAGNOSTICS
+    if (Polled) { count_fast_edges(changed); }
+  #endif
+  if (changed) {
+    pin_states ^= changed;
+    // The changed inputs that are now high have a rising edge.
+    if (count_rising_only) { count_edges<2>(changed & pin_states); }
+    else { count_edges<1>(changed); }
+  }
+  #if RECORD_DIAGNOSTICS && COUNT_IN_INTERRUPT
+    // The interrupt was triggered, but the pin changed back meanwhile.
+    else { ++overruns; }
+  #endif
+}
+
+// The timers count only the edges that return the input to the level that it
+// had when counting started, this is one edge per pulse. The number of
+// edges (the value of the software counters) is twice the number of
+// these edges, plus one if the input is currently on the other level.
+// `level_mask` is the bit of the input in port D.
+// Must be called with interrupts disabled.
+inline int32_t hardware_edges(uint32_t (*read_timer)(), byte start_level,
+                              byte level_mask) {
+  byte level, level_after;
+  uint32_t pulses;
+  // Repeat, if the input changed while the timer was read.
+  do {
+    level = PIND & level_mask;
+    pulses = read_timer();
+    level_after = PIND & level_mask;
+  } while (level != level_after);
+  return 2 * pulses + (level != start_level ? 1 : 0);
+}
+
+#if COUNT_T1_IN_HARDWARE || MEASURE_PERIODS_ON_ICP1 || RECORD_TIMING
+// Overflow interrupt handler of Timer1: extend the timer to 32 bits.
+ISR(TIMER1_OVF_vect) {
+  ++t1_overflow_count;
+}
+#endif
+
+#if MEASURE_PERIODS_ON_ICP1
+// Input capture interrupt handler of Timer1: A rising edge on ICP1. 
+// Store the period since the previous edge in the ring buffer.
+ISR(TIMER1_CAPT_vect) {
+  uint16_t const capture = ICR1;
+  uint16_t overflows = t1_overflow_count;
+  // The overflow interrupt might be pending. Then the capture belongs to the
+  // new overflow, if it is small.
+  if ((TIFR1 & _BV(TOV1)) && capture < 0x8000) { ++overflows; }
+  uint32_t const now = ((uint32_t)overflows << 16) | capture;
+
+  // There is no period before the second edge.
+  if (capture_count > 0) {
+    if (++period_ring_index == PERIOD_RING_LENGTH) { period_ring_index = 0; }
+    period_ring[period_ring_index] = now - last_capture;
+  }
+  last_capture = now;
+  ++capture_count;
+}
+#endif
+
+#if COUNT_T1_IN_HARDWARE || RECORD_TIMING
+
+// Read the 32 bit count of Timer1: the pulses, or the CPU cycles.
+// Must be called with interrupts disabled.
+inline uint32_t read_timer1() {
+  uint16_t overflows = t1_overflow_count;
+  uint16_t count = TCNT1;
+  // The overflow interrupt might be pending.
+  if ((TIFR1 & _BV(TOV1)) && count < 0x8000) { ++overflows; }
+  return ((uint32_t)overflows << 16) | count;
+}
+#endif
+
+#if COUNT_T0_IN_HARDWARE
+// Read the 32 bit pulse count of Timer0.
+// Must be called with interrupts disabled.
+inline uint32_t read_timer0() {
+  unsigned long overflows = timer0_overflow_count;
+  uint8_t count = TCNT0;
+  // The overflow interrupt might be pending.
+  if ((TIFR0 & _BV(TOV0)) && count < 0x80) { ++overflows; }
+  return (overflows << 8) | count;
+}
+#endif
+
+// Current value of the counter of `PLUG_1_PIN_2` (D5).
+// Must be called with interrupts disabled, if it is counted in hardware.
+inline int32_t get_counter_1_2() {
+  #if COUNT_T1_IN_HARDWARE
+    return counter_1_2 + hardware_edges(read_timer1, t1_start_level, 
+                                        PLUG_1_PIN_2_MASK);
+  #else
+    return counter_1_2;
+  #endif
+}
+
+// Current value of the counter of `PLUG_2_PIN_2` (D4).
+// Must be called with interrupts disabled, if it is counted in hardware.
+inline int32_t get_counter_2_2() {
+  #if COUNT_T0_IN_HARDWARE
+    return counter_2_2 + hardware_edges(read_timer0, t0_start_level, 
+                                        PLUG_2_PIN_2_MASK);
+  #else
+    return counter_2_2;
+  #endif
+}
+
+#if COUNT_IN_INTERRUPT || NESTED_I2C_CALLBACKS
+// Pin change interrupt handler for port D: All pulse pins are on port D.
+// With polling, it is only enabled while an I2C callback runs.
+ISR(PCINT2_vect) {
+  count_pulses<false>(PIND);
+}
+#endif
+
+
 // I2C Functions ---------------------------------------------------------------
+// The TWI driver calls the callbacks from its interrupt handler. With 
+// `NESTED_I2C_CALLBACKS` a callback masks the TWI interrupt and enables the 
+// others again, so that counting preempts it. Interrupts are only disabled 
+// in the critical sections of the callback, while it reads or changes the 
+// state of the counting code.
+//
+// The bus: The request callback runs while the interrupt flag `TWINT` is 
+// set, the TWI hardware stretches the clock until the driver replies. The 
+// driver releases the bus before the receive callback, the bus is free 
+// while it runs. A transaction that follows (e.g. the read after the 
+// register address) is acknowledged, and then stalls until the callback 
+// has ended: `TWINT` is set, but `TWIE` is masked.
+//
+// The worst-case latency of counting is the longest time with interrupts 
+// disabled, plus the handlers that run before the pin change interrupt:
+// * A critical section of a callback, or
+// * the end of a TWI interrupt (from `end_i2c_callback()`) followed at once
+//   by the beginning of the next one (up to `interrupts()` in 
+//   `begin_i2c_callback()`), when a transaction is stalled as above.
+// The I2C data bytes are handled by the driver alone, which is shorter. 
+// The bound does not depend on the length of the callbacks. In the native 
+// simulator, with its estimated costs, the latency of the pin change 
+// interrupt stays at 28 us or below with I2C at 400 kHz and 1 kHz
+// (`firmware/native/scenarios/simp-pulse-latency.txt`). Without nesting it
+// is up to 59 us, the whole callback. These are estimates, not cycle 
+// counts of the chip.
+//
+// With polling, the pin change interrupt of port D counts while the 
+// callback runs. Not with the glitch filter on: The filter advances only 
+// at the polls, the interrupt would see the glitches but not the stable 
+// levels. The callback then polls at its beginning, in its critical 
+// sections and at its end.
+
+// Called at the beginning of the callbacks, with interrupts disabled.
+inline void begin_i2c_callback() {
+  #if NESTED_I2C_CALLBACKS
+    // Writing a 1 into `TWINT` would clear the flag, and release the bus.
+    TWCR = TWCR & ~(_BV(TWIE) | _BV(TWINT));
+    #if !COUNT_IN_INTERRUPT
+      // The flag was set by the edges that `loop()` counted. Poll once, the
+      // pin change interrupt sees the following edges.
+      PCIFR = _BV(PCIF2);
+      #if RECORD_DIAGNOSTICS && !COUNT_T0_IN_HARDWARE
+        check_poll_gap();
+      #endif
+      count_pulses<true>(PIND);
+      #if FILTER_GLITCHES
+        if (filter_period == 0) { PCICR |= _BV(PCIE2); }
+      #else
+        PCICR |= _BV(PCIE2);
+      #endif
+    #endif
+    interrupts();
+  #endif
+}
+
+// Called at the end of the callbacks, returns with interrupts disabled.
+inline void end_i2c_callback() {
+  #if NESTED_I2C_CALLBACKS
+    noInterrupts();
+    #if !COUNT_IN_INTERRUPT
+      #if RECORD_DIAGNOSTICS && !COUNT_T0_IN_HARDWARE
+        // The pin change interrupt watched the pins, this was no poll gap.
+        if (PCICR & _BV(PCIE2)) { last_poll_us = time_us(); }
+      #endif
+      PCICR &= ~_BV(PCIE2);
+      // Poll once, the glitch filter gets a clock right after the callback.
+      count_pulses<true>(PIND);
+    #endif
+    TWCR = (TWCR & ~_BV(TWINT)) | _BV(TWIE);
+  #endif
+}
+
+// A critical section of the callbacks: The interrupt handlers must not 
+// change the counters meanwhile. (Without `NESTED_I2C_CALLBACKS` the 
+// callbacks run with interrupts disabled anyway.)
+inline void begin_critical_section() {
+  #if NESTED_I2C_CALLBACKS
+    noInterrupts();
+    #if !COUNT_IN_INTERRUPT && FILTER_GLITCHES
+      if (filter_period != 0) { count_pulses<true>(PIND); }
+    #endif
+  #endif
+}
+
+inline void end_critical_section() {
+  #if NESTED_I2C_CALLBACKS
+    interrupts();
+  #endif
+}
+
 // Function to convert a int32_t into bytes in network order.
 void convert_to_network(int32_t const num, byte * buf) {
   buf[3] = num & 0xFF;
@@ -122,78 +981,510 @@ void convert_to_network(int32_t const num, byte * buf) {
 //                    ((x)>>24 & 0x000000FFUL) )
 */
 
+// Convert the counters to network order, into the buffer `buf` that is sent 
+// over I2C. The counters are only converted when the master reads them.
+// Must be called with interrupts disabled, so that no counter is changed
+// while it is converted. (Torn values are never sent.)
+void fill_counter_buffer(byte * buf) {
+  convert_to_network(counter_1_1, &buf[buf_index_1_1]);
+  convert_to_network(get_counter_1_2(), &buf[buf_index_1_2]);
+  convert_to_network(counter_2_1, &buf[buf_index_2_1]);
+  convert_to_network(get_counter_2_2(), &buf[buf_index_2_2]);
+}
+
+#if RECORD_EDGE_TIMES
+// Convert the edge times of one input to network order: The time since the 
+// last edge, and the period.
+void convert_edge_times(byte edge_index, unsigned long now, byte * buf) {
+  convert_to_network(now - last_edge_us[edge_index], &buf[0]);
+  convert_to_network(edge_period_us[edge_index], &buf[sizeof(uint32_t)]);
+}
+
+// Convert the edge times of all inputs to network order, into the buffer 
+// `buf` that is sent over I2C. Must be called with interrupts disabled.
+void fill_edge_times_buffer(byte * buf) {
+  unsigned long const now = time_us();
+  convert_edge_times(EDGE_1_1, now, &buf[2 * buf_index_1_1]);
+  convert_edge_times(EDGE_1_2, now, &buf[2 * buf_index_1_2]);
+  convert_edge_times(EDGE_2_1, now, &buf[2 * buf_index_2_1]);
+  convert_edge_times(EDGE_2_2, now, &buf[2 * buf_index_2_2]);
+}
+#endif
+
+#if MEASURE_PERIODS_ON_ICP1
+// Convert the number of edges and the periods on ICP1 to network order, into
+// the buffer `buf` that is sent over I2C. The newest period is sent first.
+// Must be called with interrupts disabled.
+void fill_periods_buffer(byte * buf) {
+  convert_to_network(capture_count, &buf[0]);
+  byte index = period_ring_index;
+  for (byte i = 1; i <= PERIOD_RING_LENGTH; ++i) {
+    convert_to_network(period_ring[index], &buf[i * sizeof(uint32_t)]);
+    index = (index == 0) ? PERIOD_RING_LENGTH - 1 : index - 1;
+  }
+}
+#endif
+
+
+// Function to convert a uint16_t into bytes in network order.
+void convert_to_network_16(uint16_t const num, byte * buf) {
+  buf[1] = num & 0xFF;
+  buf[0] = (num >> 8) & 0xFF;
+}
+
+// Function to convert 4 bytes in network order into an int32_t.
+int32_t convert_from_network(byte const * buf) {
+  int32_t num;
+  num = buf[0];
+  num = (num << 8) | buf[1];
+  num = (num << 8) | buf[2];
+  num = (num << 8) | buf[3];
+  return num;
+}
+
+// Reset all counters to `new_counter`.
+// Must be called with interrupts disabled.
+void reset_counters(int32_t new_counter) {
+  counter_1_1 = new_counter;
+  counter_1_2 = new_counter;
+  counter_2_1 = new_counter;
+  counter_2_2 = new_counter;
+  // The hardware counters are not reset, adjust their offsets.
+  #if COUNT_T1_IN_HARDWARE
+    counter_1_2 -= hardware_edges(read_timer1, t1_start_level,
+                                  PLUG_1_PIN_2_MASK);
+  #endif
+  #if COUNT_T0_IN_HARDWARE
+    counter_2_2 -= hardware_edges(read_timer0, t0_start_level,
+                                  PLUG_2_PIN_2_MASK);
+  #endif
+  // The reset is no movement.
+  for (byte i = 0; i < 4; ++i) {
+    delta_base[i] = new_counter;
+  }
+}
+
+// Set the counted edges per pulse, see `REG_COUNT_MODE`.
+void set_count_mode(byte edges) {
+  if (edges == 1 || edges == 2) {
+    count_rising_only = (edges == 1);
+  }
+}
+
+// Configuration Functions -----------------------------------------------------
+// CRC-16 of the configuration `block`, without its CRC.
+uint16_t config_crc(byte const * block) {
+  uint16_t crc = 0xFFFF;
+  for (byte i = 0; i < CONFIG_CRC; ++i) {
+    crc = _crc16_update(crc, block[i]);
+  }
+  return crc;
+}
+
+// Is `block` a configuration of this version, with valid values and CRC?
+// See `REG_CONFIG`.
+bool is_config_valid(byte const * block) {
+  if (block[0] != CONFIG_VERSION) { return false; }
+  byte const address = block[CONFIG_ADDRESS];
+  if (address != 0 && (address < I2C_ADDR_MIN || address > I2C_ADDR_MAX)) {
+    return false;
+  }
+  // Each position in `REG_COUNT` must be used once.
+  byte positions = 0;
+  for (byte i = 0; i < 4; ++i) {
+    byte const position = block[CONFIG_MAP + i];
+    if (position >= 4) { return false; }
+    positions |= _BV(position);
+  }
+  if (positions != 0x0F) { return false; }
+  byte const mode = block[CONFIG_COUNT_MODE];
+  if (mode != 0 && mode != 1 && mode != 2) { return false; }
+  uint16_t const crc = (block[CONFIG_CRC] << 8) | block[CONFIG_CRC + 1];
+  return crc == config_crc(block);
+}
+
+// Store the configuration `block` that the master wrote, if it is valid.
+// `loop()` writes it into the EEPROM, the callbacks interrupt it only 
+// outside of `write_config_step()`.
+void write_config(byte const * block) {
+  if (!is_config_valid(block)) { return; }
+  memcpy(config_block, block, CONFIG_LENGTH);
+  config_unwritten = CONFIG_LENGTH;
+}
+
+// Write the next byte of the configuration into the EEPROM, if the EEPROM 
+// is ready. Writing a byte takes 3.4 ms, `loop()` does not wait for it.
+// The CRC is written last: An interrupted write leaves an invalid block.
+inline void write_config_step() {
+  if (config_unwritten == 0 || !eeprom_is_ready()) { return; }
+  // A new block from the master would restart the write meanwhile.
+  noInterrupts();
+  byte const index = CONFIG_LENGTH - config_unwritten;
+  --config_unwritten;
+  eeprom_update_byte((uint8_t *)(CONFIG_EEPROM_ADDRESS + index), 
+                     config_block[index]);
+  interrupts();
+}
+
+// Timing Functions ------------------------------------------------------------
+#if RECORD_TIMING
+// floor(log2(x)) of a nibble, 0 for 0.
+byte const LOG2_NIBBLE[16] = {0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3};
+
+// floor(log2(x)) of a byte, 0 for 0.
+inline byte log2_byte(byte x) {
+  return (x >> 4) ? 4 + LOG2_NIBBLE[x >> 4] : LOG2_NIBBLE[x];
+}
+
+// Count the time `cycles` in its bucket of `histogram`, see `REG_TIMING`.
+// The logarithm is looked up per byte, without a loop over the bits.
+// Must be called with interrupts disabled.
+inline void record_timing(byte histogram, uint32_t cycles) {
+  byte log2;
+  if (cycles >> 24) { log2 = 24 + log2_byte(cycles >> 24); }
+  else if (cycles >> 16) { log2 = 16 + log2_byte(cycles >> 16); }
+  else if (cycles >> 8) { log2 = 8 + log2_byte(cycles >> 8); }
+  else { log2 = log2_byte(cycles); }
+  byte bucket = (log2 > TIMING_MIN_LOG2) ? log2 - TIMING_MIN_LOG2 : 0;
+  if (bucket >= TIMING_BUCKETS) { bucket = TIMING_BUCKETS - 1; }
+  ++timing_histograms[histogram][bucket];
+}
+
+// Select the histogram of `REG_TIMING`, and clear all histograms with 
+// `TIMING_CLEAR`. Called from the I2C callbacks, which `loop()` can't 
+// interrupt. The interrupt handlers don't record timing.
+void write_timing(byte value) {
+  if (value & TIMING_CLEAR) {
+    memset(timing_histograms, 0, sizeof(timing_histograms));
+  }
+  byte const histogram = value & ~TIMING_CLEAR;
+  if (histogram < TIMING_HISTOGRAMS) { timing_selected = histogram; }
+}
+
+// Convert the selected histogram to network order, into the buffer `buf`
+// that is sent over I2C. Called from the I2C callbacks, like 
+// `write_timing()`.
+void read_timing(byte * buf) {
+  buf[0] = timing_selected;
+  for (byte i = 0; i < TIMING_BUCKETS; ++i) {
+    convert_to_network(timing_histograms[timing_selected][i],
+                       &buf[1 + i * sizeof(uint32_t)]);
+  }
+}
+#endif
+
+// Delta Counter Functions -----------------------------------------------------
+// Limit `delta` to the range of a signed integer with `width` bytes.
+inline int32_t saturate_delta(int32_t delta, byte width) {
+  if (width >= sizeof(int32_t)) { return delta; }
+  int32_t const max_delta = (1L << (8 * width - 1)) - 1;
+  if (delta > max_delta) { return max_delta; }
+  if (delta < -max_delta - 1) { return -max_delta - 1; }
+  return delta;
+}
+
+// Compute the changes of the counters since the previous call, convert them
+// into `buf`, which is sent over I2C, and clear them. Returns the number of 
+// bytes. See `REG_DELTA`.
+// Must be called with interrupts disabled, the counters must not change 
+// between reading and clearing.
+byte read_deltas(byte * buf) {
+  int32_t deltas[4];
+  deltas[buf_index_1_1 / 4] = counter_1_1;
+  deltas[buf_index_1_2 / 4] = get_counter_1_2();
+  deltas[buf_index_2_1 / 4] = counter_2_1;
+  deltas[buf_index_2_2 / 4] = get_counter_2_2();
+
+  // The smallest width that all deltas fit in.
+  byte width = sizeof(int8_t);
+  for (byte i = 0; i < 4; ++i) {
+    deltas[i] -= delta_base[i];
+    if (deltas[i] != (int16_t)deltas[i]) { 
+      width = sizeof(int32_t); 
+    }
+    else if (deltas[i] != (int8_t)deltas[i] && width < sizeof(int16_t)) {
+      width = sizeof(int16_t);
+    }
+  }
+  if (width > delta_max_width) { width = delta_max_width; }
+
+  buf[0] = width;
+  byte * data = &buf[1];
+  for (byte i = 0; i < 4; ++i) {
+    int32_t const delta = saturate_delta(deltas[i], width);
+    // The part of the delta that is not sent stays for the next read.
+    delta_base[i] += delta;
+    if (width == sizeof(int8_t)) {
+      data[0] = delta & 0xFF;
+    }
+    else if (width == sizeof(int16_t)) {
+      convert_to_network_16(delta, data);
+    }
+    else {
+      convert_to_network(delta, data);
+    }
+    data += width;
+  }
+  return 1 + 4 * width;
+}
+
+
+#if RECORD_DIAGNOSTICS
+// Convert the diagnostics to network order, into the buffer `buf` that is 
+// sent over I2C, and restart the longest poll gap. See `REG_DIAGNOSTICS`.
+// Must be called with interrupts disabled.
+void read_diagnostics(byte * buf) {
+  convert_to_network_16(overruns, &buf[0]);
+  convert_to_network_16(max_poll_gap_us < 0xFFFF ? max_poll_gap_us : 0xFFFF,
+                        &buf[2]);
+  max_poll_gap_us = 0;
+  byte * const fast = &buf[2 * sizeof(uint16_t)];
+  convert_to_network_16(fast_edges[0], &fast[buf_index_1_1 / 2]);
+  convert_to_network_16(fast_edges[1], &fast[buf_index_1_2 / 2]);
+  convert_to_network_16(fast_edges[2], &fast[buf_index_2_1 / 2]);
+  convert_to_network_16(fast_edges[3], &fast[buf_index_2_2 / 2]);
+}
+#endif
+
+// Copy the time and the counters into the shadow registers, see `REG_LATCH`.
+// When the counters are polled, they can lag behind the pins by one 
+// iteration of `loop()`.
+// Must be called with interrupts disabled.
+void latch_counters() {
+  #if !COUNT_T0_IN_HARDWARE
+    convert_to_network(time_us(), &latch_buffer[0]);
+  #endif
+  fill_counter_buffer(&latch_buffer[TIME_LENGTH]);
+}
+
+
+// Sample FIFO Functions -------------------------------------------------------
+// Store a sample of the counters in the FIFO.
+// Must be called with interrupts disabled.
+void take_sample() {
+  if (fifo_count == FIFO_LENGTH) {
+    if (fifo_lost < 0xFF) { ++fifo_lost; }
+    return;
+  }
+  // The counters have the same order as in `REG_COUNT`.
+  byte * sample = fifo[(fifo_tail + fifo_count) & (FIFO_LENGTH - 1)];
+  convert_to_network_16(counter_1_1, &sample[buf_index_1_1 / 2]);
+  convert_to_network_16(get_counter_1_2(), &sample[buf_index_1_2 / 2]);
+  convert_to_network_16(counter_2_1, &sample[buf_index_2_1 / 2]);
+  convert_to_network_16(get_counter_2_2(), &sample[buf_index_2_2 / 2]);
+  ++fifo_count;
+}
+
+// Compare match interrupt handler of Timer2, every millisecond.
+ISR(TIMER2_COMPA_vect) {
+  if (--sample_countdown == 0) {
+    sample_countdown = sample_period_ms;
+    take_sample();
+  }
+}
+
+// Set the sample period and clear the FIFO. 0 switches sampling off.
+// Must be called with interrupts disabled.
+void set_sample_period(byte period_ms) {
+  sample_period_ms = period_ms;
+  sample_countdown = period_ms;
+  fifo_tail = 0;
+  fifo_count = 0;
+  fifo_lost = 0;
+  if (period_ms > 0) {
+    TIFR2 = _BV(OCF2A);
+    TIMSK2 = _BV(OCIE2A);
+  }
+  else {
+    TIMSK2 = 0;
+  }
+}
+
+// Move the oldest samples from the FIFO into `buf`, which is sent over I2C.
+// The first byte is the number of samples. Returns the number of bytes.
+// Must be called with interrupts disabled.
+byte read_fifo(byte * buf) {
+  byte const n_samples = (fifo_count < fifo_read_limit) 
+                       ? fifo_count : fifo_read_limit;
+  buf[0] = n_samples;
+  for (byte i = 0; i < n_samples; ++i) {
+    memcpy(&buf[1 + i * SAMPLE_LENGTH], fifo[fifo_tail], SAMPLE_LENGTH);
+    fifo_tail = (fifo_tail + 1) & (FIFO_LENGTH - 1);
+  }
+  fifo_count -= n_samples;
+  return 1 + n_samples * SAMPLE_LENGTH;
+}
+
+
+// Is a part of the register at `reg`, with `length` bytes, between the 
+// addresses `start` and `end`?
+inline bool is_register_read(byte reg, byte length, byte start, byte end) {
+  return reg < end && reg + length > start;
+}
+
+// Fill the addresses between `start` and `end` of `regs`, an image of the
+// register map. Only the registers that are read are converted.
+// Each register is converted in its own critical section: A register is 
+// never torn, but the counters can be a few microseconds younger than the 
+// time.
+void fill_registers(byte * regs, byte start, byte end) {
+  // Addresses that are not in the map read as 0.
+  memset(&regs[start], 0, end - start);
+
+  if (is_register_read(REG_WHOAMI, sizeof(WHOAMI_RESP), start, end)) {
+    memcpy(&regs[REG_WHOAMI], WHOAMI_RESP, sizeof(WHOAMI_RESP));
+  }
+  if (is_register_read(REG_STATUS, STATUS_LENGTH, start, end)) {
+    regs[REG_STATUS] = STATUS_FLAGS;
+    regs[REG_STATUS + 1] = fifo_count;
+    regs[REG_STATUS + 2] = fifo_lost;
+    regs[REG_STATUS + 3] = sample_period_ms;
+  }
+  #if !COUNT_T0_IN_HARDWARE
+  if (is_register_read(REG_TIME, TIME_LENGTH, start, end)) {
+    begin_critical_section();
+    convert_to_network(time_us(), &regs[REG_TIME]);
+    end_critical_section();
+  }
+  #endif
+  if (is_register_read(REG_COUNT, COUNTER_BUFFER_LENGTH, start, end)) {
+    begin_critical_section();
+    fill_counter_buffer(&regs[REG_COUNT]);
+    end_critical_section();
+  }
+  #if RECORD_EDGE_TIMES
+  if (is_register_read(REG_EDGE_TIMES, EDGE_TIMES_BUFFER_LENGTH, start, end)) {
+    begin_critical_section();
+    fill_edge_times_buffer(&regs[REG_EDGE_TIMES]);
+    end_critical_section();
+  }
+  #endif
+  #if MEASURE_PERIODS_ON_ICP1
+  if (is_register_read(REG_PERIODS, PERIODS_BUFFER_LENGTH, start, end)) {
+    begin_critical_section();
+    fill_periods_buffer(&regs[REG_PERIODS]);
+    end_critical_section();
+  }
+  #endif
+}
+
 
 // Function that executes whenever data is received from master.
-// This function is registered as an event, see `setup()`.
-void receiveEvent(int _) {
+// The first byte selects the register, the following bytes are written into
+// the register.
+// This function is registered directly with the TWI driver, see `setup()`. 
+// (The receive buffer of `Wire` has only 32 bytes.)
+void receiveEvent(uint8_t * data, int length) {
   #if DEBUG_RL_PINS
     digitalWrite(PLUG_2_RL_PIN, true);
   #endif
+  #if RECORD_TIMING
+    uint32_t const start_cycles = read_timer1();
+  #endif
+  begin_i2c_callback();
 
-  while (Wire.available() > 0) {
-    switch (cmdState) {
-      // If the register is not set, the current byte is
-      // interpreted as the register.
-      case CMD_NONE:
-        cmdState = Wire.read();
-        //Serial.print("Register: ");
-        //Serial.println(cmdState, HEX);
+  if (length > 0) {
+    reg_address = data[0];
+    fifo_read_limit = FIFO_BURST_SAMPLES;
+    //Serial.print("Register: ");
+    //Serial.println(reg_address, HEX);
+  }
+
+  // Data to write into the register.
+  byte const * value = &data[1];
+  int const value_length = length - 1;
+  if (value_length > 0) {
+    switch (reg_address) {
+      // Reset the counters to a specified value.
+      case REG_RESET:
+        // If the master sent more or less bytes, this is an error.
+        if (value_length == sizeof(int32_t)) {
+          begin_critical_section();
+          reset_counters(convert_from_network(value));
+          end_critical_section();
+          //Serial.print("Reset. Receive new value: ");
+          //Serial.println(convert_from_network(value), DEC);
+        }
         break;
 
-      // Command: Reset the counters to a specified value.
-      case CMD_RESET:
-      {
-        byte b1, b2, b3, b4;
-        int32_t new_counter;
-
-        b1 = Wire.read();
-        b2 = Wire.read();
-        b3 = Wire.read();
-        b4 = Wire.read();
-
-        // Convert the data from network order to host order.
-        new_counter = b1;
-        new_counter = (new_counter << 8) | b2;
-        new_counter = (new_counter << 8) | b3;
-        new_counter = (new_counter << 8) | b4;
-
-        counter_1_1 = new_counter;
-        counter_1_2 = new_counter;
-        counter_2_1 = new_counter;
-        counter_2_2 = new_counter;
-
-        //Serial.print("Reset. Receive new value: ");
-        //Serial.println(new_counter, DEC);
-
-        // If the master sent more bytes, this is an error.
-        if (Wire.available())
-          goto i2c_receive_error;
-
-        // The command is finished, reset the register state
-        cmdState = CMD_NONE;
+      // Set the sample period.
+      case REG_SAMPLE_PERIOD:
+        if (value_length == 1) {
+          begin_critical_section();
+          set_sample_period(value[0]);
+          end_critical_section();
+        }
         break;
-      }
 
-      // Error: Read all bytes in this transaction
-      i2c_receive_error:
-      default:
-      {
-        //Serial.print("Error! Receive: ");
-        while (0 < Wire.available()) {
-          Wire.read();
-          // byte errByte = Wire.read();
-          //Serial.print(errByte, HEX);
-          //Serial.print(", ");
+      // Set the maximum width of the deltas.
+      case REG_DELTA:
+        if (value_length == 1 && (value[0] == sizeof(int8_t) 
+            || value[0] == sizeof(int16_t) || value[0] == sizeof(int32_t))) {
+          delta_max_width = value[0];
         }
-        //Serial.println("");
- 
-        // Reset the register state, wait for new register/command
-        cmdState = CMD_NONE;
         break;
-      }
+
+      // Latch the counters into the shadow registers.
+      case REG_LATCH:
+        if (value_length == 1) {
+          begin_critical_section();
+          latch_counters();
+          end_critical_section();
+        }
+        break;
+
+      #if FILTER_GLITCHES
+      // Set the minimum stable time of the glitch filter.
+      case REG_FILTER:
+        if (value_length == 1) {
+          begin_critical_section();
+          set_filter_time(value[0]);
+          end_critical_section();
+        }
+        break;
+      #endif
+
+      // Set the counted edges per pulse.
+      case REG_COUNT_MODE:
+        if (value_length == 1) {
+          set_count_mode(value[0]);
+        }
+        break;
+
+      #if RECORD_TIMING
+      // Select or clear the timing histograms.
+      case REG_TIMING:
+        if (value_length == 1) {
+          write_timing(value[0]);
+        }
+        break;
+      #endif
+
+      // Store a new configuration.
+      case REG_CONFIG:
+        if (value_length == CONFIG_LENGTH) {
+          write_config(value);
+        }
+        break;
+
+      // Limit the number of samples in the next reads.
+      case REG_FIFO_DATA:
+        if (value_length == 1 && value[0] <= FIFO_BURST_SAMPLES) {
+          fifo_read_limit = value[0];
+        }
+        break;
+
+      // Error: The register is not writable, ignore the data.
+      default:
+        //Serial.println("Error! Receive.");
+        break;
     }
   }
 
+  end_i2c_callback();
+  #if RECORD_TIMING
+    record_timing(TIMING_RECEIVE, read_timer1() - start_cycles);
+  #endif
   #if DEBUG_RL_PINS
     digitalWrite(PLUG_2_RL_PIN, false);
   #endif
@@ -206,34 +1497,86 @@ void requestEvent() {
   #if DEBUG_RL_PINS
     digitalWrite(PLUG_2_RL_PIN, true);
   #endif
+  #if RECORD_TIMING
+    uint32_t const start_cycles = read_timer1();
+  #endif
+  begin_i2c_callback();
 
-  switch (cmdState) {
-    // Command: send the identification code
-    case CMD_WHOAMI:
-      //Serial.println("Who am I.");
-      Wire.write(WHOAMI_RESP, sizeof(WHOAMI_RESP));
-      // The command is finished, reset the register state
-      cmdState = CMD_NONE;
-      break;
-
-    // Command: Send the counter values
-    case CMD_GET_COUNT:
-      //Serial.print("Send counter values.");
-      Wire.write(active_buffer, COUNTER_BUFFER_LENGTH);
- 
-      // The command is finished, reset the register state
-      cmdState = CMD_NONE;
-      break;
-
-    // Error
-    default:
-      //Serial.println("Error! Send: 0");
-      Wire.write(0x00);
-      // Reset the register
-      cmdState = CMD_NONE;
-      break;
+  byte const start = reg_address;
+  // Samples from the FIFO
+  if (start == REG_FIFO_DATA) {
+    byte fifo_buffer[I2C_BURST_LENGTH];
+    begin_critical_section();
+    byte const length = read_fifo(fifo_buffer);
+    end_critical_section();
+    Wire.write(fifo_buffer, length);
+  }
+  // Delta counters
+  else if (start == REG_DELTA) {
+    byte delta_buffer[1 + 4 * sizeof(int32_t)];
+    begin_critical_section();
+    byte const length = read_deltas(delta_buffer);
+    end_critical_section();
+    Wire.write(delta_buffer, length);
+  }
+  // Shadow registers
+  else if (start == REG_LATCH) {
+    Wire.write(latch_buffer, LATCH_LENGTH);
+  }
+  #if RECORD_DIAGNOSTICS
+  // Diagnostics
+  else if (start == REG_DIAGNOSTICS) {
+    byte diagnostics_buffer[DIAGNOSTICS_LENGTH];
+    begin_critical_section();
+    read_diagnostics(diagnostics_buffer);
+    end_critical_section();
+    Wire.write(diagnostics_buffer, DIAGNOSTICS_LENGTH);
+  }
+  #endif
+  #if FILTER_GLITCHES
+  // Glitch filter
+  else if (start == REG_FILTER) {
+    Wire.write(filter_time_us);
+  }
+  #endif
+  // Counted edges per pulse
+  else if (start == REG_COUNT_MODE) {
+    Wire.write(count_rising_only ? 1 : 2);
+  }
+  // Configuration
+  else if (start == REG_CONFIG) {
+    byte config_buffer[CONFIG_LENGTH + 1];
+    memcpy(config_buffer, config_block, CONFIG_LENGTH);
+    config_buffer[CONFIG_LENGTH] = config_unwritten;
+    Wire.write(config_buffer, CONFIG_LENGTH + 1);
+  }
+  #if RECORD_TIMING
+  // Timing histograms
+  else if (start == REG_TIMING) {
+    byte timing_buffer[TIMING_LENGTH];
+    read_timing(timing_buffer);
+    Wire.write(timing_buffer, TIMING_LENGTH);
+  }
+  #endif
+  // Registers
+  else if (start < REG_MAP_LENGTH) {
+    byte const end = (start + I2C_BURST_LENGTH < REG_MAP_LENGTH) 
+                   ? start + I2C_BURST_LENGTH : REG_MAP_LENGTH;
+    // Image of the register map.
+    byte registers[REG_MAP_LENGTH];
+    fill_registers(registers, start, end);
+    Wire.write(&registers[start], end - start);
+  }
+  // Error
+  else {
+    //Serial.println("Error! Send: 0");
+    Wire.write(0x00);
   }
 
+  end_i2c_callback();
+  #if RECORD_TIMING
+    record_timing(TIMING_REQUEST, read_timer1() - start_cycles);
+  #endif
   #if DEBUG_RL_PINS
     digitalWrite(PLUG_2_RL_PIN, false);
   #endif
@@ -244,18 +1587,32 @@ void requestEvent() {
 // Function that is called once at startup.
 void setup()
 {
+  // Read the configuration ----------
+  // The whole block at once, see `REG_CONFIG`. Reading the EEPROM needs no
+  // delay.
+  eeprom_read_block(config_block, (void const *)CONFIG_EEPROM_ADDRESS, 
+                    CONFIG_LENGTH);
+  bool const configured = is_config_valid(config_block);
+
   // Init I2C ------------------------
-  // Compute I2C address, respecting the address jumpers.
+  // Compute I2C address, from the configuration or the address jumpers.
   // The Address jumpers connect the pins to ground.
   pinMode(I2C_ADDR_PIN_1, INPUT_PULLUP);
   pinMode(I2C_ADDR_PIN_2, INPUT_PULLUP);
-  byte i2c_address = I2C_ADDR_BASE;
-  if (digitalRead(I2C_ADDR_PIN_1) == LOW) { i2c_address += 1; }
-  if (digitalRead(I2C_ADDR_PIN_2) == LOW) { i2c_address += 2; }
+  byte jumpers = 0;
+  if (digitalRead(I2C_ADDR_PIN_1) == LOW) { jumpers += 1; }
+  if (digitalRead(I2C_ADDR_PIN_2) == LOW) { jumpers += 2; }
+  byte i2c_address = I2C_ADDR_BASE + jumpers;
+  // Closed jumpers override the configured address.
+  if (configured && config_block[CONFIG_ADDRESS] != 0 && jumpers == 0) {
+    i2c_address = config_block[CONFIG_ADDRESS];
+  }
   // Init I2C subsystem
   Wire.begin(i2c_address);      // join i2c bus as slave
-  Wire.onReceive(receiveEvent); // register event
+  twi_attachSlaveRxEvent(receiveEvent); // register event, bypass `Wire`
   Wire.onRequest(requestEvent); // register event
+  // Also receive the general call, for `REG_LATCH`.
+  TWAR |= _BV(TWGCE);
   // Switch the pullup resistors off for the I2C pins.
   // As this is a 5V board, and RaspberryPi is 3.3 V.
   digitalWrite(SDA, LOW);
@@ -268,6 +1625,74 @@ void setup()
   pinMode(PLUG_1_PIN_2, INPUT);
   pinMode(PLUG_2_PIN_1, INPUT);
   pinMode(PLUG_2_PIN_2, INPUT);
+  // Initial state of the pins, so that the first iteration does not count.
+  pin_states = PIND & SOFT_PINS_MASK;
+  #if COUNT_IN_INTERRUPT || NESTED_I2C_CALLBACKS
+    // Enable the pin change interrupt for the pulse pins on port D.
+    // (PCINT16 - PCINT23 are D0 - D7.) With polling, the I2C callbacks 
+    // enable it in `PCICR` while they run.
+    PCMSK2 = SOFT_PINS_MASK;
+    PCIFR = _BV(PCIF2);
+  #endif
+  #if COUNT_IN_INTERRUPT
+    PCICR |= _BV(PCIE2);
+  #endif
+  // Count with the timers. The external clock source is chosen so that the
+  // timer counts the edges which return the input to its current level.
+  #if COUNT_T1_IN_HARDWARE
+    t1_start_level = PIND & PLUG_1_PIN_2_MASK;
+    TCCR1A = 0;
+    // External clock on T1: falling edge (CS12|CS11), rising edge (+ CS10)
+    TCCR1B = _BV(CS12) | _BV(CS11) | (t1_start_level ? _BV(CS10) : 0);
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+  #endif
+  #if MEASURE_PERIODS_ON_ICP1
+    // Timer1 runs with the CPU clock. Input capture on the rising edge, with
+    // noise canceler.
+    pinMode(ICP1_PIN, INPUT);
+    TCCR1A = 0;
+    TCCR1B = _BV(ICNC1) | _BV(ICES1) | _BV(CS10);
+    TCNT1 = 0;
+    TIFR1 = _BV(ICF1) | _BV(TOV1);
+    TIMSK1 = _BV(ICIE1) | _BV(TOIE1);
+  #endif
+  #if RECORD_TIMING && !MEASURE_PERIODS_ON_ICP1
+    // Timer1 runs with the CPU clock, for the timing histograms. (Input 
+    // capture uses the same clock.)
+    TCCR1A = 0;
+    TCCR1B = _BV(CS10);
+    TCNT1 = 0;
+    TIFR1 = _BV(TOV1);
+    TIMSK1 = _BV(TOIE1);
+  #endif
+  #if COUNT_T0_IN_HARDWARE
+    t0_start_level = PIND & PLUG_2_PIN_2_MASK;
+    // Keep the normal mode of the Arduino core, and its overflow interrupt.
+    TCCR0A = 0;
+    // External clock on T0: falling edge (CS02|CS01), rising edge (+ CS00)
+    TCCR0B = _BV(CS02) | _BV(CS01) | (t0_start_level ? _BV(CS00) : 0);
+    noInterrupts();
+    TCNT0 = 0;
+    timer0_overflow_count = 0;
+    interrupts();
+  #endif
+  // Counting mode and glitch filter from the configuration.
+  if (configured) {
+    set_count_mode(config_block[CONFIG_COUNT_MODE]);
+    #if FILTER_GLITCHES
+      set_filter_time(config_block[CONFIG_FILTER]);
+    #endif
+  }
+
+  // Mapping of the inputs to the positions in the I2C buffer.
+  if (configured) {
+    buf_index_1_1 = config_block[CONFIG_MAP + 0] * sizeof(int32_t);
+    buf_index_1_2 = config_block[CONFIG_MAP + 1] * sizeof(int32_t);
+    buf_index_2_1 = config_block[CONFIG_MAP + 2] * sizeof(int32_t);
+    buf_index_2_2 = config_block[CONFIG_MAP + 3] * sizeof(int32_t);
+  }
   // Right - Left exchange jumpers 
   // The RL jumpers connect the pins to ground.
   pinMode(PLUG_1_RL_PIN, INPUT_PULLUP);
@@ -285,6 +1710,14 @@ void setup()
     buf_index_2_2 = temp_index;
   }
 
+  // Init sample timer ----------------
+  // Timer2 in CTC mode, interrupt every millisecond. The interrupt is 
+  // enabled when the master sets a sample period.
+  TCCR2A = _BV(WGM21);
+  TCCR2B = _BV(CS22) | _BV(CS20); // CPU clock / 128
+  OCR2A = SAMPLE_TIMER_TOP;
+  TCNT2 = 0;
+
   // Init activity LED -----------------
   pinMode(LED_BUILTIN, OUTPUT);
   digitalWrite(LED_BUILTIN, led_state);
@@ -300,6 +1733,18 @@ void setup()
     digitalWrite(PLUG_1_RL_PIN, false);
     digitalWrite(PLUG_2_RL_PIN, false);
   #endif
+
+  // The first poll is not an overrun.
+  #if RECORD_DIAGNOSTICS && !COUNT_IN_INTERRUPT && !COUNT_T0_IN_HARDWARE
+    noInterrupts();
+    last_poll_us = time_us();
+    interrupts();
+  #endif
+  #if RECORD_TIMING
+    noInterrupts();
+    last_loop_cycles = read_timer1();
+    interrupts();
+  #endif
 }
 
 
@@ -311,61 +1756,61 @@ void loop()
     digitalWrite(PLUG_1_RL_PIN, true);
   #endif
 
+  // Period of the loop ------------------------------------
+  #if RECORD_TIMING
+    // The I2C callbacks read and clear the histograms.
+    noInterrupts();
+    uint32_t const loop_cycles = read_timer1();
+    record_timing(TIMING_LOOP, loop_cycles - last_loop_cycles);
+    last_loop_cycles = loop_cycles;
+    interrupts();
+  #endif
+
   // Compute the main counters -----------------------------
-  bool curr_state;
-  // Read each pin. If its current state is different than its previous state,
-  // increment the counter.
-  curr_state = digitalRead(PLUG_1_PIN_1);
-  if (pin_state_1_1 != curr_state) {
-    pin_state_1_1 = curr_state;
-    ++counter_1_1;
-  }
-  curr_state = digitalRead(PLUG_1_PIN_2);
-  if (pin_state_1_2 != curr_state) {
-    pin_state_1_2 = curr_state;
-    ++counter_1_2;
-  }
-  curr_state = digitalRead(PLUG_2_PIN_1);
-  if (pin_state_2_1 != curr_state) {
-    pin_state_2_1 = curr_state;
-    ++counter_2_1;
-  }
-  curr_state = digitalRead(PLUG_2_PIN_2);
-  if (pin_state_2_2 != curr_state) {
-    pin_state_2_2 = curr_state;
-    ++counter_2_2;
-  }
-
-  // Fill buffer that can be sent over I2c ---------------
-  convert_to_network(counter_1_1, &new_buffer[buf_index_1_1]);
-  convert_to_network(counter_1_2, &new_buffer[buf_index_1_2]);
-  convert_to_network(counter_2_1, &new_buffer[buf_index_2_1]);
-  convert_to_network(counter_2_2, &new_buffer[buf_index_2_2]);
-  // swap the buffers
-  byte * temp_ptr = new_buffer;
-  new_buffer = active_buffer;
-  noInterrupts();
-  active_buffer = temp_ptr;
-  interrupts();
+  #if !COUNT_IN_INTERRUPT
+    // Read all pins at once.
+    // The I2C callbacks must not see half updated counters, and the pin 
+    // change interrupt in the callbacks must not update them meanwhile.
+    noInterrupts();
+    #if RECORD_DIAGNOSTICS && !COUNT_T0_IN_HARDWARE
+      check_poll_gap();
+    #endif
+    count_pulses<true>(PIND);
+    interrupts();
+  #endif
 
   // Low frequency activity LED ----------------------------
-  unsigned long current_millis = millis();
   // Blink the LED, if enough time has elapsed ...
+  #if COUNT_T0_IN_HARDWARE
+  if (--loop_counter == 0)
+  {
+    loop_counter = ACTIVITY_BLINK_LOOPS;
+  #else
+  unsigned long current_millis = millis();
   if (current_millis - last_activity_blink > ACTIVITY_BLINK_MILLIS)
   {
     last_activity_blink = current_millis;
+  #endif
+
+    // The interrupt handlers must not change the counters meanwhile.
+    noInterrupts();
+    int32_t const curr_counter_1_1 = counter_1_1;
+    int32_t const curr_counter_1_2 = get_counter_1_2();
+    int32_t const curr_counter_2_1 = counter_2_1;
+    int32_t const curr_counter_2_2 = get_counter_2_2();
+    interrupts();
 
     // (Blink the LED) and if one of the counters has changed.
-    if (  (counter_1_1 != old_counter_1_1) 
-       or (counter_1_2 != old_counter_1_2) 
-       or (counter_2_1 != old_counter_2_1) 
-       or (counter_2_2 != old_counter_2_2)
+    if (  (curr_counter_1_1 != old_counter_1_1) 
+       or (curr_counter_1_2 != old_counter_1_2) 
+       or (curr_counter_2_1 != old_counter_2_1) 
+       or (curr_counter_2_2 != old_counter_2_2)
        )
     {
-      old_counter_1_1 = counter_1_1;
-      old_counter_1_2 = counter_1_2;
-      old_counter_2_1 = counter_2_1;
-      old_counter_2_2 = counter_2_2;
+      old_counter_1_1 = curr_counter_1_1;
+      old_counter_1_2 = curr_counter_1_2;
+      old_counter_2_1 = curr_counter_2_1;
+      old_counter_2_2 = curr_counter_2_2;
       led_state = !led_state;
       digitalWrite(LED_BUILTIN, led_state);
       // Serial.println("Blink led");
@@ -377,6 +1822,9 @@ void loop()
     }
   }
 
+  // Store the configuration -------------------------------
+  write_config_step();
+
   #if DEBUG_RL_PINS
     digitalWrite(PLUG_1_RL_PIN, false);
     // delay(1);
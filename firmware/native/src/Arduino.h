@@ -0,0 +1,157 @@
+// ============================================================================
+//        Arduino Core for the Host-Native Build of the Odometer Firmwares
+// ============================================================================
+
+// Stand-in for the Arduino AVR core of the Nano, for the PlatformIO
+// environment `native`. It contains the subset of the core, that the
+// firmwares use. Pins, timers and interrupts are emulated by the simulator
+// (`simulator.h`), `main()` is the benchmark (`benchmark.cpp`).
+//
+// Differences to the real core:
+// * `int` has 32 bits, `long` 64 bits on most hosts.
+// * Code executes in zero virtual time, only `loop()`, interrupt handlers
+//   and the delay functions have a cost in CPU cycles.
+
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "avr/io.h"
+#include "avr/interrupt.h"
+#include "avr/pgmspace.h"
+
+#ifndef F_CPU
+  #define F_CPU 16000000L
+#endif
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+// --- Constants --------------------------------------------------------------
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define NOT_A_PIN 0
+#define NOT_A_PORT 0
+#define NOT_AN_INTERRUPT -1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// Pins of the Arduino Nano
+#define NUM_DIGITAL_PINS 20
+#define LED_BUILTIN 13
+#define A0 14
+#define A1 15
+#define A2 16
+#define A3 17
+#define A4 18
+#define A5 19
+#define SDA 18
+#define SCL 19
+
+// Ports, for `digitalPinToPort`
+#define PB 2
+#define PC 3
+#define PD 4
+
+#define clockCyclesPerMicrosecond() ( F_CPU / 1000000L )
+#define clockCyclesToMicroseconds(a) ( (a) / clockCyclesPerMicrosecond() )
+#define microsecondsToClockCycles(a) ( (a) * clockCyclesPerMicrosecond() )
+
+#define interrupts() sei()
+#define noInterrupts() cli()
+
+#define lowByte(w) ((uint8_t) ((w) & 0xff))
+#define highByte(w) ((uint8_t) ((w) >> 8))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+#define bitWrite(value, bit, bitvalue) ((bitvalue) ? bitSet(value, bit) : bitClear(value, bit))
+#define bit(b) (1UL << (b))
+
+// --- Digital I/O ------------------------------------------------------------
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t * portInputRegister(uint8_t port);
+volatile uint8_t * portOutputRegister(uint8_t port);
+volatile uint8_t * portModeRegister(uint8_t port);
+
+// --- Interrupts -------------------------------------------------------------
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+// Pin change interrupts, as in `pins_arduino.h` of the Nano.
+#define digitalPinToPCICR(p) (((p) <= 21) ? (&PCICR) : ((volatile uint8_t *)0))
+#define digitalPinToPCICRbit(p) (((p) <= 7) ? 2 : (((p) <= 13) ? 0 : 1))
+#define digitalPinToPCMSK(p) \
+  (((p) <= 7) ? (&PCMSK2) : (((p) <= 13) ? (&PCMSK0) \
+                          : (((p) <= 21) ? (&PCMSK1) : ((volatile uint8_t *)0))))
+#define digitalPinToPCMSKbit(p) \
+  (((p) <= 7) ? (p) : (((p) <= 13) ? ((p) - 8) : ((p) - 14)))
+void attachInterrupt(uint8_t interrupt_number, void (*user_func)(void), int mode);
+void detachInterrupt(uint8_t interrupt_number);
+
+// --- Time -------------------------------------------------------------------
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Initialize the timers like the real core, before `setup()`.
+void init(void);
+
+void setup(void);
+void loop(void);
+
+// --- Serial -----------------------------------------------------------------
+// Writes to standard output.
+class HardwareSerial {
+public:
+  void begin(unsigned long) {}
+  void end() {}
+  void flush();
+  int available() { return 0; }
+  int read() { return -1; }
+
+  size_t write(uint8_t c);
+  size_t print(const char * str);
+  size_t print(char c);
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+  size_t println() { return print("\n"); }
+  template <typename T> size_t println(T value) {
+    size_t n = print(value);
+    return n + println();
+  }
+  template <typename T> size_t println(T value, int format) {
+    size_t n = print(value, format);
+    return n + println();
+  }
+  operator bool() { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,45 @@
+// Stand-in for `WInterrupts.c` of the Arduino AVR core: `attachInterrupt` for
+// the external interrupts INT0 (D2) and INT1 (D3).
+
+#include <Arduino.h>
+
+static void nothing(void) {
+}
+
+static void (*intFunc[2])(void) = {nothing, nothing};
+
+void attachInterrupt(uint8_t interrupt_number, void (*user_func)(void), int mode) {
+  switch (interrupt_number) {
+    case 0:
+      intFunc[0] = user_func;
+      EICRA = (EICRA & ~(_BV(ISC00) | _BV(ISC01))) | (mode << ISC00);
+      EIMSK |= _BV(INT0);
+      break;
+    case 1:
+      intFunc[1] = user_func;
+      EICRA = (EICRA & ~(_BV(ISC10) | _BV(ISC11))) | (mode << ISC10);
+      EIMSK |= _BV(INT1);
+      break;
+  }
+}
+
+void detachInterrupt(uint8_t interrupt_number) {
+  switch (interrupt_number) {
+    case 0:
+      EIMSK &= ~_BV(INT0);
+      intFunc[0] = nothing;
+      break;
+    case 1:
+      EIMSK &= ~_BV(INT1);
+      intFunc[1] = nothing;
+      break;
+  }
+}
+
+ISR(INT0_vect) {
+  intFunc[0]();
+}
+
+ISR(INT1_vect) {
+  intFunc[1]();
+}
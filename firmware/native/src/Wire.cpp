@@ -0,0 +1,91 @@
+// Stand-in for the Wire library: The slave part of `TwoWire`, like in the
+// Arduino AVR core.
+
+#include "Wire.h"
+
+extern "C" {
+  #include "utility/twi.h"
+}
+
+uint8_t TwoWire::rxBuffer[BUFFER_LENGTH];
+uint8_t TwoWire::rxBufferIndex = 0;
+uint8_t TwoWire::rxBufferLength = 0;
+
+void (*TwoWire::user_onRequest)(void);
+void (*TwoWire::user_onReceive)(int);
+
+TwoWire Wire;
+
+
+// Join the I2C bus as slave with `address`.
+void TwoWire::begin(uint8_t address) {
+  rxBufferIndex = 0;
+  rxBufferLength = 0;
+  twi_init();
+  twi_setAddress(address);
+  twi_attachSlaveTxEvent(onRequestService);
+  twi_attachSlaveRxEvent(onReceiveService);
+}
+
+void TwoWire::end() {
+  twi_disable();
+}
+
+// Must be called in the request event: Add `data` to the slave tx buffer.
+size_t TwoWire::write(uint8_t data) {
+  twi_transmit(&data, 1);
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t * data, size_t quantity) {
+  twi_transmit(data, quantity);
+  return quantity;
+}
+
+int TwoWire::available(void) {
+  return rxBufferLength - rxBufferIndex;
+}
+
+int TwoWire::read(void) {
+  if (rxBufferIndex < rxBufferLength) {
+    return rxBuffer[rxBufferIndex++];
+  }
+  return -1;
+}
+
+int TwoWire::peek(void) {
+  if (rxBufferIndex < rxBufferLength) {
+    return rxBuffer[rxBufferIndex];
+  }
+  return -1;
+}
+
+// Called by the TWI driver when the master has written data.
+void TwoWire::onReceiveService(uint8_t * inBytes, int numBytes) {
+  if (!user_onReceive) { return; }
+  // The master part of Wire might still use the buffer.
+  if (rxBufferIndex < rxBufferLength) { return; }
+  // The real Wire copies `numBytes`, which can overflow `rxBuffer` when
+  // `TWI_BUFFER_LENGTH` is larger.
+  if (numBytes > BUFFER_LENGTH) { numBytes = BUFFER_LENGTH; }
+  for (int i = 0; i < numBytes; ++i) {
+    rxBuffer[i] = inBytes[i];
+  }
+  rxBufferIndex = 0;
+  rxBufferLength = numBytes;
+  user_onReceive(numBytes);
+}
+
+// Called by the TWI driver when the master wants to read data.
+void TwoWire::onRequestService(void) {
+  if (!user_onRequest) { return; }
+  user_onRequest();
+}
+
+void TwoWire::onReceive(void (*function)(int)) {
+  user_onReceive = function;
+}
+
+void TwoWire::onRequest(void (*function)(void)) {
+  user_onRequest = function;
+}
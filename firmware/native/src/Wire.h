@@ -0,0 +1,44 @@
+// Stand-in for the Wire library: The slave part of `TwoWire`, on top of the
+// emulated TWI driver (`utility/twi.h`).
+
+#ifndef NATIVE_WIRE_H
+#define NATIVE_WIRE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BUFFER_LENGTH 32
+
+class TwoWire {
+private:
+  static uint8_t rxBuffer[];
+  static uint8_t rxBufferIndex;
+  static uint8_t rxBufferLength;
+
+  static void (*user_onRequest)(void);
+  static void (*user_onReceive)(int);
+  static void onRequestService(void);
+  static void onReceiveService(uint8_t*, int);
+
+public:
+  void begin(uint8_t address);
+  void begin(int address) { begin((uint8_t)address); }
+  void end();
+
+  size_t write(uint8_t data);
+  size_t write(const uint8_t * data, size_t quantity);
+  size_t write(unsigned long n) { return write((uint8_t)n); }
+  size_t write(long n) { return write((uint8_t)n); }
+  size_t write(unsigned int n) { return write((uint8_t)n); }
+  size_t write(int n) { return write((uint8_t)n); }
+  int available(void);
+  int read(void);
+  int peek(void);
+
+  void onReceive(void (*)(int));
+  void onRequest(void (*)(void));
+};
+
+extern TwoWire Wire;
+
+#endif
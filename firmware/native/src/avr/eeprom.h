@@ -0,0 +1,28 @@
+// Stand-in for `<avr/eeprom.h>`: The 1 KiB EEPROM of the ATmega328 is an
+// array of the simulator, erased (0xFF) at start, see `sim_eeprom_load()`.
+// As on the chip, writing a byte takes 3.4 ms: `eeprom_is_ready()` is false
+// meanwhile, and the next write waits for it. Reads don't wait.
+
+#ifndef NATIVE_AVR_EEPROM_H
+#define NATIVE_AVR_EEPROM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int eeprom_is_ready(void);
+uint8_t eeprom_read_byte(uint8_t const * address);
+void eeprom_read_block(void * destination, void const * source, size_t length);
+void eeprom_write_byte(uint8_t * address, uint8_t value);
+// Writes only if the value differs, like avr-libc.
+void eeprom_update_byte(uint8_t * address, uint8_t value);
+void eeprom_update_block(void const * source, void * destination, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
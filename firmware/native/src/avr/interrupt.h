@@ -0,0 +1,61 @@
+// ============================================================================
+//        Interrupt Vectors of the ATmega328 for the Host-Native Build
+// ============================================================================
+
+// Stand-in for `<avr/interrupt.h>`. `ISR(vector)` defines a C function with
+// the name of the vector, the simulator calls it when the interrupt is
+// enabled, its flag is set, and the global interrupt flag is set.
+// The attributes of `ISR` (`ISR_NOBLOCK`, ...) are ignored.
+
+#ifndef NATIVE_AVR_INTERRUPT_H
+#define NATIVE_AVR_INTERRUPT_H
+
+#include "avr/io.h"
+
+#ifdef __cplusplus
+  #define ISR(vector, ...) \
+    extern "C" void vector(void); \
+    extern "C" void vector(void)
+#else
+  #define ISR(vector, ...) \
+    void vector(void); \
+    void vector(void)
+#endif
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define reti() return
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+void sim_sei(void);
+void sim_cli(void);
+#ifdef __cplusplus
+}
+#endif
+
+#define sei() sim_sei()
+#define cli() sim_cli()
+
+// Vector numbers of the ATmega328
+#define INT0_vect __vector_1
+#define INT1_vect __vector_2
+#define PCINT0_vect __vector_3
+#define PCINT1_vect __vector_4
+#define PCINT2_vect __vector_5
+#define WDT_vect __vector_6
+#define TIMER2_COMPA_vect __vector_7
+#define TIMER2_COMPB_vect __vector_8
+#define TIMER2_OVF_vect __vector_9
+#define TIMER1_CAPT_vect __vector_10
+#define TIMER1_COMPA_vect __vector_11
+#define TIMER1_COMPB_vect __vector_12
+#define TIMER1_OVF_vect __vector_13
+#define TIMER0_COMPA_vect __vector_14
+#define TIMER0_COMPB_vect __vector_15
+#define TIMER0_OVF_vect __vector_16
+#define TWI_vect __vector_24
+
+#endif
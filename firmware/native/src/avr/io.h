@@ -0,0 +1,191 @@
+// ============================================================================
+//          ATmega328 Registers for the Host-Native Build
+// ============================================================================
+
+// Stand-in for `<avr/io.h>`. The registers that the firmwares use are plain
+// variables, that the simulator (`simulator.cpp`) updates when the virtual
+// time advances, and that it reads to find out how the firmware configured
+// the hardware.
+//
+// Some registers have special write semantics on the real chip, they are
+// small classes here:
+// * Interrupt flag registers (`TIFRx`, `PCIFR`, `EIFR`): writing a 1 clears
+//   the flag.
+// * `TWCR`: writing a 1 into `TWINT` clears it, and releases the I2C bus.
+// * `SREG`: only the global interrupt flag (bit 7) is emulated.
+//
+// The pins of the ports are computed by the simulator: direct writes to
+// `DDRx`/`PORTx` are only noticed at the next `pinMode` or `digitalWrite`.
+
+#ifndef NATIVE_AVR_IO_H
+#define NATIVE_AVR_IO_H
+
+#include <stdint.h>
+
+#define _BV(bit) (1 << (bit))
+
+// --- Registers with special semantics ---------------------------------------
+// Interrupt flag register: Writing a 1 into a bit clears the flag.
+class FlagRegister {
+public:
+  volatile uint8_t value;
+
+  operator uint8_t() const { return value; }
+  FlagRegister & operator=(uint8_t clear_mask) {
+    value &= ~clear_mask;
+    return *this;
+  }
+  // Read-modify-write writes a 1 into all flags, that are set: It clears
+  // them all, as on the chip.
+  FlagRegister & operator|=(uint8_t) {
+    value = 0;
+    return *this;
+  }
+};
+
+// TWI control register: Writing a 1 into `TWINT` clears it.
+class TwiControlRegister {
+public:
+  volatile uint8_t value;
+
+  operator uint8_t() const { return value; }
+  TwiControlRegister & operator=(uint8_t new_value);
+  TwiControlRegister & operator|=(uint8_t mask) { return *this = value | mask; }
+  TwiControlRegister & operator&=(uint8_t mask) { return *this = value & mask; }
+};
+
+// Status register: Only the global interrupt flag `SREG_I` is emulated.
+class StatusRegister {
+public:
+  operator uint8_t() const;
+  StatusRegister & operator=(uint8_t new_value);
+};
+
+// --- Ports ------------------------------------------------------------------
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+
+// --- External and pin change interrupts -------------------------------------
+extern volatile uint8_t EICRA, EIMSK;
+extern FlagRegister EIFR;
+extern volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+extern FlagRegister PCIFR;
+
+// --- Timers -----------------------------------------------------------------
+extern volatile uint8_t GTCCR;
+extern volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+extern FlagRegister TIFR0;
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+extern FlagRegister TIFR1;
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+extern FlagRegister TIFR2;
+
+// --- TWI (I2C) --------------------------------------------------------------
+extern volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWAMR;
+extern TwiControlRegister TWCR;
+
+// --- Status register --------------------------------------------------------
+extern StatusRegister SREG;
+
+// --- Bits -------------------------------------------------------------------
+#define SREG_I 7
+
+// EICRA, EIMSK, EIFR
+#define ISC00 0
+#define ISC01 1
+#define ISC10 2
+#define ISC11 3
+#define INT0 0
+#define INT1 1
+#define INTF0 0
+#define INTF1 1
+
+// PCICR, PCIFR
+#define PCIE0 0
+#define PCIE1 1
+#define PCIE2 2
+#define PCIF0 0
+#define PCIF1 1
+#define PCIF2 2
+
+// GTCCR
+#define PSRSYNC 0
+#define PSRASY 1
+#define TSM 7
+
+// Timer0
+#define WGM00 0
+#define WGM01 1
+#define COM0B0 4
+#define COM0B1 5
+#define COM0A0 6
+#define COM0A1 7
+#define CS00 0
+#define CS01 1
+#define CS02 2
+#define WGM02 3
+#define FOC0B 6
+#define FOC0A 7
+#define TOIE0 0
+#define OCIE0A 1
+#define OCIE0B 2
+#define TOV0 0
+#define OCF0A 1
+#define OCF0B 2
+
+// Timer1
+#define WGM10 0
+#define WGM11 1
+#define COM1B0 4
+#define COM1B1 5
+#define COM1A0 6
+#define COM1A1 7
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define WGM13 4
+#define ICES1 6
+#define ICNC1 7
+#define TOIE1 0
+#define OCIE1A 1
+#define OCIE1B 2
+#define ICIE1 5
+#define TOV1 0
+#define OCF1A 1
+#define OCF1B 2
+#define ICF1 5
+
+// Timer2
+#define WGM20 0
+#define WGM21 1
+#define COM2B0 4
+#define COM2B1 5
+#define COM2A0 6
+#define COM2A1 7
+#define CS20 0
+#define CS21 1
+#define CS22 2
+#define WGM22 3
+#define TOIE2 0
+#define OCIE2A 1
+#define OCIE2B 2
+#define TOV2 0
+#define OCF2A 1
+#define OCF2B 2
+
+// TWI
+#define TWIE 0
+#define TWEN 2
+#define TWWC 3
+#define TWSTO 4
+#define TWSTA 5
+#define TWEA 6
+#define TWINT 7
+#define TWGCE 0
+#define TWPS0 0
+#define TWPS1 1
+
+#endif
@@ -0,0 +1,19 @@
+// Stand-in for `<avr/pgmspace.h>`: On the host, flash and RAM are the same.
+
+#ifndef NATIVE_AVR_PGMSPACE_H
+#define NATIVE_AVR_PGMSPACE_H
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s) (s)
+
+#define pgm_read_byte(address) (*(const uint8_t *)(address))
+#define pgm_read_word(address) (*(const uint16_t *)(address))
+#define pgm_read_dword(address) (*(const uint32_t *)(address))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+#endif
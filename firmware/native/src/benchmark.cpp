@@ -0,0 +1,422 @@
+// ============================================================================
+//      Benchmark of the Odometer Firmwares on the Simulated Arduino Nano
+// ============================================================================
+
+// `main()` of the host-native build. It runs `setup()` and `loop()` of the
+// firmware on the simulator (`simulator.h`), drives the inputs with the
+// waveforms of a scenario script, and loads the I2C bus. It reports the
+// iterations of `loop()` per second, and the counts that were lost.
+//
+//     pio run -e native
+//     .pio/build/native/program ../native/scenarios/simp-pulse.txt
+//
+// The exit status is 1 when counts were lost or a read differed from its
+// `expect`, 2 for errors.
+//
+// Scenario scripts contain one command per line, `#` starts a comment.
+// Numbers are decimal or hexadecimal (0x...).
+//
+//     cost loop|isr|twi_byte|twi_callback|critical_section <cycles>
+//             Estimated CPU cycles of the firmware, see `SimCosts`.
+//     bitrate <hz>
+//             Clock of the I2C bus, default 100000 Hz.
+//     address <address>
+//             I2C address of the device, default 0x28.
+//     level <pin> 0|1|z
+//             Drive a pin from outside, e.g. a jumper.
+//     pulse <pin> <hz>
+//             Square wave. Declares the next counter of the firmware, which
+//             counts every edge.
+//     glitch <hz> <us>
+//             Noise on the previous pulse wave: `hz` glitches per second at
+//             random times, each inverts the pin for `us` microseconds.
+//             They are not counted.
+//     quad <pin_1> <pin_2> <hz>
+//             Quadrature signal, `pin_2` leads for positive frequencies.
+//             Declares the next counter, which counts every edge with its
+//             direction.
+//     load <hz> <byte>... [read <n>]
+//             Write the bytes and read `n` bytes, `hz` times per second, as
+//             background load. `load 0` stops it.
+//     write <register> <byte>...
+//             Write the bytes into the register, e.g. a configuration. The
+//             waveforms pause meanwhile, the write is not part of the
+//             load.
+//     eeprom <address> <byte>...
+//             Store the bytes in the EEPROM, e.g. a configuration for
+//             `setup()`. The EEPROM is erased at start.
+//     setup
+//             Call `setup()`, the first `run` or `check` does it otherwise.
+//     run <ms>
+//             Run the firmware for `ms` milliseconds.
+//     check <register> [latch] [within <n>]
+//             Pause the waveforms, let the firmware settle for 10 ms, read
+//             the counters from `register` (4 bytes each, big endian), and
+//             compare them with the counts of the waveforms. Then the
+//             waveforms continue. With `latch`, the register is first
+//             written (1 byte) to the general call address, and the 4 bytes
+//             of the time before the counters are skipped (`REG_LATCH`).
+//             With `within`, counts that differ by at most `n` are right,
+//             for the reduced resolutions of `REG_COUNT_MODE`.
+//     read <register> <n> [expect <byte>|x...]
+//             Read `n` bytes from `register` and print them, e.g. the
+//             diagnostics (`REG_DIAGNOSTICS`). The waveforms continue.
+//             With `expect`, the bytes are compared with the given ones,
+//             `x` matches any byte.
+//     echo <text>
+//             Print the text.
+//
+// Estimates: The highest square wave frequency on each input without lost
+// counts, 200 ms per frequency, to 2 %, with the costs of the scenarios 
+// (150, 80, 80 and 800 cycles for the loop, a handler, a TWI byte and an
+// I2C callback). The costs are guesses, not cycle accurate, so the longest
+// loop or handler can't be measured here (see `test/simavr-benchmark`).
+//
+//     firmware                          no I2C    REG_COUNT at 1 kHz, 400 kHz
+//     simp-pulse (4 inputs)             26 kHz    21.6 kHz
+//     simp-pulse, NESTED_I2C_CALLBACKS
+//       false                           26 kHz     4.0 kHz
+//     quad-enc (2 encoders, cycles)     25.6 kHz   4.5 kHz
+
+#include <Arduino.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simulator.h"
+
+// --- Constants --------------------------------------------------------------
+// Virtual time after which a transaction of `check` is considered hung.
+uint64_t const CHECK_TIMEOUT_CYCLES = F_CPU;
+// Time for the firmware to settle after the waveforms stopped.
+uint64_t const SETTLE_CYCLES = F_CPU / 100;
+size_t const MAX_LINE_LENGTH = 256;
+
+// --- Global Variables -------------------------------------------------------
+static bool setup_done = false;
+static uint8_t device_address = 0x28;
+// Sum of all lost counts.
+static int64_t total_lost = 0;
+// Sum of the bytes that differed from `expect`.
+static int total_wrong = 0;
+
+// Script position, for error messages.
+static char const * script_name = "";
+static int line_number = 0;
+
+
+// --- Helpers ----------------------------------------------------------------
+static void script_error(char const * message, char const * argument) {
+  fprintf(stderr, "%s:%d: %s%s\n", script_name, line_number, message,
+          argument ? argument : "");
+  exit(2);
+}
+
+// The next token of the line as number.
+static long next_number() {
+  char const * token = strtok(NULL, " \t\r\n");
+  if (!token) { script_error("Missing number", NULL); }
+  char * end;
+  long const value = strtol(token, &end, 0);
+  if (*end != '\0') { script_error("Not a number: ", token); }
+  return value;
+}
+
+static void ensure_setup() {
+  if (!setup_done) {
+    setup();
+    setup_done = true;
+  }
+}
+
+// Run `loop()` until `end_time`, returns the number of iterations.
+static uint64_t run_loop_until(uint64_t end_time) {
+  uint64_t iterations = 0;
+  while (sim_now() < end_time) {
+    loop();
+    sim_consume(sim_costs.loop);
+    ++iterations;
+  }
+  return iterations;
+}
+
+static double cycles_to_us(uint64_t cycles) {
+  return (double)cycles / clockCyclesPerMicrosecond();
+}
+
+
+// --- Commands ---------------------------------------------------------------
+static void command_cost() {
+  char const * name = strtok(NULL, " \t\r\n");
+  uint32_t const cycles = next_number();
+  if (!name) { script_error("Missing cost name", NULL); }
+  else if (!strcmp(name, "loop")) { sim_costs.loop = cycles; }
+  else if (!strcmp(name, "isr")) { sim_costs.isr = cycles; }
+  else if (!strcmp(name, "twi_byte")) { sim_costs.twi_byte = cycles; }
+  else if (!strcmp(name, "twi_callback")) { sim_costs.twi_callback = cycles; }
+  else if (!strcmp(name, "critical_section")) {
+    sim_costs.critical_section = cycles;
+  }
+  else { script_error("Unknown cost: ", name); }
+}
+
+static void command_level() {
+  uint8_t const pin = next_number();
+  char const * level = strtok(NULL, " \t\r\n");
+  if (!level) { script_error("Missing level", NULL); }
+  else if (!strcmp(level, "z")) { sim_drive_pin(pin, SIM_FLOATING); }
+  else { sim_drive_pin(pin, atoi(level) ? 1 : 0); }
+}
+
+static void command_load() {
+  SimTransaction transaction = {};
+  transaction.address = device_address;
+  uint32_t const rate = next_number();
+  char const * token;
+  while ((token = strtok(NULL, " \t\r\n"))) {
+    if (!strcmp(token, "read")) {
+      transaction.read_length = next_number();
+      break;
+    }
+    if (transaction.write_length >= SIM_I2C_MAX_LENGTH) {
+      script_error("Too many bytes", NULL);
+    }
+    transaction.write_data[transaction.write_length++] = strtol(token, NULL, 0);
+  }
+  sim_i2c_periodic(transaction, rate);
+}
+
+static void command_glitch() {
+  uint32_t const rate = next_number();
+  uint32_t const width = microsecondsToClockCycles(next_number());
+  sim_add_glitches(sim_wave_count() - 1, rate, width);
+}
+
+static void command_run() {
+  ensure_setup();
+  long const ms = next_number();
+  sim_stats.i2c_max_cycles = 0;
+  sim_stats.max_latency_cycles = 0;
+  SimStats const before = sim_stats;
+  uint64_t const start_time = sim_now();
+  uint64_t const cycles = (uint64_t)ms * microsecondsToClockCycles(1000);
+
+  auto const host_start = std::chrono::steady_clock::now();
+  uint64_t const iterations = run_loop_until(start_time + cycles);
+  std::chrono::duration<double> const host_time =
+      std::chrono::steady_clock::now() - host_start;
+
+  double const seconds = (double)cycles / F_CPU;
+  uint64_t const isr_cycles = sim_stats.isr_cycles - before.isr_cycles;
+  printf("run %ld ms: %llu loops, %.0f loops/s (host: %.3g loops/s), "
+         "%u interrupts (%.1f %% CPU, latency up to %.0f us), "
+         "%u I2C transactions (%u skipped, longest %.0f us)\n",
+         ms, (unsigned long long)iterations, iterations / seconds,
+         iterations / host_time.count(),
+         sim_stats.isr_count - before.isr_count,
+         100.0 * isr_cycles / cycles,
+         cycles_to_us(sim_stats.max_latency_cycles),
+         sim_stats.i2c_transactions - before.i2c_transactions,
+         sim_stats.i2c_skipped - before.i2c_skipped,
+         cycles_to_us(sim_stats.i2c_max_cycles));
+}
+
+// Run the firmware until `transaction` is done.
+static void run_transaction(SimTransaction & transaction) {
+  sim_i2c_start(&transaction);
+  uint64_t const timeout = sim_now() + CHECK_TIMEOUT_CYCLES;
+  while (!transaction.done) {
+    if (sim_now() > timeout) { script_error("I2C transaction hangs", NULL); }
+    loop();
+    sim_consume(sim_costs.loop);
+  }
+  if (!transaction.acknowledged) {
+    script_error("The device did not acknowledge", NULL);
+  }
+}
+
+static void command_check() {
+  ensure_setup();
+  uint8_t const reg = next_number();
+  bool latch = false;
+  long within = 0;
+  char const * option;
+  while ((option = strtok(NULL, " \t\r\n"))) {
+    if (!strcmp(option, "latch")) { latch = true; }
+    else if (!strcmp(option, "within")) { within = next_number(); }
+    else { script_error("Unknown option: ", option); }
+  }
+  // Length of the time in front of the latched counters.
+  int const skip = latch ? 4 : 0;
+  int const n_counters = sim_wave_count();
+
+  sim_pause_waves();
+  run_loop_until(sim_now() + SETTLE_CYCLES);
+
+  SimTransaction transaction = {};
+  if (latch) {
+    transaction.address = 0;
+    transaction.write_data[0] = reg;
+    transaction.write_data[1] = 1;
+    transaction.write_length = 2;
+    run_transaction(transaction);
+    transaction = SimTransaction();
+  }
+  transaction.address = device_address;
+  transaction.write_data[0] = reg;
+  transaction.write_length = 1;
+  transaction.read_length = skip + 4 * n_counters;
+  run_transaction(transaction);
+
+  printf("check 0x%02X%s", reg, latch ? " latch" : "");
+  if (within) { printf(" within %ld", within); }
+  printf(":");
+  int64_t lost = 0;
+  for (int i = 0; i < n_counters; ++i) {
+    uint8_t const * data = &transaction.read_data[skip + 4 * i];
+    int32_t const count = (int32_t)((uint32_t)data[0] << 24
+                                  | (uint32_t)data[1] << 16
+                                  | (uint32_t)data[2] << 8
+                                  | (uint32_t)data[3]);
+    int32_t const expected = sim_wave_expected_count(i);
+    int64_t const difference = llabs((int64_t)expected - count);
+    if (difference > within) { lost += difference - within; }
+    printf(" [%d] %ld/%ld", i, (long)count, (long)expected);
+  }
+  printf(", lost %lld\n", (long long)lost);
+  total_lost += lost;
+  sim_resume_waves();
+}
+
+static void command_write() {
+  ensure_setup();
+  SimTransaction transaction = {};
+  transaction.address = device_address;
+  char const * token;
+  while ((token = strtok(NULL, " \t\r\n"))) {
+    if (transaction.write_length >= SIM_I2C_MAX_LENGTH) {
+      script_error("Too many bytes", NULL);
+    }
+    transaction.write_data[transaction.write_length++] = strtol(token, NULL, 0);
+  }
+  if (transaction.write_length == 0) { script_error("Missing register", NULL); }
+  sim_pause_waves();
+  run_transaction(transaction);
+  sim_resume_waves();
+}
+
+static void command_eeprom() {
+  uint16_t const address = next_number();
+  uint8_t data[SIM_I2C_MAX_LENGTH];
+  uint16_t length = 0;
+  char const * token;
+  while ((token = strtok(NULL, " \t\r\n"))) {
+    if (length >= sizeof(data)) { script_error("Too many bytes", NULL); }
+    data[length++] = strtol(token, NULL, 0);
+  }
+  sim_eeprom_load(address, data, length);
+}
+
+static void command_read() {
+  ensure_setup();
+  SimTransaction transaction = {};
+  transaction.address = device_address;
+  transaction.write_data[0] = next_number();
+  transaction.write_length = 1;
+  long const length = next_number();
+  if (length < 0 || length > SIM_I2C_MAX_LENGTH) {
+    script_error("Invalid length", NULL);
+  }
+  transaction.read_length = length;
+  // Expected bytes, -1 for any.
+  int expected[SIM_I2C_MAX_LENGTH];
+  long n_expected = 0;
+  char const * option = strtok(NULL, " \t\r\n");
+  if (option) {
+    if (strcmp(option, "expect")) {
+      script_error("Unknown option: ", option);
+    }
+    char const * token;
+    while ((token = strtok(NULL, " \t\r\n"))) {
+      if (n_expected >= length) { script_error("Too many bytes", NULL); }
+      expected[n_expected++] =
+          strcmp(token, "x") ? strtol(token, NULL, 0) : -1;
+    }
+  }
+  run_transaction(transaction);
+
+  printf("read 0x%02X:", transaction.write_data[0]);
+  int wrong = 0;
+  for (long i = 0; i < length; ++i) {
+    printf(" %02X", transaction.read_data[i]);
+    if (i < n_expected && expected[i] >= 0
+        && expected[i] != transaction.read_data[i]) {
+      ++wrong;
+    }
+  }
+  if (n_expected) { printf(", %d wrong", wrong); }
+  printf("\n");
+  total_wrong += wrong;
+}
+
+static void execute(char * line) {
+  char * comment = strchr(line, '#');
+  if (comment) { *comment = '\0'; }
+  char const * command = strtok(line, " \t\r\n");
+  if (!command) { return; }
+
+  if (!strcmp(command, "cost")) { command_cost(); }
+  else if (!strcmp(command, "bitrate")) { sim_i2c_set_bitrate(next_number()); }
+  else if (!strcmp(command, "address")) { device_address = next_number(); }
+  else if (!strcmp(command, "level")) { command_level(); }
+  else if (!strcmp(command, "pulse")) {
+    uint8_t const pin = next_number();
+    sim_add_pulse_wave(pin, next_number());
+  }
+  else if (!strcmp(command, "glitch")) { command_glitch(); }
+  else if (!strcmp(command, "quad")) {
+    uint8_t const pin_1 = next_number();
+    uint8_t const pin_2 = next_number();
+    sim_add_quadrature_wave(pin_1, pin_2, next_number());
+  }
+  else if (!strcmp(command, "load")) { command_load(); }
+  else if (!strcmp(command, "write")) { command_write(); }
+  else if (!strcmp(command, "eeprom")) { command_eeprom(); }
+  else if (!strcmp(command, "setup")) { ensure_setup(); }
+  else if (!strcmp(command, "run")) { command_run(); }
+  else if (!strcmp(command, "check")) { command_check(); }
+  else if (!strcmp(command, "read")) { command_read(); }
+  else if (!strcmp(command, "echo")) {
+    char const * text = strtok(NULL, "\r\n");
+    printf("%s\n", text ? text : "");
+  }
+  else { script_error("Unknown command: ", command); }
+}
+
+
+// --- Main -------------------------------------------------------------------
+int main(int argc, char ** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <scenario>\n", argv[0]);
+    return 2;
+  }
+  script_name = argv[1];
+  FILE * script = fopen(script_name, "r");
+  if (!script) {
+    perror(script_name);
+    return 2;
+  }
+
+  init();
+  char line[MAX_LINE_LENGTH];
+  while (fgets(line, sizeof(line), script)) {
+    ++line_number;
+    execute(line);
+  }
+  fclose(script);
+
+  printf("Lost counts: %lld\n", (long long)total_lost);
+  if (total_wrong) { printf("Wrong bytes: %d\n", total_wrong); }
+  return total_lost || total_wrong ? 1 : 0;
+}
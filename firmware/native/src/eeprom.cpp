@@ -0,0 +1,72 @@
+// Stand-in for the EEPROM functions of avr-libc, see `avr/eeprom.h`.
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+
+#include "simulator.h"
+
+// --- Constants --------------------------------------------------------------
+// Duration of a write (erase and write) of one byte: 3.4 ms.
+static uint64_t const WRITE_CYCLES = 34 * F_CPU / 10000;
+
+// --- Global Variables -------------------------------------------------------
+// The contents, erased before the first access.
+static uint8_t contents[SIM_EEPROM_SIZE];
+static bool erased = false;
+// End of the write in progress.
+static uint64_t ready_time = 0;
+
+// --- Helpers ----------------------------------------------------------------
+static uint8_t * eeprom() {
+  if (!erased) {
+    memset(contents, 0xFF, SIM_EEPROM_SIZE);
+    erased = true;
+  }
+  return contents;
+}
+
+static size_t offset(void const * address) {
+  return (uintptr_t)address % SIM_EEPROM_SIZE;
+}
+
+// --- Functions --------------------------------------------------------------
+void sim_eeprom_load(uint16_t address, uint8_t const * data, uint16_t length) {
+  for (uint16_t i = 0; i < length; ++i) {
+    eeprom()[(address + i) % SIM_EEPROM_SIZE] = data[i];
+  }
+}
+
+extern "C" int eeprom_is_ready(void) {
+  return sim_now() >= ready_time;
+}
+
+extern "C" uint8_t eeprom_read_byte(uint8_t const * address) {
+  return eeprom()[offset(address)];
+}
+
+extern "C" void eeprom_read_block(void * destination, void const * source,
+                                  size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    ((uint8_t *)destination)[i] = 
+      eeprom_read_byte((uint8_t const *)source + i);
+  }
+}
+
+extern "C" void eeprom_write_byte(uint8_t * address, uint8_t value) {
+  // Wait for the previous write.
+  if (!eeprom_is_ready()) { sim_consume(ready_time - sim_now()); }
+  eeprom()[offset(address)] = value;
+  ready_time = sim_now() + WRITE_CYCLES;
+}
+
+extern "C" void eeprom_update_byte(uint8_t * address, uint8_t value) {
+  if (eeprom_read_byte(address) != value) { eeprom_write_byte(address, value); }
+}
+
+extern "C" void eeprom_update_block(void const * source, void * destination,
+                                    size_t length) {
+  for (size_t i = 0; i < length; ++i) {
+    eeprom_update_byte((uint8_t *)destination + i, 
+                       ((uint8_t const *)source)[i]);
+  }
+}
@@ -0,0 +1,997 @@
+// ============================================================================
+//          Simulated Arduino Nano for the Host-Native Build
+// ============================================================================
+
+// See `simulator.h`.
+//
+// Limitations of the hardware emulation:
+// * Timers count in normal mode or CTC mode. PWM modes count like normal
+//   mode, compare match flags are only set in CTC mode.
+// * External clocks and input capture react immediately, without the
+//   synchronization delay and the noise canceler.
+// * The level interrupt of INT0/INT1 triggers only on the falling edge.
+// * The I2C master supports a single slave, it never loses arbitration.
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "simulator.h"
+
+extern "C" {
+  #include "utility/twi.h"
+}
+
+// --- Registers --------------------------------------------------------------
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+
+volatile uint8_t EICRA, EIMSK;
+FlagRegister EIFR;
+volatile uint8_t PCICR, PCMSK0, PCMSK1, PCMSK2;
+FlagRegister PCIFR;
+
+volatile uint8_t GTCCR;
+volatile uint8_t TCCR0A, TCCR0B, TCNT0, OCR0A, OCR0B, TIMSK0;
+FlagRegister TIFR0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint16_t TCNT1, ICR1, OCR1A, OCR1B;
+FlagRegister TIFR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2;
+FlagRegister TIFR2;
+
+volatile uint8_t TWBR, TWSR, TWAR, TWDR, TWAMR;
+TwiControlRegister TWCR;
+
+StatusRegister SREG;
+
+// --- Costs and statistics ---------------------------------------------------
+SimCosts sim_costs = {
+  150, // loop
+  80,  // isr
+  80,  // twi_byte
+  800, // twi_callback
+  160, // critical_section
+};
+
+SimStats sim_stats;
+
+// --- Global Variables -------------------------------------------------------
+uint64_t const NEVER = UINT64_MAX;
+
+// Virtual time in CPU cycles.
+static uint64_t now = 0;
+// Global interrupt flag.
+static bool interrupt_flag = false;
+// Nesting depth of interrupt handlers, and the cost of the executing one.
+static int isr_depth = 0;
+static uint32_t isr_cost = 0;
+// Cost of the executing handler, that passes with interrupts enabled if the
+// handler enables them.
+static uint32_t isr_interruptible_cost = 0;
+
+// Pins -----------------------------------
+// How the outside world drives the pins.
+uint8_t const DRIVE_FLOATING = 0;
+uint8_t const DRIVE_LOW = 1;
+uint8_t const DRIVE_HIGH = 2;
+static uint8_t pin_drive[NUM_DIGITAL_PINS];
+static uint32_t pin_changes[NUM_DIGITAL_PINS];
+
+// The ports and their pins.
+struct Port {
+  volatile uint8_t * pin;
+  volatile uint8_t * ddr;
+  volatile uint8_t * port;
+  volatile uint8_t * pcmsk;
+  uint8_t first_pin;
+  uint8_t n_pins;
+};
+// In the order of the pin change interrupts: PCINT0 = port B, ...
+Port const PORTS[] = {
+  {&PINB, &DDRB, &PORTB, &PCMSK0, 8, 6},
+  {&PINC, &DDRC, &PORTC, &PCMSK1, 14, 6},
+  {&PIND, &DDRD, &PORTD, &PCMSK2, 0, 8},
+};
+int const PORT_B = 0;
+int const PORT_C = 1;
+int const PORT_D = 2;
+
+// Special pins, as bits in their port.
+uint8_t const INT0_BIT = 2; // D2
+uint8_t const INT1_BIT = 3; // D3
+uint8_t const T0_BIT = 4;   // D4
+uint8_t const T1_BIT = 5;   // D5
+uint8_t const ICP1_BIT = 0; // B0 = D8
+
+// Waveforms ------------------------------
+struct Wave {
+  uint8_t pin_1;
+  uint8_t pin_2;
+  bool quadrature;
+  int32_t frequency;
+  uint64_t start_time;
+  uint64_t edges;
+  uint64_t next_time;
+  bool running;
+  int32_t count;
+  // Glitches: mean time between two, width, and the time at which the next
+  // one starts or the current one ends, all in CPU cycles.
+  uint64_t glitch_interval;
+  uint32_t glitch_width;
+  uint64_t glitch_time;
+  bool in_glitch;
+};
+int const MAX_WAVES = 8;
+static Wave waves[MAX_WAVES];
+static int n_waves = 0;
+// Time at which the waveforms were paused.
+static uint64_t waves_paused_time = NEVER;
+// State of the random generator for the glitches (xorshift), fixed seed.
+static uint32_t glitch_random = 2463534242u;
+
+// I2C master -----------------------------
+enum BusPhase {
+  BUS_IDLE,
+  BUS_SLA_W,   // start, address + write
+  BUS_WRITE,   // data byte from master
+  BUS_RESTART, // repeated start
+  BUS_SLA_R,   // address + read
+  BUS_READ,    // data byte from slave
+  BUS_STOP,
+  BUS_DONE,
+};
+int const I2C_QUEUE_LENGTH = 8;
+static SimTransaction * i2c_queue[I2C_QUEUE_LENGTH];
+static int i2c_queue_length = 0;
+static SimTransaction * i2c_active = NULL;
+static uint32_t i2c_bit_cycles = F_CPU / TWI_FREQ;
+// The current phase ends at `bus_next_time`.
+static BusPhase bus_phase = BUS_IDLE;
+static uint64_t bus_next_time = NEVER;
+// The slave has raised its interrupt flag, and holds the clock low until it
+// clears it. Then the next phase starts.
+static bool bus_waiting = false;
+static BusPhase bus_next_phase = BUS_IDLE;
+static uint8_t bus_next_bits = 0;
+// Index of the data byte.
+static uint8_t bus_index = 0;
+// The slave is addressed, as receiver or transmitter.
+static bool bus_addressed = false;
+static bool bus_slave_receives = false;
+static bool bus_general_call = false;
+// Periodic transactions
+static SimTransaction i2c_periodic_prototype;
+static SimTransaction i2c_periodic_instance;
+static uint64_t i2c_periodic_cycles = 0;
+static uint64_t i2c_periodic_next_time = NEVER;
+
+
+// --- Forward Declarations ---------------------------------------------------
+static void dispatch_interrupts();
+static void note_pending_interrupts();
+static void pass_time(uint64_t cycles);
+static void end_interruptible();
+static void bus_release(uint32_t delay);
+static void timer_tick(int timer, uint32_t ticks);
+
+
+// --- Interrupt Flag ---------------------------------------------------------
+extern "C" void sim_cli(void) {
+  if (isr_depth > 0 && interrupt_flag) {
+    // A handler with nested interrupts enters a critical section. Its 
+    // interruptible cycles until then pass, the first critical section is a
+    // part of them.
+    uint32_t const first = 
+      (sim_costs.critical_section < isr_interruptible_cost)
+      ? sim_costs.critical_section : isr_interruptible_cost;
+    isr_interruptible_cost -= first;
+    end_interruptible();
+    isr_cost += sim_costs.critical_section;
+  }
+  interrupt_flag = false;
+}
+
+extern "C" void sim_sei(void) {
+  if (isr_depth > 0 && !interrupt_flag) {
+    // A handler enables nested interrupts. Its cycles until now pass with
+    // interrupts disabled.
+    pass_time(isr_cost);
+    sim_stats.isr_cycles += isr_cost;
+    isr_cost = 0;
+  }
+  interrupt_flag = true;
+  dispatch_interrupts();
+}
+
+StatusRegister::operator uint8_t() const {
+  return interrupt_flag ? _BV(SREG_I) : 0;
+}
+
+StatusRegister & StatusRegister::operator=(uint8_t new_value) {
+  if (new_value & _BV(SREG_I)) { sim_sei(); }
+  else { sim_cli(); }
+  return *this;
+}
+
+
+// --- Pins -------------------------------------------------------------------
+// An edge on the pin of an external interrupt.
+static void external_interrupt(uint8_t number, bool level) {
+  uint8_t const mode = (EICRA >> (2 * number)) & 0x03;
+  bool const trigger = (mode == CHANGE)
+                    || (mode == RISING && level)
+                    || ((mode == FALLING || mode == LOW) && !level);
+  if (trigger) {
+    EIFR.value |= _BV(number);
+  }
+}
+
+// An edge on the external clock pin of Timer0 or Timer1.
+static void external_clock(int timer, bool level) {
+  uint8_t const clock_select = (timer == 0 ? TCCR0B : TCCR1B) & 0x07;
+  // 6: falling edge, 7: rising edge
+  if (clock_select == (level ? 7 : 6)) {
+    timer_tick(timer, 1);
+  }
+}
+
+// An edge on ICP1.
+static void input_capture(bool level) {
+  bool const rising_edge = TCCR1B & _BV(ICES1);
+  if ((TCCR1B & 0x07) && rising_edge == level) {
+    ICR1 = TCNT1;
+    TIFR1.value |= _BV(ICF1);
+  }
+}
+
+// Recompute the input register of a port, and trigger the hardware that
+// reacts on its pins.
+static void update_port(int index) {
+  Port const & p = PORTS[index];
+  uint8_t level = 0;
+  for (uint8_t bit = 0; bit < p.n_pins; ++bit) {
+    uint8_t const mask = _BV(bit);
+    uint8_t const drive = pin_drive[p.first_pin + bit];
+    if (*p.ddr & mask) {
+      level |= *p.port & mask;
+    }
+    else if (drive == DRIVE_HIGH) {
+      level |= mask;
+    }
+    else if (drive == DRIVE_FLOATING && (*p.port & mask)) {
+      // Pull-up resistor
+      level |= mask;
+    }
+  }
+  uint8_t const changed = *p.pin ^ level;
+  if (!changed) { return; }
+  *p.pin = level;
+
+  for (uint8_t bit = 0; bit < p.n_pins; ++bit) {
+    if (changed & _BV(bit)) { ++pin_changes[p.first_pin + bit]; }
+  }
+  if (changed & *p.pcmsk) {
+    PCIFR.value |= _BV(index);
+  }
+  if (index == PORT_D) {
+    if (changed & _BV(INT0_BIT)) { external_interrupt(0, level & _BV(INT0_BIT)); }
+    if (changed & _BV(INT1_BIT)) { external_interrupt(1, level & _BV(INT1_BIT)); }
+    if (changed & _BV(T0_BIT)) { external_clock(0, level & _BV(T0_BIT)); }
+    if (changed & _BV(T1_BIT)) { external_clock(1, level & _BV(T1_BIT)); }
+  }
+  else if (index == PORT_B) {
+    if (changed & _BV(ICP1_BIT)) { input_capture(level & _BV(ICP1_BIT)); }
+  }
+}
+
+void sim_update_pins() {
+  for (int i = 0; i < 3; ++i) {
+    update_port(i);
+  }
+}
+
+void sim_drive_pin(uint8_t pin, int8_t level) {
+  if (pin >= NUM_DIGITAL_PINS) { return; }
+  pin_drive[pin] = (level == SIM_FLOATING) ? DRIVE_FLOATING
+                 : (level ? DRIVE_HIGH : DRIVE_LOW);
+  sim_update_pins();
+}
+
+uint32_t sim_pin_changes(uint8_t pin) {
+  return (pin < NUM_DIGITAL_PINS) ? pin_changes[pin] : 0;
+}
+
+
+// --- Timers -----------------------------------------------------------------
+// Cycles per count for the clock select bits, 0: stopped or external clock.
+static uint32_t const TIMER_01_PRESCALE[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+static uint32_t const TIMER_2_PRESCALE[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+
+static uint32_t timer_prescale(int timer) {
+  switch (timer) {
+    case 0: return TIMER_01_PRESCALE[TCCR0B & 0x07];
+    case 1: return TIMER_01_PRESCALE[TCCR1B & 0x07];
+    default: return TIMER_2_PRESCALE[TCCR2B & 0x07];
+  }
+}
+
+// Waveform generation mode
+static uint8_t timer_mode(int timer) {
+  switch (timer) {
+    case 0: return (TCCR0A & 0x03) | ((TCCR0B >> WGM02) & 0x01) << 2;
+    case 1: return (TCCR1A & 0x03) | ((TCCR1B >> WGM12) & 0x03) << 2;
+    default: return (TCCR2A & 0x03) | ((TCCR2B >> WGM22) & 0x01) << 2;
+  }
+}
+
+static bool timer_is_ctc(int timer) {
+  uint8_t const mode = timer_mode(timer);
+  return (timer == 1) ? (mode == 4 || mode == 12) : (mode == 2);
+}
+
+static uint32_t timer_max(int timer) {
+  return (timer == 1) ? 0xFFFF : 0xFF;
+}
+
+// The value after which the timer wraps to 0.
+static uint32_t timer_top(int timer) {
+  if (!timer_is_ctc(timer)) { return timer_max(timer); }
+  switch (timer) {
+    case 0: return OCR0A;
+    case 1: return (timer_mode(1) == 12) ? ICR1 : OCR1A;
+    default: return OCR2A;
+  }
+}
+
+static uint32_t timer_count(int timer) {
+  switch (timer) {
+    case 0: return TCNT0;
+    case 1: return TCNT1;
+    default: return TCNT2;
+  }
+}
+
+static void set_timer_count(int timer, uint32_t count) {
+  switch (timer) {
+    case 0: TCNT0 = count; break;
+    case 1: TCNT1 = count; break;
+    default: TCNT2 = count; break;
+  }
+}
+
+// The timer wraps: set the overflow or the compare match flag.
+static void timer_wrap(int timer) {
+  bool const ctc = timer_is_ctc(timer);
+  switch (timer) {
+    case 0: TIFR0.value |= ctc ? _BV(OCF0A) : _BV(TOV0); break;
+    case 1:
+      TIFR1.value |= !ctc ? _BV(TOV1)
+                   : (timer_mode(1) == 12 ? _BV(ICF1) : _BV(OCF1A));
+      break;
+    default: TIFR2.value |= ctc ? _BV(OCF2A) : _BV(TOV2); break;
+  }
+}
+
+// Counts until the timer wraps.
+static uint32_t timer_ticks_to_wrap(int timer) {
+  uint32_t const count = timer_count(timer);
+  uint32_t const top = timer_top(timer);
+  // A counter above the top counts until its maximum.
+  return ((count <= top) ? top : timer_max(timer)) - count + 1;
+}
+
+static void timer_tick(int timer, uint32_t ticks) {
+  while (ticks > 0) {
+    uint32_t const to_wrap = timer_ticks_to_wrap(timer);
+    if (ticks < to_wrap) {
+      set_timer_count(timer, timer_count(timer) + ticks);
+      return;
+    }
+    ticks -= to_wrap;
+    set_timer_count(timer, 0);
+    timer_wrap(timer);
+  }
+}
+
+// Let the prescaled timers count until `time`.
+static void advance_timers(uint64_t time) {
+  for (int timer = 0; timer < 3; ++timer) {
+    uint32_t const prescale = timer_prescale(timer);
+    if (prescale) {
+      timer_tick(timer, time / prescale - now / prescale);
+    }
+  }
+}
+
+// Time at which the next prescaled timer wraps.
+static uint64_t next_timer_event() {
+  uint64_t next = NEVER;
+  for (int timer = 0; timer < 3; ++timer) {
+    uint32_t const prescale = timer_prescale(timer);
+    if (prescale) {
+      uint64_t const time =
+          (now / prescale + timer_ticks_to_wrap(timer)) * prescale;
+      if (time < next) { next = time; }
+    }
+  }
+  return next;
+}
+
+
+// --- Waveforms --------------------------------------------------------------
+// Time of edge number `edge` (counted from 1).
+static uint64_t wave_edge_time(Wave const & wave, uint64_t edge) {
+  uint64_t const edges_per_cycle = wave.quadrature ? 4 : 2;
+  uint64_t const frequency = abs(wave.frequency);
+  return wave.start_time + (edge * F_CPU) / (edges_per_cycle * frequency);
+}
+
+static int add_wave(uint8_t pin_1, uint8_t pin_2, bool quadrature,
+                    int32_t frequency) {
+  if (n_waves >= MAX_WAVES) {
+    fprintf(stderr, "Error: More than %d waveforms.\n", MAX_WAVES);
+    exit(2);
+  }
+  Wave & wave = waves[n_waves];
+  wave.pin_1 = pin_1;
+  wave.pin_2 = pin_2;
+  wave.quadrature = quadrature;
+  wave.frequency = frequency;
+  wave.start_time = now;
+  wave.edges = 0;
+  wave.running = (frequency != 0);
+  wave.count = 0;
+  wave.glitch_interval = 0;
+  wave.glitch_width = 0;
+  wave.glitch_time = NEVER;
+  wave.in_glitch = false;
+  // Start at the idle level of pulled up inputs, the firmware's initial
+  // state of the pins is then correct.
+  sim_drive_pin(pin_1, 1);
+  if (quadrature) { sim_drive_pin(pin_2, 1); }
+  wave.next_time = (wave.running && waves_paused_time == NEVER)
+                 ? wave_edge_time(wave, 1) : NEVER;
+  if (waves_paused_time != NEVER) { wave.start_time = waves_paused_time; }
+  return n_waves++;
+}
+
+static void wave_edge(Wave & wave) {
+  uint64_t const edge = ++wave.edges;
+  if (wave.quadrature) {
+    // The pins change alternately, for a positive frequency pin 2 first.
+    bool const pin_2_changes = (edge % 2 == 1) == (wave.frequency > 0);
+    // The levels of the changing pins are: low, low, high, high, ...
+    int8_t const level = 1 - ((edge + 1) / 2) % 2;
+    sim_drive_pin(pin_2_changes ? wave.pin_2 : wave.pin_1, level);
+    wave.count += (wave.frequency > 0) ? 1 : -1;
+  }
+  else {
+    sim_drive_pin(wave.pin_1, 1 - edge % 2);
+    wave.count += 1;
+  }
+  wave.next_time = wave_edge_time(wave, wave.edges + 1);
+}
+
+// Time of the next glitch: Uniformly distributed around the mean interval,
+// at least one glitch width after the previous one. Closer glitches would 
+// be one longer pulse for the polls.
+static void schedule_glitch(Wave & wave) {
+  glitch_random ^= glitch_random << 13;
+  glitch_random ^= glitch_random >> 17;
+  glitch_random ^= glitch_random << 5;
+  wave.glitch_time = now + 1 + wave.glitch_width
+                     + glitch_random % (2 * wave.glitch_interval);
+}
+
+// Start or end a glitch. Glitches that would overlap an edge are skipped.
+static void wave_glitch(Wave & wave) {
+  int8_t const level = 1 - wave.edges % 2;
+  if (wave.in_glitch) {
+    sim_drive_pin(wave.pin_1, level);
+    wave.in_glitch = false;
+    schedule_glitch(wave);
+  }
+  else if (now + wave.glitch_width < wave.next_time) {
+    sim_drive_pin(wave.pin_1, 1 - level);
+    wave.in_glitch = true;
+    wave.glitch_time = now + wave.glitch_width;
+  }
+  else {
+    schedule_glitch(wave);
+  }
+}
+
+void sim_add_glitches(int index, uint32_t rate, uint32_t width) {
+  if (index < 0 || index >= n_waves || waves[index].quadrature) {
+    fprintf(stderr, "Error: Glitches need a pulse wave.\n");
+    exit(2);
+  }
+  Wave & wave = waves[index];
+  wave.glitch_interval = rate ? F_CPU / rate : 0;
+  wave.glitch_width = width;
+  wave.glitch_time = NEVER;
+  if (rate && waves_paused_time == NEVER) { schedule_glitch(wave); }
+}
+
+int sim_add_pulse_wave(uint8_t pin, uint32_t frequency) {
+  return add_wave(pin, pin, false, frequency);
+}
+
+int sim_add_quadrature_wave(uint8_t pin_1, uint8_t pin_2, int32_t frequency) {
+  return add_wave(pin_1, pin_2, true, frequency);
+}
+
+void sim_pause_waves() {
+  if (waves_paused_time != NEVER) { return; }
+  waves_paused_time = now;
+  for (int i = 0; i < n_waves; ++i) {
+    Wave & wave = waves[i];
+    wave.next_time = NEVER;
+    if (wave.in_glitch) {
+      sim_drive_pin(wave.pin_1, 1 - wave.edges % 2);
+      wave.in_glitch = false;
+    }
+    wave.glitch_time = NEVER;
+  }
+}
+
+void sim_resume_waves() {
+  if (waves_paused_time == NEVER) { return; }
+  for (int i = 0; i < n_waves; ++i) {
+    Wave & wave = waves[i];
+    if (wave.running) {
+      wave.start_time += now - waves_paused_time;
+      wave.next_time = wave_edge_time(wave, wave.edges + 1);
+    }
+    if (wave.glitch_interval) { schedule_glitch(wave); }
+  }
+  waves_paused_time = NEVER;
+}
+
+int sim_wave_count() {
+  return n_waves;
+}
+
+int32_t sim_wave_expected_count(int index) {
+  return (index < n_waves) ? waves[index].count : 0;
+}
+
+
+// --- I2C Master -------------------------------------------------------------
+// Begin a phase of the bus protocol with `bits` clock cycles, in `delay`
+// cycles.
+static void bus_begin(BusPhase phase, uint8_t bits, uint32_t delay = 0) {
+  bus_phase = phase;
+  bus_next_time = now + delay + bits * i2c_bit_cycles;
+}
+
+// Continue with the phase, after the slave has released the bus.
+static void bus_continue(BusPhase phase, uint8_t bits) {
+  if (bus_waiting) {
+    bus_next_phase = phase;
+    bus_next_bits = bits;
+  }
+  else {
+    bus_begin(phase, bits);
+  }
+}
+
+// The TWI hardware of the slave sets its interrupt flag, and holds the bus.
+static void bus_raise(uint8_t status, uint8_t data) {
+  TWSR = (TWSR & ~TW_STATUS_MASK) | status;
+  TWDR = data;
+  TWCR.value |= _BV(TWINT);
+  bus_waiting = true;
+  bus_next_time = NEVER;
+}
+
+// The slave clears its interrupt flag in `delay` cycles.
+static void bus_release(uint32_t delay) {
+  if (!bus_waiting) { return; }
+  bus_waiting = false;
+  bus_begin(bus_next_phase, bus_next_bits, delay);
+}
+
+TwiControlRegister & TwiControlRegister::operator=(uint8_t new_value) {
+  bool const clear_flag = new_value & _BV(TWINT);
+  bool const release = clear_flag && (value & _BV(TWINT));
+  value = (new_value & ~_BV(TWINT))
+        | (clear_flag ? 0 : (value & _BV(TWINT)));
+  if (release) {
+    // The bus is released at once, also in a handler: The TWI driver 
+    // releases it before the receive callback, which runs while the bus 
+    // continues. The cycles of the handler until here have not passed yet.
+    bus_release(isr_depth > 0 ? isr_cost + isr_interruptible_cost : 0);
+  }
+  return *this;
+}
+
+// Does the slave acknowledge `address`?
+static bool slave_acknowledges(uint8_t address, bool read) {
+  if (!(TWCR & _BV(TWEN)) || !(TWCR & _BV(TWEA))) { return false; }
+  bus_general_call = !read && address == 0 && (TWAR & _BV(TWGCE));
+  return bus_general_call || address == (TWAR >> 1);
+}
+
+static void bus_start(SimTransaction * transaction) {
+  i2c_active = transaction;
+  transaction->acknowledged = true;
+  transaction->done = false;
+  transaction->start_time = now;
+  bus_index = 0;
+  bus_addressed = false;
+  bus_begin(transaction->write_length ? BUS_SLA_W : BUS_SLA_R, 10);
+}
+
+static void bus_finish() {
+  SimTransaction * const transaction = i2c_active;
+  transaction->done = true;
+  transaction->end_time = now;
+  uint64_t const duration = now - transaction->start_time;
+  ++sim_stats.i2c_transactions;
+  if (duration > sim_stats.i2c_max_cycles) {
+    sim_stats.i2c_max_cycles = duration;
+  }
+  i2c_active = NULL;
+  bus_phase = BUS_IDLE;
+  bus_next_time = NEVER;
+  if (i2c_queue_length > 0) {
+    SimTransaction * const next = i2c_queue[0];
+    --i2c_queue_length;
+    for (int i = 0; i < i2c_queue_length; ++i) {
+      i2c_queue[i] = i2c_queue[i + 1];
+    }
+    bus_start(next);
+  }
+}
+
+// The current phase of the bus protocol has ended.
+static void bus_phase_done() {
+  SimTransaction & transaction = *i2c_active;
+  switch (bus_phase) {
+    case BUS_SLA_W:
+      if (slave_acknowledges(transaction.address, false)) {
+        bus_addressed = true;
+        bus_slave_receives = true;
+        bus_raise(bus_general_call ? TW_SR_GCALL_ACK : TW_SR_SLA_ACK, 0);
+        bus_continue(BUS_WRITE, 9);
+      }
+      else {
+        transaction.acknowledged = false;
+        bus_continue(BUS_STOP, 1);
+      }
+      break;
+
+    case BUS_WRITE:
+    {
+      uint8_t const data = transaction.write_data[bus_index++];
+      bool const slave_acks = TWCR & _BV(TWEA);
+      if (slave_acks) {
+        bus_raise(bus_general_call ? TW_SR_GCALL_DATA_ACK : TW_SR_DATA_ACK,
+                  data);
+      }
+      else {
+        bus_raise(bus_general_call ? TW_SR_GCALL_DATA_NACK : TW_SR_DATA_NACK,
+                  data);
+        bus_addressed = false;
+        transaction.acknowledged = false;
+        bus_continue(BUS_STOP, 1);
+        break;
+      }
+      if (bus_index < transaction.write_length) {
+        bus_continue(BUS_WRITE, 9);
+      }
+      else {
+        bus_continue(transaction.read_length ? BUS_RESTART : BUS_STOP, 1);
+      }
+      break;
+    }
+
+    case BUS_RESTART:
+      if (bus_addressed && bus_slave_receives) {
+        bus_raise(TW_SR_STOP, 0);
+      }
+      bus_addressed = false;
+      bus_continue(BUS_SLA_R, 9);
+      break;
+
+    case BUS_SLA_R:
+      if (slave_acknowledges(transaction.address, true)) {
+        bus_addressed = true;
+        bus_slave_receives = false;
+        bus_index = 0;
+        bus_raise(TW_ST_SLA_ACK, TWDR);
+        bus_continue(BUS_READ, 9);
+      }
+      else {
+        transaction.acknowledged = false;
+        bus_continue(BUS_STOP, 1);
+      }
+      break;
+
+    case BUS_READ:
+    {
+      bool const last = (bus_index + 1 >= transaction.read_length);
+      transaction.read_data[bus_index++] = bus_addressed ? TWDR : 0xFF;
+      if (bus_addressed) {
+        if (last) {
+          bus_raise(TW_ST_DATA_NACK, TWDR);
+          bus_addressed = false;
+        }
+        else if (TWCR & _BV(TWEA)) {
+          bus_raise(TW_ST_DATA_ACK, TWDR);
+        }
+        else {
+          bus_raise(TW_ST_LAST_DATA, TWDR);
+          bus_addressed = false;
+        }
+      }
+      bus_continue(last ? BUS_STOP : BUS_READ, last ? 1 : 9);
+      break;
+    }
+
+    case BUS_STOP:
+      if (bus_addressed && bus_slave_receives) {
+        bus_raise(TW_SR_STOP, 0);
+      }
+      bus_addressed = false;
+      bus_continue(BUS_DONE, 0);
+      break;
+
+    case BUS_DONE:
+      bus_finish();
+      break;
+
+    case BUS_IDLE:
+      break;
+  }
+}
+
+void sim_i2c_set_bitrate(uint32_t bitrate) {
+  i2c_bit_cycles = F_CPU / bitrate;
+}
+
+void sim_i2c_start(SimTransaction * transaction) {
+  transaction->done = false;
+  if (!i2c_active) {
+    bus_start(transaction);
+    return;
+  }
+  if (i2c_queue_length >= I2C_QUEUE_LENGTH) {
+    fprintf(stderr, "Error: More than %d queued I2C transactions.\n",
+            I2C_QUEUE_LENGTH);
+    exit(2);
+  }
+  i2c_queue[i2c_queue_length++] = transaction;
+}
+
+void sim_i2c_periodic(SimTransaction const & transaction, uint32_t rate) {
+  i2c_periodic_prototype = transaction;
+  i2c_periodic_cycles = rate ? F_CPU / rate : 0;
+  i2c_periodic_next_time = rate ? now + i2c_periodic_cycles : NEVER;
+}
+
+// Start the periodic transaction, if the bus is free.
+static void i2c_periodic_event() {
+  i2c_periodic_next_time += i2c_periodic_cycles;
+  if (i2c_active) {
+    ++sim_stats.i2c_skipped;
+    return;
+  }
+  i2c_periodic_instance = i2c_periodic_prototype;
+  sim_i2c_start(&i2c_periodic_instance);
+}
+
+
+// --- Time -------------------------------------------------------------------
+static uint64_t next_event_time() {
+  uint64_t next = next_timer_event();
+  for (int i = 0; i < n_waves; ++i) {
+    if (waves[i].next_time < next) { next = waves[i].next_time; }
+    if (waves[i].glitch_time < next) { next = waves[i].glitch_time; }
+  }
+  if (bus_next_time < next) { next = bus_next_time; }
+  if (i2c_periodic_next_time < next) { next = i2c_periodic_next_time; }
+  return next;
+}
+
+static void move_time_to(uint64_t time) {
+  advance_timers(time);
+  now = time;
+  note_pending_interrupts();
+}
+
+// Process the events at the current time.
+static void process_events() {
+  for (int i = 0; i < n_waves; ++i) {
+    while (waves[i].next_time == now) {
+      wave_edge(waves[i]);
+    }
+    if (waves[i].glitch_time == now) {
+      wave_glitch(waves[i]);
+    }
+  }
+  if (bus_next_time == now) {
+    bus_next_time = NEVER;
+    bus_phase_done();
+  }
+  if (i2c_periodic_next_time == now) {
+    i2c_periodic_event();
+  }
+  note_pending_interrupts();
+}
+
+// Time passes, without dispatching interrupts.
+static void pass_time(uint64_t cycles) {
+  uint64_t const end = now + cycles;
+  for (;;) {
+    uint64_t const next = next_event_time();
+    if (next > end) {
+      move_time_to(end);
+      return;
+    }
+    move_time_to(next);
+    process_events();
+  }
+}
+
+uint64_t sim_now() {
+  return now;
+}
+
+void sim_consume(uint64_t cycles) {
+  uint64_t remaining = cycles;
+  for (;;) {
+    dispatch_interrupts();
+    if (remaining == 0) { return; }
+    uint64_t const next = next_event_time();
+    uint64_t const step = (next - now < remaining) ? next - now : remaining;
+    move_time_to(now + step);
+    remaining -= step;
+    if (now == next) { process_events(); }
+  }
+}
+
+void sim_add_isr_cycles(uint32_t cycles) {
+  isr_cost += cycles;
+}
+
+void sim_add_interruptible_cycles(uint32_t cycles) {
+  isr_interruptible_cost += cycles;
+}
+
+// The interruptible cycles of the executing handler pass, with interrupts
+// enabled.
+static void end_interruptible() {
+  uint32_t const cycles = isr_interruptible_cost;
+  isr_interruptible_cost = 0;
+  sim_stats.isr_cycles += cycles;
+  sim_consume(cycles);
+}
+
+
+// --- Interrupts -------------------------------------------------------------
+extern "C" {
+  void __vector_1(void) __attribute__((weak));
+  void __vector_2(void) __attribute__((weak));
+  void __vector_3(void) __attribute__((weak));
+  void __vector_4(void) __attribute__((weak));
+  void __vector_5(void) __attribute__((weak));
+  void __vector_7(void) __attribute__((weak));
+  void __vector_8(void) __attribute__((weak));
+  void __vector_9(void) __attribute__((weak));
+  void __vector_10(void) __attribute__((weak));
+  void __vector_11(void) __attribute__((weak));
+  void __vector_12(void) __attribute__((weak));
+  void __vector_13(void) __attribute__((weak));
+  void __vector_14(void) __attribute__((weak));
+  void __vector_15(void) __attribute__((weak));
+  void __vector_16(void) __attribute__((weak));
+  void __vector_24(void) __attribute__((weak));
+}
+
+struct Vector {
+  uint8_t number;
+  void (*handler)(void);
+  volatile uint8_t * flags;
+  uint8_t flag;
+  volatile uint8_t * enable;
+  uint8_t enable_bit;
+};
+
+// In the order of their priority.
+static Vector const VECTORS[] = {
+  {1, __vector_1, &EIFR.value, INTF0, &EIMSK, INT0},
+  {2, __vector_2, &EIFR.value, INTF1, &EIMSK, INT1},
+  {3, __vector_3, &PCIFR.value, PCIF0, &PCICR, PCIE0},
+  {4, __vector_4, &PCIFR.value, PCIF1, &PCICR, PCIE1},
+  {5, __vector_5, &PCIFR.value, PCIF2, &PCICR, PCIE2},
+  {7, __vector_7, &TIFR2.value, OCF2A, &TIMSK2, OCIE2A},
+  {8, __vector_8, &TIFR2.value, OCF2B, &TIMSK2, OCIE2B},
+  {9, __vector_9, &TIFR2.value, TOV2, &TIMSK2, TOIE2},
+  {10, __vector_10, &TIFR1.value, ICF1, &TIMSK1, ICIE1},
+  {11, __vector_11, &TIFR1.value, OCF1A, &TIMSK1, OCIE1A},
+  {12, __vector_12, &TIFR1.value, OCF1B, &TIMSK1, OCIE1B},
+  {13, __vector_13, &TIFR1.value, TOV1, &TIMSK1, TOIE1},
+  {14, __vector_14, &TIFR0.value, OCF0A, &TIMSK0, OCIE0A},
+  {15, __vector_15, &TIFR0.value, OCF0B, &TIMSK0, OCIE0B},
+  {16, __vector_16, &TIFR0.value, TOV0, &TIMSK0, TOIE0},
+  // The TWI flag is cleared by the handler, not by the hardware.
+  {24, __vector_24, &TWCR.value, TWINT, &TWCR.value, TWIE},
+};
+uint8_t const TWI_VECTOR = 24;
+int const N_VECTORS = sizeof(VECTORS) / sizeof(VECTORS[0]);
+
+// The enabled interrupts that are pending, and since when, for the latency.
+static bool pending[N_VECTORS];
+static uint64_t pending_since[N_VECTORS];
+
+// Note the time of the interrupts that became pending.
+static void note_pending_interrupts() {
+  for (int i = 0; i < N_VECTORS; ++i) {
+    Vector const & vector = VECTORS[i];
+    bool const now_pending = (*vector.flags & _BV(vector.flag))
+                          && (*vector.enable & _BV(vector.enable_bit));
+    if (now_pending && !pending[i]) { pending_since[i] = now; }
+    pending[i] = now_pending;
+  }
+}
+
+static void run_isr(int index) {
+  Vector const & vector = VECTORS[index];
+  if (!vector.handler) {
+    fprintf(stderr, "Error: Interrupt %d is enabled, but has no handler.\n",
+            vector.number);
+    exit(2);
+  }
+  if (vector.number != TWI_VECTOR) {
+    *vector.flags &= ~_BV(vector.flag);
+  }
+  if (pending[index]) {
+    uint64_t const latency = now - pending_since[index];
+    if (latency > sim_stats.max_latency_cycles) {
+      sim_stats.max_latency_cycles = latency;
+    }
+    pending[index] = false;
+  }
+  interrupt_flag = false;
+  ++isr_depth;
+  uint32_t const outer_cost = isr_cost;
+  uint32_t const outer_interruptible_cost = isr_interruptible_cost;
+  isr_cost = (vector.number == TWI_VECTOR) ? sim_costs.twi_byte
+                                           : sim_costs.isr;
+  isr_interruptible_cost = 0;
+  vector.handler();
+  // The handler returns with nested interrupts enabled.
+  if (interrupt_flag) { end_interruptible(); }
+  // Without nested interrupts, all cycles pass with interrupts disabled.
+  uint32_t const cost = isr_cost + isr_interruptible_cost;
+  isr_cost = outer_cost;
+  isr_interruptible_cost = outer_interruptible_cost;
+  ++sim_stats.isr_count;
+  sim_stats.isr_cycles += cost;
+  // Interrupts are disabled while the handler executes.
+  interrupt_flag = false;
+  pass_time(cost);
+  --isr_depth;
+  interrupt_flag = true;
+}
+
+// Execute the pending interrupt with the highest priority.
+static bool dispatch_one() {
+  for (int i = 0; i < N_VECTORS; ++i) {
+    Vector const & vector = VECTORS[i];
+    if ((*vector.flags & _BV(vector.flag))
+        && (*vector.enable & _BV(vector.enable_bit))) {
+      run_isr(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void dispatch_interrupts() {
+  while (interrupt_flag && dispatch_one()) {}
+}
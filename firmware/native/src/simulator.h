@@ -0,0 +1,167 @@
+// ============================================================================
+//          Simulated Arduino Nano for the Host-Native Build
+// ============================================================================
+
+// Emulates the parts of the ATmega328 that the odometer firmwares use: the
+// ports, pin change and external interrupts, Timer0/1/2 (prescaled clock,
+// external clock on T0/T1, input capture on ICP1, CTC mode), the TWI slave
+// hardware, and the EEPROM (`avr/eeprom.h`). The simulator plays the outside
+// world: It drives the input pins with scripted waveforms, and it is the I2C
+// master.
+//
+// Time is virtual and counted in CPU cycles. Code of the firmware executes
+// in zero virtual time, the CPU cycles it needs are estimated by costs
+// (`sim_costs`):
+// * Each call of `loop()` is followed by `sim_consume(sim_costs.loop)`.
+// * Each interrupt handler is followed by `sim_costs.isr` cycles, in which
+//   interrupts are disabled and the main loop does not run.
+// * `delay()` and `delayMicroseconds()` consume their time.
+// * A handler can enable interrupts again (nested interrupts), like the I2C
+//   callbacks of the simple pulse firmware. Its cost until then passes with
+//   interrupts disabled. The cost of the callbacks
+//   (`sim_add_interruptible_cycles()`) passes with interrupts enabled, when
+//   the handler disables them again. Each critical section (`cli()` to
+//   `sei()`) costs `sim_costs.critical_section` cycles with interrupts
+//   disabled, the first one is a part of the cost of the callback.
+// * The I2C bus continues when a handler clears `TWINT`, after the cycles 
+//   of the handler until then. The receive callback runs while the bus is 
+//   free, the request callback while it is held.
+// * The timers don't see the cycles of a handler while it runs with 
+//   interrupts disabled. Durations that a handler measures itself, like 
+//   the timing histograms of the I2C callbacks without nested interrupts, 
+//   are 0.
+// While time advances, waveforms change pins, timers count, and I2C bytes
+// arrive. These events set interrupt flags, and pending interrupts are
+// dispatched in the order of their vectors, when the global interrupt flag
+// is set. As on the chip, several events of the same interrupt, while it is
+// pending, are merged into one.
+//
+// The costs are estimates, the benchmark results (lost counts, CPU load)
+// are only as exact as the costs. Cycle exact numbers need a simulator of
+// the AVR CPU.
+
+#ifndef NATIVE_SIMULATOR_H
+#define NATIVE_SIMULATOR_H
+
+#include <stdint.h>
+
+// --- Costs ------------------------------------------------------------------
+// Estimated CPU cycles of the firmware's code.
+struct SimCosts {
+  // One call of `loop()`.
+  uint32_t loop;
+  // One interrupt handler of the firmware, including entry and exit.
+  uint32_t isr;
+  // The TWI interrupt handler for one byte on the bus.
+  uint32_t twi_byte;
+  // Additional cycles when the TWI handler calls the receive or request
+  // callback of the firmware.
+  uint32_t twi_callback;
+  // One critical section (`cli()` to `sei()`) of a handler with nested
+  // interrupts, e.g. a copy of the counters in an I2C callback.
+  uint32_t critical_section;
+};
+
+extern SimCosts sim_costs;
+
+// --- Time -------------------------------------------------------------------
+// Current time in CPU cycles.
+uint64_t sim_now();
+// The foreground code (`loop()`, `delay()`) needs `cycles` CPU cycles. Time
+// advances, pending interrupts are dispatched. Time spent in interrupt
+// handlers is added.
+void sim_consume(uint64_t cycles);
+// Add `cycles` to the cost of the interrupt handler that is executing.
+void sim_add_isr_cycles(uint32_t cycles);
+// Like `sim_add_isr_cycles()`, but the cycles pass with interrupts enabled,
+// if the handler enables them.
+void sim_add_interruptible_cycles(uint32_t cycles);
+
+// --- Pins -------------------------------------------------------------------
+// Levels with which the outside world drives a pin.
+int8_t const SIM_FLOATING = -1;
+
+// Drive `pin` from outside with `level`: 0, 1, `SIM_FLOATING`.
+void sim_drive_pin(uint8_t pin, int8_t level);
+// Recompute the input registers, after `DDRx` or `PORTx` changed.
+void sim_update_pins();
+// Number of level changes of `pin`, e.g. for the activity LED.
+uint32_t sim_pin_changes(uint8_t pin);
+
+// --- Waveforms --------------------------------------------------------------
+// Square wave with `frequency` in Hz on `pin`. Its count is incremented for
+// each edge. Returns the index of the waveform.
+int sim_add_pulse_wave(uint8_t pin, uint32_t frequency);
+// Quadrature signal with `frequency` (full cycles) in Hz on `pin_1` and
+// `pin_2`. For a positive frequency `pin_2` leads, for a negative frequency
+// `pin_1` leads. Its count is incremented (positive frequency) or
+// decremented for each edge, like the Encoder library counts.
+int sim_add_quadrature_wave(uint8_t pin_1, uint8_t pin_2, int32_t frequency);
+// Glitches on the pulse wave `index`: With `rate` glitches per second on
+// average, at random times, its pin is inverted for `width` CPU cycles.
+// Glitches don't overlap edges and don't change the count, and are at 
+// least `width` apart. A rate of 0 stops them.
+void sim_add_glitches(int index, uint32_t rate, uint32_t width);
+// Pause all waveforms, the pins keep their levels.
+void sim_pause_waves();
+// Continue the paused waveforms.
+void sim_resume_waves();
+// Number of waveforms.
+int sim_wave_count();
+// The count of an ideal counter for waveform `index`.
+int32_t sim_wave_expected_count(int index);
+
+// --- I2C master -------------------------------------------------------------
+uint8_t const SIM_I2C_MAX_LENGTH = 128;
+
+// An I2C transaction: `write_length` bytes are written, then, after a
+// repeated start, `read_length` bytes are read.
+struct SimTransaction {
+  uint8_t address;
+  uint8_t write_data[SIM_I2C_MAX_LENGTH];
+  uint8_t write_length;
+  uint8_t read_length;
+  // --- Results ---
+  uint8_t read_data[SIM_I2C_MAX_LENGTH];
+  // The slave acknowledged its address and all written bytes.
+  bool acknowledged;
+  bool done;
+  uint64_t start_time;
+  uint64_t end_time;
+};
+
+// Set the clock of the I2C bus, in Hz.
+void sim_i2c_set_bitrate(uint32_t bitrate);
+// Start `transaction` when the bus is free. `transaction` must stay valid
+// until it is done.
+void sim_i2c_start(SimTransaction * transaction);
+// Start a copy of `transaction` with `rate` Hz, as background load.
+// A rate of 0 stops it.
+void sim_i2c_periodic(SimTransaction const & transaction, uint32_t rate);
+
+// --- EEPROM -----------------------------------------------------------------
+uint16_t const SIM_EEPROM_SIZE = 1024;
+
+// Store `length` bytes at `address` of the EEPROM, without write time, e.g.
+// a configuration before `setup()`.
+void sim_eeprom_load(uint16_t address, uint8_t const * data, uint16_t length);
+
+// --- Statistics -------------------------------------------------------------
+struct SimStats {
+  // Interrupt handlers and the cycles spent in them.
+  uint32_t isr_count;
+  uint64_t isr_cycles;
+  // Completed I2C transactions, and the longest one in cycles.
+  uint32_t i2c_transactions;
+  uint64_t i2c_max_cycles;
+  // Periodic transactions, that were skipped because the bus was busy.
+  uint32_t i2c_skipped;
+  // The longest time that an enabled interrupt was pending until its
+  // handler started, in cycles: the worst-case latency of the interrupts,
+  // e.g. of counting in the pin change interrupt.
+  uint64_t max_latency_cycles;
+};
+
+extern SimStats sim_stats;
+
+#endif
@@ -0,0 +1,19 @@
+// Stand-in for `<util/crc16.h>`: The CRC functions of avr-libc, with the C
+// equivalents of their assembler, from the avr-libc documentation.
+
+#ifndef NATIVE_UTIL_CRC16_H
+#define NATIVE_UTIL_CRC16_H
+
+#include <stdint.h>
+
+// CRC-16 with the polynomial 0xA001 (x^16 + x^15 + x^2 + 1), reflected.
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+  crc ^= a;
+  for (int i = 0; i < 8; ++i) {
+    if (crc & 1) { crc = (crc >> 1) ^ 0xA001; }
+    else { crc = (crc >> 1); }
+  }
+  return crc;
+}
+
+#endif
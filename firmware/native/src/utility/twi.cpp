@@ -0,0 +1,149 @@
+// Stand-in for `utility/twi.c` of the Wire library: The slave part of the
+// TWI driver, with the same interrupt handler as the real driver. It runs
+// on the emulated TWI registers, the simulator plays the I2C master.
+
+#include <Arduino.h>
+#include "simulator.h"
+
+extern "C" {
+  #include "utility/twi.h"
+}
+
+static volatile uint8_t twi_state;
+
+static void (*twi_onSlaveTransmit)(void);
+static void (*twi_onSlaveReceive)(uint8_t*, int);
+
+static uint8_t twi_txBuffer[TWI_BUFFER_LENGTH];
+static volatile uint8_t twi_txBufferIndex;
+static volatile uint8_t twi_txBufferLength;
+
+static uint8_t twi_rxBuffer[TWI_BUFFER_LENGTH];
+static volatile uint8_t twi_rxBufferIndex;
+
+
+// Enable the TWI hardware, acknowledge the own address.
+void twi_init(void) {
+  twi_state = TWI_READY;
+  TWSR &= ~(_BV(TWPS0) | _BV(TWPS1));
+  TWBR = ((F_CPU / TWI_FREQ) - 16) / 2;
+  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA);
+}
+
+void twi_disable(void) {
+  TWCR &= ~(_BV(TWEN) | _BV(TWIE) | _BV(TWEA));
+}
+
+void twi_setAddress(uint8_t address) {
+  TWAR = address << 1;
+}
+
+// Fill the slave tx buffer, must be called in the slave tx event.
+// Returns 0: success, 1: too long for the buffer, 2: not slave transmitter
+uint8_t twi_transmit(const uint8_t* data, uint8_t length) {
+  if (TWI_BUFFER_LENGTH < (twi_txBufferLength + length)) {
+    return 1;
+  }
+  if (TWI_STX != twi_state) {
+    return 2;
+  }
+  for (uint8_t i = 0; i < length; ++i) {
+    twi_txBuffer[twi_txBufferLength + i] = data[i];
+  }
+  twi_txBufferLength += length;
+  return 0;
+}
+
+void twi_attachSlaveRxEvent( void (*function)(uint8_t*, int) ) {
+  twi_onSlaveReceive = function;
+}
+
+void twi_attachSlaveTxEvent( void (*function)(void) ) {
+  twi_onSlaveTransmit = function;
+}
+
+// Release the bus, and acknowledge (1) or not acknowledge (0) the next byte.
+void twi_reply(uint8_t ack) {
+  if (ack) {
+    TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT) | _BV(TWEA);
+  }
+  else {
+    TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWINT);
+  }
+}
+
+void twi_releaseBus(void) {
+  TWCR = _BV(TWEN) | _BV(TWIE) | _BV(TWEA) | _BV(TWINT);
+  twi_state = TWI_READY;
+}
+
+
+ISR(TWI_vect) {
+  switch (TWSR & TW_STATUS_MASK) {
+    // Slave receiver
+    case TW_SR_SLA_ACK:
+    case TW_SR_GCALL_ACK:
+    case TW_SR_ARB_LOST_SLA_ACK:
+    case TW_SR_ARB_LOST_GCALL_ACK:
+      twi_state = TWI_SRX;
+      twi_rxBufferIndex = 0;
+      twi_reply(1);
+      break;
+    case TW_SR_DATA_ACK:
+    case TW_SR_GCALL_DATA_ACK:
+      if (twi_rxBufferIndex < TWI_BUFFER_LENGTH) {
+        twi_rxBuffer[twi_rxBufferIndex++] = TWDR;
+        twi_reply(1);
+      }
+      else {
+        twi_reply(0);
+      }
+      break;
+    case TW_SR_STOP:
+      twi_releaseBus();
+      if (twi_rxBufferIndex < TWI_BUFFER_LENGTH) {
+        twi_rxBuffer[twi_rxBufferIndex] = '\0';
+      }
+      sim_add_interruptible_cycles(sim_costs.twi_callback);
+      twi_onSlaveReceive(twi_rxBuffer, twi_rxBufferIndex);
+      twi_rxBufferIndex = 0;
+      break;
+    case TW_SR_DATA_NACK:
+    case TW_SR_GCALL_DATA_NACK:
+      twi_reply(0);
+      break;
+
+    // Slave transmitter
+    case TW_ST_SLA_ACK:
+    case TW_ST_ARB_LOST_SLA_ACK:
+      twi_state = TWI_STX;
+      twi_txBufferIndex = 0;
+      twi_txBufferLength = 0;
+      sim_add_interruptible_cycles(sim_costs.twi_callback);
+      twi_onSlaveTransmit();
+      if (0 == twi_txBufferLength) {
+        twi_txBufferLength = 1;
+        twi_txBuffer[0] = 0x00;
+      }
+      // Fall through
+    case TW_ST_DATA_ACK:
+      TWDR = twi_txBuffer[twi_txBufferIndex++];
+      if (twi_txBufferIndex < twi_txBufferLength) {
+        twi_reply(1);
+      }
+      else {
+        twi_reply(0);
+      }
+      break;
+    case TW_ST_DATA_NACK:
+    case TW_ST_LAST_DATA:
+      twi_reply(1);
+      twi_state = TWI_READY;
+      break;
+
+    // Master modes are not emulated.
+    default:
+      twi_releaseBus();
+      break;
+  }
+}
@@ -0,0 +1,52 @@
+// Stand-in for `utility/twi.h` of the Wire library: The slave part of the
+// TWI driver. It works on the emulated TWI registers like the real driver,
+// the simulator plays the I2C master.
+
+#ifndef NATIVE_TWI_H
+#define NATIVE_TWI_H
+
+#include <stdint.h>
+
+#ifndef TWI_FREQ
+  #define TWI_FREQ 100000L
+#endif
+
+#ifndef TWI_BUFFER_LENGTH
+  #define TWI_BUFFER_LENGTH 32
+#endif
+
+#define TWI_READY 0
+#define TWI_MRX   1
+#define TWI_MTX   2
+#define TWI_SRX   3
+#define TWI_STX   4
+
+// TWI status codes of the slave modes, from `<util/twi.h>`
+#define TW_STATUS_MASK 0xF8
+#define TW_ST_SLA_ACK 0xA8
+#define TW_ST_ARB_LOST_SLA_ACK 0xB0
+#define TW_ST_DATA_ACK 0xB8
+#define TW_ST_DATA_NACK 0xC0
+#define TW_ST_LAST_DATA 0xC8
+#define TW_SR_SLA_ACK 0x60
+#define TW_SR_ARB_LOST_SLA_ACK 0x68
+#define TW_SR_GCALL_ACK 0x70
+#define TW_SR_ARB_LOST_GCALL_ACK 0x78
+#define TW_SR_DATA_ACK 0x80
+#define TW_SR_DATA_NACK 0x88
+#define TW_SR_GCALL_DATA_ACK 0x90
+#define TW_SR_GCALL_DATA_NACK 0x98
+#define TW_SR_STOP 0xA0
+#define TW_NO_INFO 0xF8
+#define TW_BUS_ERROR 0x00
+
+void twi_init(void);
+void twi_disable(void);
+void twi_setAddress(uint8_t);
+uint8_t twi_transmit(const uint8_t*, uint8_t);
+void twi_attachSlaveRxEvent( void (*)(uint8_t*, int) );
+void twi_attachSlaveTxEvent( void (*)(void) );
+void twi_reply(uint8_t);
+void twi_releaseBus(void);
+
+#endif
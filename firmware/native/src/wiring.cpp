@@ -0,0 +1,213 @@
+// Stand-in for `wiring.c` and `wiring_digital.c` of the Arduino AVR core:
+// Time keeping with Timer0, digital I/O, and `Serial`.
+
+#include <Arduino.h>
+#include <stdio.h>
+
+#include "simulator.h"
+
+// --- Time -------------------------------------------------------------------
+// The same as in the real core: Timer0 overflows every 64 * 256 CPU cycles.
+#define MICROSECONDS_PER_TIMER0_OVERFLOW (clockCyclesToMicroseconds(64 * 256))
+#define MILLIS_INC (MICROSECONDS_PER_TIMER0_OVERFLOW / 1000)
+#define FRACT_INC ((MICROSECONDS_PER_TIMER0_OVERFLOW % 1000) >> 3)
+#define FRACT_MAX (1000 >> 3)
+
+volatile unsigned long timer0_overflow_count = 0;
+volatile unsigned long timer0_millis = 0;
+static unsigned char timer0_fract = 0;
+
+ISR(TIMER0_OVF_vect) {
+  unsigned long m = timer0_millis;
+  unsigned char f = timer0_fract;
+
+  m += MILLIS_INC;
+  f += FRACT_INC;
+  if (f >= FRACT_MAX) {
+    f -= FRACT_MAX;
+    m += 1;
+  }
+  timer0_fract = f;
+  timer0_millis = m;
+  timer0_overflow_count++;
+}
+
+unsigned long millis() {
+  uint8_t oldSREG = SREG;
+  cli();
+  unsigned long m = timer0_millis;
+  SREG = oldSREG;
+  return m;
+}
+
+unsigned long micros() {
+  uint8_t oldSREG = SREG;
+  cli();
+  unsigned long m = timer0_overflow_count;
+  uint8_t t = TCNT0;
+  if ((TIFR0 & _BV(TOV0)) && (t < 255)) {
+    m++;
+  }
+  SREG = oldSREG;
+  return ((m << 8) + t) * (64 / clockCyclesPerMicrosecond());
+}
+
+void delay(unsigned long ms) {
+  sim_consume((uint64_t)ms * microsecondsToClockCycles(1000));
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim_consume((uint64_t)us * clockCyclesPerMicrosecond());
+}
+
+// Configure the timers like the real core.
+void init() {
+  sei();
+  // Timer0: fast PWM, clock / 64, overflow interrupt for `millis()`
+  TCCR0A |= _BV(WGM01) | _BV(WGM00);
+  TCCR0B |= _BV(CS01) | _BV(CS00);
+  TIMSK0 |= _BV(TOIE0);
+  // Timer1: phase correct PWM 8 bit, clock / 64
+  TCCR1B = _BV(CS11) | _BV(CS10);
+  TCCR1A |= _BV(WGM10);
+  // Timer2: phase correct PWM, clock / 64
+  TCCR2B |= _BV(CS22);
+  TCCR2A |= _BV(WGM20);
+}
+
+
+// --- Digital I/O ------------------------------------------------------------
+uint8_t digitalPinToPort(uint8_t pin) {
+  if (pin < 8) { return PD; }
+  if (pin < 14) { return PB; }
+  if (pin < NUM_DIGITAL_PINS) { return PC; }
+  return NOT_A_PIN;
+}
+
+uint8_t digitalPinToBitMask(uint8_t pin) {
+  if (pin < 8) { return _BV(pin); }
+  if (pin < 14) { return _BV(pin - 8); }
+  if (pin < NUM_DIGITAL_PINS) { return _BV(pin - 14); }
+  return 0;
+}
+
+volatile uint8_t * portInputRegister(uint8_t port) {
+  switch (port) {
+    case PB: return &PINB;
+    case PC: return &PINC;
+    case PD: return &PIND;
+    default: return NULL;
+  }
+}
+
+volatile uint8_t * portOutputRegister(uint8_t port) {
+  switch (port) {
+    case PB: return &PORTB;
+    case PC: return &PORTC;
+    case PD: return &PORTD;
+    default: return NULL;
+  }
+}
+
+volatile uint8_t * portModeRegister(uint8_t port) {
+  switch (port) {
+    case PB: return &DDRB;
+    case PC: return &DDRC;
+    case PD: return &DDRD;
+    default: return NULL;
+  }
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  uint8_t const port = digitalPinToPort(pin);
+  if (port == NOT_A_PIN) { return; }
+  uint8_t const bit = digitalPinToBitMask(pin);
+  volatile uint8_t * const reg = portModeRegister(port);
+  volatile uint8_t * const out = portOutputRegister(port);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  if (mode == INPUT) {
+    *reg &= ~bit;
+    *out &= ~bit;
+  }
+  else if (mode == INPUT_PULLUP) {
+    *reg &= ~bit;
+    *out |= bit;
+  }
+  else {
+    *reg |= bit;
+  }
+  sim_update_pins();
+  SREG = oldSREG;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  uint8_t const port = digitalPinToPort(pin);
+  if (port == NOT_A_PIN) { return; }
+  uint8_t const bit = digitalPinToBitMask(pin);
+  volatile uint8_t * const out = portOutputRegister(port);
+
+  uint8_t oldSREG = SREG;
+  cli();
+  if (val == LOW) {
+    *out &= ~bit;
+  }
+  else {
+    *out |= bit;
+  }
+  sim_update_pins();
+  SREG = oldSREG;
+}
+
+int digitalRead(uint8_t pin) {
+  uint8_t const port = digitalPinToPort(pin);
+  if (port == NOT_A_PIN) { return LOW; }
+  if (*portInputRegister(port) & digitalPinToBitMask(pin)) { return HIGH; }
+  return LOW;
+}
+
+
+// --- Serial -----------------------------------------------------------------
+HardwareSerial Serial;
+
+void HardwareSerial::flush() {
+  fflush(stdout);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  putchar(c);
+  return 1;
+}
+
+size_t HardwareSerial::print(const char * str) {
+  return printf("%s", str);
+}
+
+size_t HardwareSerial::print(char c) {
+  return write(c);
+}
+
+size_t HardwareSerial::print(long n, int base) {
+  if (n < 0 && base == DEC) {
+    return write('-') + print((unsigned long)-n, base);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t HardwareSerial::print(unsigned long n, int base) {
+  char buf[8 * sizeof(long) + 1];
+  char * str = &buf[sizeof(buf) - 1];
+  *str = '\0';
+  if (base < 2) { base = 10; }
+  do {
+    char const c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return print(str);
+}
+
+size_t HardwareSerial::print(double n, int digits) {
+  return printf("%.*f", digits, n);
+}
@@ -0,0 +1,42 @@
+// Conversion between host values and the network order (big endian) of the
+// odometer's registers. The functions work on any alignment.
+
+#ifndef ODOMETER_BYTE_ORDER_H
+#define ODOMETER_BYTE_ORDER_H
+
+#include <stdint.h>
+
+namespace odometer {
+
+inline uint32_t get_uint32(uint8_t const * data) {
+  return (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16
+       | (uint32_t)data[2] << 8 | (uint32_t)data[3];
+}
+
+inline int32_t get_int32(uint8_t const * data) {
+  return (int32_t)get_uint32(data);
+}
+
+inline uint16_t get_uint16(uint8_t const * data) {
+  return (uint16_t)(data[0] << 8 | data[1]);
+}
+
+inline int16_t get_int16(uint8_t const * data) {
+  return (int16_t)get_uint16(data);
+}
+
+inline void put_uint32(uint32_t value, uint8_t * data) {
+  data[0] = value >> 24;
+  data[1] = value >> 16;
+  data[2] = value >> 8;
+  data[3] = value;
+}
+
+inline void put_uint16(uint16_t value, uint8_t * data) {
+  data[0] = value >> 8;
+  data[1] = value;
+}
+
+}  // namespace odometer
+
+#endif
@@ -0,0 +1,111 @@
+// An odometer (simple pulse firmware) in the same process, as `Transport`.
+//
+// Tests and programs without hardware use it instead of `I2cDevTransport`.
+// It implements the register map of `firmware/arduino-nano-simp-pulse`:
+// register selection, burst reads of the map, reset, the sample FIFO, the
+// delta counters, the shadow registers of the latch, also written to the
+// general call address, the diagnostics, the settings of the glitch filter
+// and of the counted edges, the configuration and the timing histograms.
+// The state of the simulated firmware is public, tests set it directly.
+// Errors of the bus can be injected with `fail_error`.
+
+#ifndef ODOMETER_FAKE_DEVICE_H
+#define ODOMETER_FAKE_DEVICE_H
+
+#include "odometer/odometer.h"
+#include "odometer/registers.h"
+#include "odometer/transport.h"
+
+namespace odometer {
+
+class FakeDevice : public Transport {
+public:
+  explicit FakeDevice(uint8_t address = ADDRESS_BASE) : address(address) {}
+
+  uint8_t get_address() const { return address; }
+
+  // --- State of the simulated firmware ---
+  char whoami[WHOAMI_LENGTH] = "odsp01";
+  uint8_t status_flags = STATUS_RECORD_EDGE_TIMES | STATUS_RECORD_DIAGNOSTICS
+                       | STATUS_FILTER_GLITCHES | STATUS_RECORD_TIMING;
+  uint32_t time_us = 0;
+  int32_t counters[N_COUNTERS] = {};
+  EdgeTime edge_times[N_COUNTERS] = {};
+  Periods periods = {};
+  Diagnostics diagnostics = {};
+  // Minimum stable time of the glitch filter, written by the master.
+  uint8_t filter_time_us = 0;
+  // Counted edges per pulse, written by the master: 1 or 2.
+  uint8_t count_mode = 2;
+  // Timing histograms, see `REG_TIMING`. The fake does not measure.
+  uint32_t timing[TIMING_HISTOGRAMS][TIMING_BUCKETS] = {};
+  // The configuration block in the EEPROM, erased. Valid blocks that the
+  // master writes are stored at once.
+  uint8_t config_block[CONFIG_LENGTH] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+                                         0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+  // Store the counters in the FIFO, like the sample interrupt.
+  void take_sample();
+
+  // --- Bus ---
+  // All transactions, also failed ones.
+  unsigned long n_transfers = 0;
+  // When not 0, transactions fail with `-fail_error`, e.g. `EIO`.
+  int fail_error = 0;
+
+  // Transactions for other addresses fail with `-ENXIO`, like a
+  // transaction that is not acknowledged. Writes to the general call
+  // address are accepted.
+  int transfer(uint8_t address,
+               uint8_t const * write_data, size_t write_length,
+               uint8_t * read_data, size_t read_length) override;
+
+private:
+  static size_t const FIFO_LENGTH = 32;
+
+  void write(uint8_t const * data, size_t length);
+  void read(uint8_t * data, size_t length);
+  void fill_registers(uint8_t * regs);
+  size_t read_fifo(uint8_t * data);
+  size_t read_deltas(uint8_t * data);
+  size_t read_diagnostics(uint8_t * data);
+  static bool is_config_valid(uint8_t const * block);
+
+  uint8_t const address;
+  uint8_t reg_address = 0;
+  uint8_t sample_period_ms = 0;
+  uint8_t fifo[FIFO_LENGTH][SAMPLE_LENGTH] = {};
+  size_t fifo_tail = 0;
+  size_t fifo_count = 0;
+  uint8_t fifo_lost = 0;
+  size_t fifo_read_limit = FIFO_BURST_SAMPLES;
+  int32_t delta_base[N_COUNTERS] = {};
+  uint8_t delta_max_width = 2;
+  uint8_t latch_registers[LATCH_LENGTH] = {};
+  uint8_t timing_selected = TIMING_LOOP;
+};
+
+
+// Several fake odometers on one bus, as `Transport`.
+class FakeBus : public Transport {
+public:
+  static size_t const MAX_DEVICES = N_ADDRESSES;
+
+  // Add `device`, it must stay valid while the bus is used.
+  // Returns 0, or `-ENOSPC`.
+  int add(FakeDevice & device);
+
+  // Transactions for addresses without a device fail with `-ENXIO`. Writes
+  // to the general call address go to all devices.
+  int transfer(uint8_t address,
+               uint8_t const * write_data, size_t write_length,
+               uint8_t * read_data, size_t read_length) override;
+
+private:
+  FakeDevice * devices[MAX_DEVICES] = {};
+  size_t n_devices = 0;
+};
+
+}  // namespace odometer
+
+#endif
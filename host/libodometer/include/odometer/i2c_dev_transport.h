@@ -0,0 +1,36 @@
+// Transport over the Linux I2C character device (`/dev/i2c-*`).
+//
+// Each transaction is one `I2C_RDWR` ioctl: The register address and the
+// read are combined with a repeated start, with one system call and
+// without the block size limit of SMBus (32 bytes).
+
+#ifndef ODOMETER_I2C_DEV_TRANSPORT_H
+#define ODOMETER_I2C_DEV_TRANSPORT_H
+
+#include "odometer/transport.h"
+
+namespace odometer {
+
+class I2cDevTransport : public Transport {
+public:
+  I2cDevTransport() = default;
+  ~I2cDevTransport() override;
+  I2cDevTransport(I2cDevTransport const &) = delete;
+  I2cDevTransport & operator=(I2cDevTransport const &) = delete;
+
+  // Open the bus, e.g. "/dev/i2c-1". Returns 0, or a negative `errno` value.
+  int open(char const * path);
+  void close();
+  bool is_open() const { return fd >= 0; }
+
+  int transfer(uint8_t address,
+               uint8_t const * write_data, size_t write_length,
+               uint8_t * read_data, size_t read_length) override;
+
+private:
+  int fd = -1;
+};
+
+}  // namespace odometer
+
+#endif
@@ -0,0 +1,203 @@
+// ============================================================================
+//          Host Driver for the Odometer
+// ============================================================================
+
+// Reads the registers of one odometer board over a `Transport`.
+//
+// Each read is a single I2C transaction (register address, repeated start,
+// read), and the values are decoded from network order directly into the
+// caller's structures. The driver allocates no memory, and does not use
+// exceptions: All functions return 0, or a negative `errno` value.
+//
+//     odometer::I2cDevTransport bus;
+//     bus.open("/dev/i2c-1");
+//     odometer::Odometer odometer(bus, 0x28);
+//     int32_t counters[odometer::N_COUNTERS];
+//     int error = odometer.read_counters(counters, odometer::N_COUNTERS);
+
+#ifndef ODOMETER_ODOMETER_H
+#define ODOMETER_ODOMETER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "odometer/registers.h"
+#include "odometer/transport.h"
+
+namespace odometer {
+
+// --- Register Values --------------------------------------------------------
+struct Status {
+  // The counting methods, `STATUS_*` flags.
+  uint8_t flags;
+  // Samples in the FIFO, and samples lost because it was full.
+  uint8_t fifo_count;
+  uint8_t fifo_lost;
+  // Period of the samples in milliseconds, 0 for off.
+  uint8_t sample_period_ms;
+};
+
+// The edge times of one counter, in microseconds.
+struct EdgeTime {
+  // Time since the last edge.
+  uint32_t age_us;
+  // Period between the last two edges, 0 before the second edge.
+  uint32_t period_us;
+};
+
+// The periods measured on ICP1.
+struct Periods {
+  // Number of rising edges.
+  uint32_t n_edges;
+  // Periods between the last edges in CPU cycles (62.5 ns), the newest
+  // first, 0 is invalid.
+  uint32_t periods[N_PERIODS];
+};
+
+// All values that `read_burst` reads in one transaction.
+struct Burst {
+  Status status;
+  uint32_t time_us;
+  int32_t counters[N_COUNTERS];
+  EdgeTime edge_times[N_COUNTERS];
+};
+
+// The shadow registers: Time and counters at the last latch.
+struct Latched {
+  uint32_t time_us;
+  int32_t counters[N_COUNTERS];
+};
+
+// The diagnostics: Situations in which counts can be lost. The counters
+// wrap around at 16 bits, use their differences.
+struct Diagnostics {
+  // Iterations of the main loop that took too long, or (simple pulse
+  // firmware with `STATUS_COUNT_IN_INTERRUPT`) interrupts that found no
+  // changed input.
+  uint16_t overruns;
+  // Longest iteration of the main loop since the previous read, in
+  // microseconds.
+  uint16_t max_loop_us;
+  // For each counter: Edges in consecutive polls (simple pulse firmware),
+  // or double transitions of the encoder (quadrature encoder firmware).
+  uint16_t missed[N_COUNTERS];
+};
+
+// One sample of the FIFO: The lower 16 bits of the counters.
+struct Sample {
+  uint16_t counters[N_COUNTERS];
+};
+
+// The configuration in the EEPROM, which the firmware uses at its start.
+// Closed jumpers on the board override the address, and swap inputs or
+// invert encoders.
+struct Config {
+  // I2C address, 0 for `ADDRESS_BASE` and the jumpers.
+  uint8_t address;
+  // The position of each input in the counters (simple pulse firmware), or
+  // of the 2 encoders (quadrature encoder firmware, the rest is 0).
+  uint8_t channel_map[N_COUNTERS];
+  // Inverted encoders, bit 0 encoder 1 (quadrature encoder firmware).
+  uint8_t inverted;
+  // Counted edges, see `write_count_mode`, 0 for the default.
+  uint8_t count_mode;
+  // Minimum stable time of the glitch filter in microseconds (simple pulse
+  // firmware).
+  uint8_t filter_time_us;
+};
+
+// CRC-16 of a configuration block without its CRC, as the firmware
+// computes it (`_crc16_update` of avr-libc, start value 0xFFFF).
+uint16_t config_crc(uint8_t const * block);
+
+
+// --- Driver -----------------------------------------------------------------
+class Odometer {
+public:
+  Odometer(Transport & transport, uint8_t address = ADDRESS_BASE)
+    : transport(transport), address(address) {}
+
+  uint8_t get_address() const { return address; }
+
+  // "odsp01" or "odqe01", null terminated.
+  int read_whoami(char (&whoami)[WHOAMI_LENGTH]);
+  int read_status(Status & status);
+  int read_time(uint32_t & time_us);
+  // Read the first `n_counters` counters: `N_COUNTERS` for the simple pulse
+  // firmware, `N_QUAD_ENC_COUNTERS` for the quadrature encoder firmware.
+  int read_counters(int32_t * counters, size_t n_counters);
+  int read_edge_times(EdgeTime (&edge_times)[N_COUNTERS]);
+  int read_periods(Periods & periods);
+  // Status, time, counters and edge times in one transaction.
+  int read_burst(Burst & burst);
+  // Set all counters to `value`.
+  int reset_counters(int32_t value);
+
+  // Start sampling into the FIFO, 0 stops it. Clears the FIFO.
+  int write_sample_period(uint8_t period_ms);
+  // Read at most `max_samples` samples from the FIFO, they are removed
+  // from the FIFO. `n_samples` is set to the number of samples read.
+  int read_fifo(Sample * samples, size_t max_samples, size_t & n_samples);
+
+  // Set the maximum width of the deltas: 1, 2, 4 bytes.
+  int write_delta_width(uint8_t width);
+  // Read and clear the changes of the counters since the previous call.
+  // Decoded with the width that the board sends, the width may have been
+  // set by another host or reset by a restart of the board.
+  int read_deltas(int32_t (&deltas)[N_COUNTERS]);
+
+  // Copy the time and the counters of this board into its shadow registers.
+  int latch();
+  // Latch all boards on the bus at the same moment, with a write to the
+  // general call address.
+  static int latch_all(Transport & transport);
+  // Read the shadow registers, with the first `n_counters` counters (see
+  // `read_counters`).
+  int read_latched(Latched & latched, size_t n_counters);
+
+  // Set the minimum stable time of the glitch filter in microseconds, 0
+  // switches it off.
+  int write_filter_time(uint8_t time_us);
+  int read_filter_time(uint8_t & time_us);
+
+  // Set the counted edges per cycle: 1 or 2 (rising or both edges) for the
+  // simple pulse firmware, 1, 2 or 4 for the quadrature encoder firmware.
+  // The firmware ignores other values, read them back to check. The 
+  // quadrature encoder firmware without `USE_STATIC_ENCODERS` can't switch,
+  // it ignores the writes and reads 0.
+  int write_count_mode(uint8_t edges);
+  int read_count_mode(uint8_t & edges);
+
+  // Store `config` in the EEPROM of the board, it is used at the next start.
+  // The firmware ignores invalid values, read it back to check. Writing
+  // into the EEPROM takes about 40 ms, `unwritten` of `read_config` counts
+  // the bytes that are not yet written.
+  int write_config(Config const & config);
+  // Read the stored configuration. Returns `-ENODATA`, when the EEPROM
+  // contains no valid configuration.
+  int read_config(Config & config, uint8_t & unwritten);
+
+  // Read the timing histogram `histogram` (`TIMING_LOOP`, ...), with its
+  // bucket counts, see `TIMING_BUCKETS`. The counts wrap around. Only the
+  // simple pulse firmware, with `STATUS_RECORD_TIMING`.
+  int read_timing(uint8_t histogram, uint32_t (&counts)[TIMING_BUCKETS]);
+  // Clear all timing histograms.
+  int clear_timing();
+
+  // Read the diagnostics, with the first `n_counters` counters (see
+  // `read_counters`). Restarts the longest loop.
+  int read_diagnostics(Diagnostics & diagnostics, size_t n_counters);
+
+private:
+  int read_register(uint8_t reg, uint8_t * data, size_t length);
+  int write_register(uint8_t reg, uint8_t const * data, size_t length);
+
+  Transport & transport;
+  uint8_t const address;
+  // Buffer for the raw bytes of one transaction.
+  uint8_t buffer[MAX_READ_LENGTH];
+};
+
+}  // namespace odometer
+
+#endif
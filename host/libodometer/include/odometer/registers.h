@@ -0,0 +1,110 @@
+// ============================================================================
+//          Register Map of the Odometer Firmwares
+// ============================================================================
+
+// The I2C registers of `firmware/arduino-nano-simp-pulse` (all registers)
+// and `firmware/arduino-nano-quad-enc` (`REG_WHOAMI`, `REG_RESET`,
+// `REG_COUNT`, `REG_LATCH`, `REG_DIAGNOSTICS`, `REG_COUNT_MODE`,
+// `REG_CONFIG`). See the firmware for the meaning of the registers. All
+// values are in network order (big endian), see `byte_order.h`.
+
+#ifndef ODOMETER_REGISTERS_H
+#define ODOMETER_REGISTERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace odometer {
+
+// --- I2C Addresses ----------------------------------------------------------
+// The lowest two address bits are set with jumpers, or the address is
+// configured, see `REG_CONFIG`.
+uint8_t const ADDRESS_BASE = 0x28;
+uint8_t const N_ADDRESSES = 4;
+// Writes to the general call address reach all boards, see `REG_LATCH`.
+uint8_t const GENERAL_CALL_ADDRESS = 0x00;
+
+// --- Registers --------------------------------------------------------------
+uint8_t const REG_WHOAMI = 0x01;
+uint8_t const REG_STATUS = 0x08;
+uint8_t const REG_SAMPLE_PERIOD = 0x0B;
+uint8_t const REG_TIME = 0x0C;
+uint8_t const REG_RESET = 0x0C;
+uint8_t const REG_COUNT = 0x10;
+uint8_t const REG_EDGE_TIMES = 0x20;
+uint8_t const REG_PERIODS = 0x40;
+uint8_t const REG_MAP_LENGTH = 0x60;
+uint8_t const REG_FIFO_DATA = 0x60;
+uint8_t const REG_DELTA = 0x61;
+uint8_t const REG_LATCH = 0x62;
+uint8_t const REG_DIAGNOSTICS = 0x63;
+uint8_t const REG_FILTER = 0x64;
+uint8_t const REG_COUNT_MODE = 0x65;
+uint8_t const REG_CONFIG = 0x66;
+uint8_t const REG_TIMING = 0x67;
+
+// --- Lengths ----------------------------------------------------------------
+// "odsp01" (simple pulse) or "odqe01" (quadrature encoder), and a null byte.
+size_t const WHOAMI_LENGTH = 7;
+size_t const STATUS_LENGTH = 4;
+size_t const TIME_LENGTH = 4;
+// Counters of the simple pulse firmware, the quadrature encoder firmware
+// has 2.
+size_t const N_COUNTERS = 4;
+size_t const N_QUAD_ENC_COUNTERS = 2;
+size_t const COUNT_LENGTH = N_COUNTERS * 4;
+size_t const EDGE_TIMES_LENGTH = N_COUNTERS * 2 * 4;
+size_t const N_PERIODS = 7;
+size_t const PERIODS_LENGTH = (1 + N_PERIODS) * 4;
+// Status, time, counters and edge times, read in one transaction.
+size_t const BURST_LENGTH = REG_EDGE_TIMES + EDGE_TIMES_LENGTH - REG_STATUS;
+// Samples in the FIFO, 4 uint16_t each.
+size_t const SAMPLE_LENGTH = N_COUNTERS * 2;
+// Samples that the firmware sends at most in one read (64 bytes buffer).
+size_t const FIFO_BURST_SAMPLES = 7;
+// Longest read of `REG_DELTA`: The width of the deltas (1 byte) and the
+// deltas with 4 bytes each. Narrower deltas are followed by padding.
+size_t const DELTA_LENGTH = 1 + N_COUNTERS * 4;
+// Time and counters in the shadow registers of `REG_LATCH`.
+size_t const LATCH_LENGTH = TIME_LENGTH + COUNT_LENGTH;
+// Overruns, longest loop and the missed edges of each counter, uint16_t.
+size_t const DIAGNOSTICS_LENGTH = (2 + N_COUNTERS) * 2;
+// The configuration block of `REG_CONFIG`: version, address, channel map,
+// inverted channels, count mode, filter time, CRC-16. A read returns 1 more
+// byte, the bytes that are not yet written into the EEPROM.
+size_t const CONFIG_LENGTH = 11;
+uint8_t const CONFIG_VERSION = 1;
+// Histograms of `REG_TIMING`: Bucket i counts the times from 2^(i + 4) to
+// 2^(i + 5) - 1 CPU cycles, bucket 0 also the shorter, the last bucket also
+// the longer times. A read returns the histogram (1 byte) and the counts,
+// uint32_t.
+size_t const TIMING_BUCKETS = 15;
+uint8_t const TIMING_MIN_LOG2 = 4;
+size_t const TIMING_LENGTH = 1 + TIMING_BUCKETS * 4;
+// Largest read of the firmware (its TWI buffer).
+size_t const MAX_READ_LENGTH = 64;
+
+// --- Status Flags -----------------------------------------------------------
+// First byte of `REG_STATUS`, the counting methods of the firmware.
+uint8_t const STATUS_COUNT_IN_INTERRUPT = 0x01;
+uint8_t const STATUS_COUNT_T1_IN_HARDWARE = 0x02;
+uint8_t const STATUS_COUNT_T0_IN_HARDWARE = 0x04;
+uint8_t const STATUS_RECORD_EDGE_TIMES = 0x08;
+uint8_t const STATUS_MEASURE_PERIODS_ON_ICP1 = 0x10;
+uint8_t const STATUS_RECORD_DIAGNOSTICS = 0x20;
+uint8_t const STATUS_FILTER_GLITCHES = 0x40;
+uint8_t const STATUS_RECORD_TIMING = 0x80;
+
+// --- Timing Histograms ------------------------------------------------------
+// The histograms of `REG_TIMING`: loop periods, durations of the receive
+// and of the request callback.
+uint8_t const TIMING_LOOP = 0;
+uint8_t const TIMING_RECEIVE = 1;
+uint8_t const TIMING_REQUEST = 2;
+size_t const TIMING_HISTOGRAMS = 3;
+// Added to the histogram that is written, clears all histograms.
+uint8_t const TIMING_CLEAR = 0x80;
+
+}  // namespace odometer
+
+#endif
@@ -0,0 +1,218 @@
+// ============================================================================
+//          Ring Buffers of Samples in POSIX Shared Memory
+// ============================================================================
+
+// `odometerd` polls the odometers and publishes their counters in shared
+// memory, other processes read them without I2C traffic and without system
+// calls.
+//
+// The shared memory contains one ring buffer for each I2C bus. Each ring has
+// a single producer (the polling thread of its bus) and any number of
+// consumers, it is lock free:
+// * Each slot has a sequence number, odd while the producer writes the
+//   slot (a seqlock). A consumer copies the sample, and checks that the
+//   sequence number has not changed meanwhile.
+// * The producer never waits for consumers. A consumer that is too slow
+//   loses the oldest samples, and is told how many.
+//
+//     odometer::SharedRings rings;
+//     rings.open("/odometer");
+//     odometer::RingReader reader(rings.get(0));
+//     odometer::RingSample sample;
+//     while (reader.read(sample) == odometer::RingReader::OK) { ... }
+
+#ifndef ODOMETER_SAMPLE_RING_H
+#define ODOMETER_SAMPLE_RING_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "odometer/registers.h"
+
+namespace odometer {
+
+// --- Layout -----------------------------------------------------------------
+// Changes of the layout must change `RING_VERSION`.
+uint32_t const RING_MAGIC = 0x4F444F4D;  // "ODOM"
+uint32_t const RING_VERSION = 1;
+size_t const MAX_RINGS = 8;
+// Samples per ring, a power of 2.
+size_t const RING_CAPACITY = 1024;
+char const * const DEFAULT_SHM_NAME = "/odometer";
+
+// One poll of one odometer.
+struct RingSample {
+  // CLOCK_MONOTONIC, in the middle of the I2C transaction.
+  uint64_t time_ns;
+  uint8_t address;
+  uint8_t n_counters;
+  // 0, or the (positive) `errno` value of a failed read. The counters of
+  // failed reads are 0.
+  uint16_t error;
+  uint32_t reserved;
+  int32_t counters[N_COUNTERS];
+};
+
+size_t const SAMPLE_WORDS = sizeof(RingSample) / sizeof(uint64_t);
+static_assert(sizeof(RingSample) == SAMPLE_WORDS * sizeof(uint64_t),
+              "RingSample must be a whole number of words");
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "The rings need lock free 64 bit atomics");
+
+// The sample is stored as atomic words: Reads that race with the producer
+// are then defined, the sequence number rejects them.
+struct RingSlot {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint64_t> words[SAMPLE_WORDS];
+};
+
+struct alignas(64) Ring {
+  // Number of samples that were published.
+  std::atomic<uint64_t> head;
+  // Statistics of the producer.
+  std::atomic<uint64_t> n_errors;
+  std::atomic<uint64_t> n_missed_deadlines;
+  // Bus of this ring, e.g. "/dev/i2c-1", null terminated.
+  char bus_name[40];
+  RingSlot slots[RING_CAPACITY];
+};
+
+struct SharedRegion {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t n_rings;
+  uint32_t ring_capacity;
+  // Poll period of the daemon.
+  uint32_t period_us;
+  Ring rings[MAX_RINGS];
+};
+
+
+// --- Producer ---------------------------------------------------------------
+// Used by exactly one thread per ring.
+class RingWriter {
+public:
+  explicit RingWriter(Ring & ring) : ring(ring) {}
+
+  void write(RingSample const & sample) {
+    uint64_t const index = ring.head.load(std::memory_order_relaxed);
+    RingSlot & slot = ring.slots[index & (RING_CAPACITY - 1)];
+    uint64_t words[SAMPLE_WORDS];
+    memcpy(words, &sample, sizeof(words));
+
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < SAMPLE_WORDS; ++i) {
+      slot.words[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot.sequence.store(2 * index + 2, std::memory_order_release);
+    ring.head.store(index + 1, std::memory_order_release);
+  }
+
+private:
+  Ring & ring;
+};
+
+
+// --- Consumer ---------------------------------------------------------------
+// Each consumer has its own reader, and starts with the newest sample (with
+// the next one, when the ring is empty).
+class RingReader {
+public:
+  enum Result {
+    // A sample was read.
+    OK,
+    // No new sample.
+    EMPTY,
+    // The producer has overwritten samples that were not read. The reader
+    // skipped them, `get_lost` counts them.
+    LOST,
+  };
+
+  explicit RingReader(Ring const & ring) : ring(ring), next(newest(ring)) {}
+
+  Result read(RingSample & sample) {
+    for (;;) {
+      uint64_t const head = ring.head.load(std::memory_order_acquire);
+      if (next >= head) { return EMPTY; }
+      if (head - next > RING_CAPACITY) {
+        skip_to(head - RING_CAPACITY);
+        return LOST;
+      }
+
+      RingSlot const & slot = ring.slots[next & (RING_CAPACITY - 1)];
+      uint64_t const expected = 2 * next + 2;
+      uint64_t const before = slot.sequence.load(std::memory_order_acquire);
+      if (before != expected) {
+        // Overwritten meanwhile, try again with the new head.
+        if (before > expected) { continue; }
+        return EMPTY;
+      }
+      uint64_t words[SAMPLE_WORDS];
+      for (size_t i = 0; i < SAMPLE_WORDS; ++i) {
+        words[i] = slot.words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.sequence.load(std::memory_order_relaxed) != before) {
+        continue;
+      }
+      memcpy(&sample, words, sizeof(sample));
+      ++next;
+      return OK;
+    }
+  }
+
+  uint64_t get_lost() const { return lost; }
+
+private:
+  static uint64_t newest(Ring const & ring) {
+    uint64_t const head = ring.head.load(std::memory_order_acquire);
+    return head > 0 ? head - 1 : 0;
+  }
+
+  void skip_to(uint64_t index) {
+    lost += index - next;
+    next = index;
+  }
+
+  Ring const & ring;
+  uint64_t next;
+  uint64_t lost = 0;
+};
+
+
+// --- Shared Memory ----------------------------------------------------------
+// The mapping of the shared memory, unmapped by the destructor.
+class SharedRings {
+public:
+  SharedRings() = default;
+  ~SharedRings();
+  SharedRings(SharedRings const &) = delete;
+  SharedRings & operator=(SharedRings const &) = delete;
+
+  // Create (or replace) the shared memory `name` with `n_rings` empty
+  // rings, for the producer. A replaced region stays mapped by its
+  // consumers, but no longer changes. Returns 0, or a negative `errno`
+  // value.
+  int create(char const * name, uint32_t n_rings, uint32_t period_us);
+  // Open the existing shared memory `name` read only, for consumers.
+  // Returns 0, or a negative `errno` value, `-EPROTO` for a wrong layout.
+  int open(char const * name);
+  void close();
+  // Remove the name of the shared memory, existing mappings stay valid.
+  static int unlink(char const * name);
+
+  uint32_t get_n_rings() const { return region ? region->n_rings : 0; }
+  uint32_t get_period_us() const { return region ? region->period_us : 0; }
+  Ring & get(uint32_t index) { return region->rings[index]; }
+  Ring const & get(uint32_t index) const { return region->rings[index]; }
+
+private:
+  SharedRegion * region = nullptr;
+};
+
+}  // namespace odometer
+
+#endif
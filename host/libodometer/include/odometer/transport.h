@@ -0,0 +1,28 @@
+// The connection to the I2C bus, which `Odometer` uses. Implementations:
+// * `I2cDevTransport`: Linux `/dev/i2c-*`.
+// * `FakeDevice`: An odometer in the same process, for tests.
+
+#ifndef ODOMETER_TRANSPORT_H
+#define ODOMETER_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace odometer {
+
+class Transport {
+public:
+  virtual ~Transport() = default;
+
+  // One transaction with the device at `address`: Write `write_length`
+  // bytes, then, after a repeated start, read `read_length` bytes into
+  // `read_data`. Either length can be 0.
+  // Returns 0, or a negative `errno` value.
+  virtual int transfer(uint8_t address,
+                       uint8_t const * write_data, size_t write_length,
+                       uint8_t * read_data, size_t read_length) = 0;
+};
+
+}  // namespace odometer
+
+#endif
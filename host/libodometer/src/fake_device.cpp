@@ -0,0 +1,273 @@
+#include "odometer/fake_device.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "odometer/byte_order.h"
+
+namespace odometer {
+
+int FakeDevice::transfer(uint8_t address,
+                         uint8_t const * write_data, size_t write_length,
+                         uint8_t * read_data, size_t read_length) {
+  ++n_transfers;
+  if (fail_error) { return -fail_error; }
+  bool const general_call = address == GENERAL_CALL_ADDRESS
+                            && read_length == 0;
+  if (address != this->address && !general_call) { return -ENXIO; }
+  if (write_length > 0) { write(write_data, write_length); }
+  if (read_length > 0) { read(read_data, read_length); }
+  return 0;
+}
+
+void FakeDevice::take_sample() {
+  if (fifo_count == FIFO_LENGTH) {
+    if (fifo_lost < 0xFF) { ++fifo_lost; }
+    return;
+  }
+  uint8_t * const sample = fifo[(fifo_tail + fifo_count) % FIFO_LENGTH];
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    put_uint16(counters[i], &sample[2 * i]);
+  }
+  ++fifo_count;
+}
+
+// The first byte selects the register, the following bytes are written
+// into it. As in the firmware, values with a wrong length are ignored.
+void FakeDevice::write(uint8_t const * data, size_t length) {
+  reg_address = data[0];
+  fifo_read_limit = FIFO_BURST_SAMPLES;
+  uint8_t const * const value = &data[1];
+  size_t const value_length = length - 1;
+  if (value_length == 0) { return; }
+
+  switch (reg_address) {
+    case REG_RESET:
+      if (value_length == 4) {
+        int32_t const new_counter = get_int32(value);
+        for (size_t i = 0; i < N_COUNTERS; ++i) {
+          counters[i] = new_counter;
+          delta_base[i] = new_counter;
+        }
+      }
+      break;
+    case REG_SAMPLE_PERIOD:
+      if (value_length == 1) {
+        sample_period_ms = value[0];
+        fifo_tail = 0;
+        fifo_count = 0;
+        fifo_lost = 0;
+      }
+      break;
+    case REG_DELTA:
+      if (value_length == 1
+          && (value[0] == 1 || value[0] == 2 || value[0] == 4)) {
+        delta_max_width = value[0];
+      }
+      break;
+    case REG_LATCH:
+      if (value_length == 1) {
+        put_uint32(time_us, &latch_registers[0]);
+        for (size_t i = 0; i < N_COUNTERS; ++i) {
+          put_uint32(counters[i], &latch_registers[TIME_LENGTH + 4 * i]);
+        }
+      }
+      break;
+    case REG_FILTER:
+      if (value_length == 1) {
+        filter_time_us = value[0];
+      }
+      break;
+    case REG_COUNT_MODE:
+      if (value_length == 1 && (value[0] == 1 || value[0] == 2)) {
+        count_mode = value[0];
+      }
+      break;
+    case REG_TIMING:
+      if (value_length == 1) {
+        if (value[0] & TIMING_CLEAR) { memset(timing, 0, sizeof(timing)); }
+        uint8_t const histogram = value[0] & ~TIMING_CLEAR;
+        if (histogram < TIMING_HISTOGRAMS) { timing_selected = histogram; }
+      }
+      break;
+    case REG_CONFIG:
+      if (value_length == CONFIG_LENGTH && is_config_valid(value)) {
+        memcpy(config_block, value, CONFIG_LENGTH);
+      }
+      break;
+    case REG_FIFO_DATA:
+      if (value_length == 1 && value[0] <= FIFO_BURST_SAMPLES) {
+        fifo_read_limit = value[0];
+      }
+      break;
+  }
+}
+
+// The bytes after the end of the response read as 0xFF, like an idle bus.
+void FakeDevice::read(uint8_t * data, size_t length) {
+  uint8_t response[MAX_READ_LENGTH];
+  size_t response_length;
+  if (reg_address == REG_FIFO_DATA) {
+    response_length = read_fifo(response);
+  }
+  else if (reg_address == REG_DELTA) {
+    response_length = read_deltas(response);
+  }
+  else if (reg_address == REG_LATCH) {
+    memcpy(response, latch_registers, LATCH_LENGTH);
+    response_length = LATCH_LENGTH;
+  }
+  else if (reg_address == REG_DIAGNOSTICS) {
+    response_length = read_diagnostics(response);
+  }
+  else if (reg_address == REG_FILTER) {
+    response[0] = filter_time_us;
+    response_length = 1;
+  }
+  else if (reg_address == REG_COUNT_MODE) {
+    response[0] = count_mode;
+    response_length = 1;
+  }
+  else if (reg_address == REG_TIMING) {
+    response[0] = timing_selected;
+    for (size_t i = 0; i < TIMING_BUCKETS; ++i) {
+      put_uint32(timing[timing_selected][i], &response[1 + 4 * i]);
+    }
+    response_length = TIMING_LENGTH;
+  }
+  else if (reg_address == REG_CONFIG) {
+    memcpy(response, config_block, CONFIG_LENGTH);
+    // Nothing is left to write.
+    response[CONFIG_LENGTH] = 0;
+    response_length = CONFIG_LENGTH + 1;
+  }
+  else {
+    uint8_t regs[REG_MAP_LENGTH];
+    fill_registers(regs);
+    response_length = REG_MAP_LENGTH - reg_address;
+    if (response_length > MAX_READ_LENGTH) {
+      response_length = MAX_READ_LENGTH;
+    }
+    memcpy(response, &regs[reg_address], response_length);
+  }
+  if (response_length > length) { response_length = length; }
+  memcpy(data, response, response_length);
+  memset(&data[response_length], 0xFF, length - response_length);
+}
+
+void FakeDevice::fill_registers(uint8_t * regs) {
+  memset(regs, 0, REG_MAP_LENGTH);
+  memcpy(&regs[REG_WHOAMI], whoami, WHOAMI_LENGTH);
+  regs[REG_STATUS] = status_flags;
+  regs[REG_STATUS + 1] = fifo_count;
+  regs[REG_STATUS + 2] = fifo_lost;
+  regs[REG_STATUS + 3] = sample_period_ms;
+  put_uint32(time_us, &regs[REG_TIME]);
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    put_uint32(counters[i], &regs[REG_COUNT + 4 * i]);
+    put_uint32(edge_times[i].age_us, &regs[REG_EDGE_TIMES + 8 * i]);
+    put_uint32(edge_times[i].period_us, &regs[REG_EDGE_TIMES + 8 * i + 4]);
+  }
+  put_uint32(periods.n_edges, &regs[REG_PERIODS]);
+  for (size_t i = 0; i < N_PERIODS; ++i) {
+    put_uint32(periods.periods[i], &regs[REG_PERIODS + 4 * (i + 1)]);
+  }
+}
+
+// The checks of the simple pulse firmware.
+bool FakeDevice::is_config_valid(uint8_t const * block) {
+  if (block[0] != CONFIG_VERSION) { return false; }
+  uint8_t const address = block[1];
+  if (address != 0 && (address < 0x08 || address > 0x77)) { return false; }
+  uint8_t positions = 0;
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    if (block[2 + i] >= N_COUNTERS) { return false; }
+    positions |= 1 << block[2 + i];
+  }
+  if (positions != 0x0F) { return false; }
+  if (block[7] > 2) { return false; }
+  return get_uint16(&block[CONFIG_LENGTH - 2]) == config_crc(block);
+}
+
+size_t FakeDevice::read_fifo(uint8_t * data) {
+  size_t const n_samples = fifo_count < fifo_read_limit
+                         ? fifo_count : fifo_read_limit;
+  data[0] = n_samples;
+  for (size_t i = 0; i < n_samples; ++i) {
+    memcpy(&data[1 + i * SAMPLE_LENGTH], fifo[fifo_tail], SAMPLE_LENGTH);
+    fifo_tail = (fifo_tail + 1) % FIFO_LENGTH;
+  }
+  fifo_count -= n_samples;
+  return 1 + n_samples * SAMPLE_LENGTH;
+}
+
+size_t FakeDevice::read_diagnostics(uint8_t * data) {
+  put_uint16(diagnostics.overruns, &data[0]);
+  put_uint16(diagnostics.max_loop_us, &data[2]);
+  diagnostics.max_loop_us = 0;
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    put_uint16(diagnostics.missed[i], &data[4 + 2 * i]);
+  }
+  return DIAGNOSTICS_LENGTH;
+}
+
+size_t FakeDevice::read_deltas(uint8_t * data) {
+  int32_t deltas[N_COUNTERS];
+  uint8_t width = 1;
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    deltas[i] = counters[i] - delta_base[i];
+    if (deltas[i] != (int16_t)deltas[i]) { width = 4; }
+    else if (deltas[i] != (int8_t)deltas[i] && width < 2) { width = 2; }
+  }
+  if (width > delta_max_width) { width = delta_max_width; }
+
+  data[0] = width;
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    int32_t delta = deltas[i];
+    if (width < 4) {
+      int32_t const max_delta = (1L << (8 * width - 1)) - 1;
+      if (delta > max_delta) { delta = max_delta; }
+      if (delta < -max_delta - 1) { delta = -max_delta - 1; }
+    }
+    delta_base[i] += delta;
+    uint8_t * const value = &data[1 + width * i];
+    switch (width) {
+      case 1: value[0] = delta; break;
+      case 2: put_uint16(delta, value); break;
+      default: put_uint32(delta, value); break;
+    }
+  }
+  return 1 + N_COUNTERS * width;
+}
+
+
+// --- Fake Bus ---------------------------------------------------------------
+int FakeBus::add(FakeDevice & device) {
+  if (n_devices == MAX_DEVICES) { return -ENOSPC; }
+  devices[n_devices++] = &device;
+  return 0;
+}
+
+int FakeBus::transfer(uint8_t address,
+                      uint8_t const * write_data, size_t write_length,
+                      uint8_t * read_data, size_t read_length) {
+  // The general call is acknowledged, if at least one device is on the bus.
+  if (address == GENERAL_CALL_ADDRESS && read_length == 0) {
+    int result = -ENXIO;
+    for (size_t i = 0; i < n_devices; ++i) {
+      int const error = devices[i]->transfer(address, write_data,
+                                             write_length, nullptr, 0);
+      if (!error) { result = 0; }
+    }
+    return result;
+  }
+  for (size_t i = 0; i < n_devices; ++i) {
+    if (devices[i]->get_address() == address) {
+      return devices[i]->transfer(address, write_data, write_length,
+                                  read_data, read_length);
+    }
+  }
+  return -ENXIO;
+}
+
+}  // namespace odometer
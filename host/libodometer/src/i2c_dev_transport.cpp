@@ -0,0 +1,64 @@
+#include "odometer/i2c_dev_transport.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace odometer {
+
+I2cDevTransport::~I2cDevTransport() {
+  close();
+}
+
+int I2cDevTransport::open(char const * path) {
+  close();
+  fd = ::open(path, O_RDWR | O_CLOEXEC);
+  if (fd < 0) { return -errno; }
+  return 0;
+}
+
+void I2cDevTransport::close() {
+  if (fd >= 0) {
+    ::close(fd);
+    fd = -1;
+  }
+}
+
+int I2cDevTransport::transfer(uint8_t address,
+                              uint8_t const * write_data, size_t write_length,
+                              uint8_t * read_data, size_t read_length) {
+  if (fd < 0) { return -EBADF; }
+  if (write_length > UINT16_MAX || read_length > UINT16_MAX) {
+    return -EINVAL;
+  }
+
+  i2c_msg messages[2];
+  unsigned n_messages = 0;
+  if (write_length > 0) {
+    i2c_msg & message = messages[n_messages++];
+    message.addr = address;
+    message.flags = 0;
+    message.len = write_length;
+    // The kernel does not write into the buffer of a write message.
+    message.buf = const_cast<uint8_t *>(write_data);
+  }
+  if (read_length > 0) {
+    i2c_msg & message = messages[n_messages++];
+    message.addr = address;
+    message.flags = I2C_M_RD;
+    message.len = read_length;
+    message.buf = read_data;
+  }
+  if (n_messages == 0) { return 0; }
+
+  i2c_rdwr_ioctl_data data;
+  data.msgs = messages;
+  data.nmsgs = n_messages;
+  if (ioctl(fd, I2C_RDWR, &data) < 0) { return -errno; }
+  return 0;
+}
+
+}  // namespace odometer
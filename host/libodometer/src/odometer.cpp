@@ -0,0 +1,279 @@
+#include "odometer/odometer.h"
+
+#include <errno.h>
+#include <string.h>
+
+#include "odometer/byte_order.h"
+
+namespace odometer {
+
+// --- Decoding ---------------------------------------------------------------
+static void decode_status(uint8_t const * data, Status & status) {
+  status.flags = data[0];
+  status.fifo_count = data[1];
+  status.fifo_lost = data[2];
+  status.sample_period_ms = data[3];
+}
+
+static void encode_config(Config const & config, uint8_t * data) {
+  data[0] = CONFIG_VERSION;
+  data[1] = config.address;
+  memcpy(&data[2], config.channel_map, N_COUNTERS);
+  data[6] = config.inverted;
+  data[7] = config.count_mode;
+  data[8] = config.filter_time_us;
+  put_uint16(config_crc(data), &data[CONFIG_LENGTH - 2]);
+}
+
+static void decode_edge_times(uint8_t const * data,
+                              EdgeTime (&edge_times)[N_COUNTERS]) {
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    edge_times[i].age_us = get_uint32(&data[8 * i]);
+    edge_times[i].period_us = get_uint32(&data[8 * i + 4]);
+  }
+}
+
+
+uint16_t config_crc(uint8_t const * block) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < CONFIG_LENGTH - 2; ++i) {
+    crc ^= block[i];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+
+// --- Transactions -----------------------------------------------------------
+int Odometer::read_register(uint8_t reg, uint8_t * data, size_t length) {
+  if (length > MAX_READ_LENGTH) { return -EINVAL; }
+  return transport.transfer(address, &reg, 1, data, length);
+}
+
+int Odometer::write_register(uint8_t reg, uint8_t const * data,
+                             size_t length) {
+  if (length + 1 > sizeof(buffer)) { return -EINVAL; }
+  buffer[0] = reg;
+  memcpy(&buffer[1], data, length);
+  return transport.transfer(address, buffer, length + 1, nullptr, 0);
+}
+
+
+// --- Registers --------------------------------------------------------------
+int Odometer::read_whoami(char (&whoami)[WHOAMI_LENGTH]) {
+  int const error = read_register(REG_WHOAMI, buffer, WHOAMI_LENGTH);
+  if (error) { return error; }
+  memcpy(whoami, buffer, WHOAMI_LENGTH);
+  whoami[WHOAMI_LENGTH - 1] = '\0';
+  return 0;
+}
+
+int Odometer::read_status(Status & status) {
+  int const error = read_register(REG_STATUS, buffer, STATUS_LENGTH);
+  if (error) { return error; }
+  decode_status(buffer, status);
+  return 0;
+}
+
+int Odometer::read_time(uint32_t & time_us) {
+  int const error = read_register(REG_TIME, buffer, TIME_LENGTH);
+  if (error) { return error; }
+  time_us = get_uint32(buffer);
+  return 0;
+}
+
+int Odometer::read_counters(int32_t * counters, size_t n_counters) {
+  if (n_counters > N_COUNTERS) { return -EINVAL; }
+  int const error = read_register(REG_COUNT, buffer, 4 * n_counters);
+  if (error) { return error; }
+  for (size_t i = 0; i < n_counters; ++i) {
+    counters[i] = get_int32(&buffer[4 * i]);
+  }
+  return 0;
+}
+
+int Odometer::read_edge_times(EdgeTime (&edge_times)[N_COUNTERS]) {
+  int const error = read_register(REG_EDGE_TIMES, buffer, EDGE_TIMES_LENGTH);
+  if (error) { return error; }
+  decode_edge_times(buffer, edge_times);
+  return 0;
+}
+
+int Odometer::read_periods(Periods & periods) {
+  int const error = read_register(REG_PERIODS, buffer, PERIODS_LENGTH);
+  if (error) { return error; }
+  periods.n_edges = get_uint32(buffer);
+  for (size_t i = 0; i < N_PERIODS; ++i) {
+    periods.periods[i] = get_uint32(&buffer[4 * (i + 1)]);
+  }
+  return 0;
+}
+
+int Odometer::read_burst(Burst & burst) {
+  int const error = read_register(REG_STATUS, buffer, BURST_LENGTH);
+  if (error) { return error; }
+  decode_status(&buffer[REG_STATUS - REG_STATUS], burst.status);
+  burst.time_us = get_uint32(&buffer[REG_TIME - REG_STATUS]);
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    burst.counters[i] = get_int32(&buffer[REG_COUNT - REG_STATUS + 4 * i]);
+  }
+  decode_edge_times(&buffer[REG_EDGE_TIMES - REG_STATUS], burst.edge_times);
+  return 0;
+}
+
+int Odometer::reset_counters(int32_t value) {
+  uint8_t data[4];
+  put_uint32(value, data);
+  return write_register(REG_RESET, data, sizeof(data));
+}
+
+int Odometer::write_sample_period(uint8_t period_ms) {
+  return write_register(REG_SAMPLE_PERIOD, &period_ms, 1);
+}
+
+int Odometer::read_fifo(Sample * samples, size_t max_samples,
+                        size_t & n_samples) {
+  n_samples = 0;
+  if (max_samples > FIFO_BURST_SAMPLES) { max_samples = FIFO_BURST_SAMPLES; }
+  // The device removes all samples it sends, it must not send more than
+  // fit into `samples`. The limit is written in the same transaction as the
+  // read: selecting a register restores the default limit.
+  uint8_t const select[] = {REG_FIFO_DATA, (uint8_t)max_samples};
+  size_t const length = 1 + max_samples * SAMPLE_LENGTH;
+  int const error = transport.transfer(address, select, sizeof(select),
+                                       buffer, length);
+  if (error) { return error; }
+  if (buffer[0] > max_samples) { return -EPROTO; }
+  n_samples = buffer[0];
+  for (size_t i = 0; i < n_samples; ++i) {
+    uint8_t const * const data = &buffer[1 + i * SAMPLE_LENGTH];
+    for (size_t j = 0; j < N_COUNTERS; ++j) {
+      samples[i].counters[j] = get_uint16(&data[2 * j]);
+    }
+  }
+  return 0;
+}
+
+int Odometer::write_delta_width(uint8_t width) {
+  if (width != 1 && width != 2 && width != 4) { return -EINVAL; }
+  return write_register(REG_DELTA, &width, 1);
+}
+
+int Odometer::read_deltas(int32_t (&deltas)[N_COUNTERS]) {
+  int const error = read_register(REG_DELTA, buffer, DELTA_LENGTH);
+  if (error) { return error; }
+  uint8_t const width = buffer[0];
+  uint8_t const * const data = &buffer[1];
+  for (size_t i = 0; i < N_COUNTERS; ++i) {
+    switch (width) {
+      case 1: deltas[i] = (int8_t)data[i]; break;
+      case 2: deltas[i] = get_int16(&data[2 * i]); break;
+      case 4: deltas[i] = get_int32(&data[4 * i]); break;
+      default: return -EPROTO;
+    }
+  }
+  return 0;
+}
+
+int Odometer::latch() {
+  uint8_t const value = 1;
+  return write_register(REG_LATCH, &value, 1);
+}
+
+int Odometer::latch_all(Transport & transport) {
+  uint8_t const data[] = {REG_LATCH, 1};
+  return transport.transfer(GENERAL_CALL_ADDRESS, data, sizeof(data),
+                            nullptr, 0);
+}
+
+int Odometer::read_latched(Latched & latched, size_t n_counters) {
+  if (n_counters > N_COUNTERS) { return -EINVAL; }
+  int const error = read_register(REG_LATCH, buffer,
+                                  TIME_LENGTH + 4 * n_counters);
+  if (error) { return error; }
+  latched.time_us = get_uint32(buffer);
+  for (size_t i = 0; i < n_counters; ++i) {
+    latched.counters[i] = get_int32(&buffer[TIME_LENGTH + 4 * i]);
+  }
+  return 0;
+}
+
+int Odometer::write_filter_time(uint8_t time_us) {
+  return write_register(REG_FILTER, &time_us, 1);
+}
+
+int Odometer::read_filter_time(uint8_t & time_us) {
+  int const error = read_register(REG_FILTER, buffer, 1);
+  if (error) { return error; }
+  time_us = buffer[0];
+  return 0;
+}
+
+int Odometer::write_count_mode(uint8_t edges) {
+  return write_register(REG_COUNT_MODE, &edges, 1);
+}
+
+int Odometer::read_count_mode(uint8_t & edges) {
+  int const error = read_register(REG_COUNT_MODE, buffer, 1);
+  if (error) { return error; }
+  edges = buffer[0];
+  return 0;
+}
+
+int Odometer::write_config(Config const & config) {
+  uint8_t data[CONFIG_LENGTH];
+  encode_config(config, data);
+  return write_register(REG_CONFIG, data, CONFIG_LENGTH);
+}
+
+int Odometer::read_config(Config & config, uint8_t & unwritten) {
+  int const error = read_register(REG_CONFIG, buffer, CONFIG_LENGTH + 1);
+  if (error) { return error; }
+  unwritten = buffer[CONFIG_LENGTH];
+  if (buffer[0] != CONFIG_VERSION
+      || get_uint16(&buffer[CONFIG_LENGTH - 2]) != config_crc(buffer)) {
+    return -ENODATA;
+  }
+  config.address = buffer[1];
+  memcpy(config.channel_map, &buffer[2], N_COUNTERS);
+  config.inverted = buffer[6];
+  config.count_mode = buffer[7];
+  config.filter_time_us = buffer[8];
+  return 0;
+}
+
+int Odometer::read_timing(uint8_t histogram,
+                          uint32_t (&counts)[TIMING_BUCKETS]) {
+  // Select the histogram and read it, in one transaction.
+  uint8_t const select[] = {REG_TIMING, histogram};
+  int const error = transport.transfer(address, select, sizeof(select),
+                                       buffer, TIMING_LENGTH);
+  if (error) { return error; }
+  if (buffer[0] != histogram) { return -EIO; }
+  for (size_t i = 0; i < TIMING_BUCKETS; ++i) {
+    counts[i] = get_uint32(&buffer[1 + 4 * i]);
+  }
+  return 0;
+}
+
+int Odometer::clear_timing() {
+  uint8_t const value = TIMING_LOOP | TIMING_CLEAR;
+  return write_register(REG_TIMING, &value, 1);
+}
+
+int Odometer::read_diagnostics(Diagnostics & diagnostics, size_t n_counters) {
+  if (n_counters > N_COUNTERS) { return -EINVAL; }
+  int const error = read_register(REG_DIAGNOSTICS, buffer,
+                                  2 * (2 + n_counters));
+  if (error) { return error; }
+  diagnostics.overruns = get_uint16(&buffer[0]);
+  diagnostics.max_loop_us = get_uint16(&buffer[2]);
+  for (size_t i = 0; i < n_counters; ++i) {
+    diagnostics.missed[i] = get_uint16(&buffer[4 + 2 * i]);
+  }
+  return 0;
+}
+
+}  // namespace odometer
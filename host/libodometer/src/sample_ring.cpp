@@ -0,0 +1,85 @@
+#include "odometer/sample_ring.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace odometer {
+
+SharedRings::~SharedRings() {
+  close();
+}
+
+int SharedRings::create(char const * name, uint32_t n_rings,
+                        uint32_t period_us) {
+  close();
+  if (n_rings > MAX_RINGS) { return -EINVAL; }
+  // Replace an old region with a new object: Its consumers keep their
+  // mapping, which no longer changes, instead of losing the memory under
+  // it (SIGBUS). They open the name again.
+  if (shm_unlink(name) < 0 && errno != ENOENT) { return -errno; }
+  int const fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (fd < 0) { return -errno; }
+  if (ftruncate(fd, sizeof(SharedRegion)) < 0) {
+    int const error = errno;
+    ::close(fd);
+    return -error;
+  }
+  void * const memory = mmap(nullptr, sizeof(SharedRegion),
+                             PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) { return -errno; }
+
+  // The memory is zero, which is a valid state of the atomics.
+  region = new (memory) SharedRegion;
+  region->n_rings = n_rings;
+  region->ring_capacity = RING_CAPACITY;
+  region->period_us = period_us;
+  region->version = RING_VERSION;
+  std::atomic_thread_fence(std::memory_order_release);
+  region->magic = RING_MAGIC;
+  return 0;
+}
+
+int SharedRings::open(char const * name) {
+  close();
+  int const fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) { return -errno; }
+  // Accessing the mapping beyond the end of a smaller region would crash.
+  struct stat status;
+  if (fstat(fd, &status) < 0
+      || status.st_size < (off_t)sizeof(SharedRegion)) {
+    ::close(fd);
+    return -EPROTO;
+  }
+  void * const memory = mmap(nullptr, sizeof(SharedRegion), PROT_READ,
+                             MAP_SHARED, fd, 0);
+  ::close(fd);
+  if (memory == MAP_FAILED) { return -errno; }
+
+  region = static_cast<SharedRegion *>(memory);
+  if (region->magic != RING_MAGIC || region->version != RING_VERSION
+      || region->ring_capacity != RING_CAPACITY
+      || region->n_rings > MAX_RINGS) {
+    close();
+    return -EPROTO;
+  }
+  return 0;
+}
+
+void SharedRings::close() {
+  if (region) {
+    munmap(region, sizeof(SharedRegion));
+    region = nullptr;
+  }
+}
+
+int SharedRings::unlink(char const * name) {
+  if (shm_unlink(name) < 0) { return -errno; }
+  return 0;
+}
+
+}  // namespace odometer
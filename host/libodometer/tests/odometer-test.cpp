@@ -0,0 +1,334 @@
+// ============================================================================
+//          Tests of the Driver with Fake Odometers
+// ============================================================================
+
+// Drives `FakeDevice` and `FakeBus` through the `Odometer` functions: the
+// burst limit of the FIFO, the saturation of the deltas at their width, the
+// latch with the general call, the CRC of the configuration, and errors of
+// the bus, and the start of the readers of the shared memory ring. Run by
+// `ctest`; the exit status is 1 when a check failed.
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "odometer/byte_order.h"
+#include "odometer/fake_device.h"
+#include "odometer/odometer.h"
+#include "odometer/sample_ring.h"
+
+using namespace odometer;
+
+static int n_failures = 0;
+
+#define CHECK(condition) \
+  do { \
+    if (!(condition)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, \
+              #condition); \
+      ++n_failures; \
+    } \
+  } while (0)
+
+#define CHECK_EQUAL(actual, expected) \
+  do { \
+    long long const actual_ = (actual); \
+    long long const expected_ = (expected); \
+    if (actual_ != expected_) { \
+      fprintf(stderr, "%s:%d: %s is %lld, expected %lld\n", __FILE__, \
+              __LINE__, #actual, actual_, expected_); \
+      ++n_failures; \
+    } \
+  } while (0)
+
+
+// --- FIFO -------------------------------------------------------------------
+// A read returns at most `FIFO_BURST_SAMPLES` and at most the samples that
+// fit into the caller's array, the rest stays in the FIFO.
+static void test_fifo_burst_limits() {
+  FakeDevice device;
+  Odometer odometer(device);
+  CHECK_EQUAL(odometer.write_sample_period(10), 0);
+  for (int i = 0; i < 10; ++i) {
+    for (size_t j = 0; j < N_COUNTERS; ++j) {
+      device.counters[j] = 100 * i + j;
+    }
+    device.take_sample();
+  }
+
+  Sample samples[10];
+  size_t n_samples = 99;
+  CHECK_EQUAL(odometer.read_fifo(samples, 10, n_samples), 0);
+  CHECK_EQUAL(n_samples, FIFO_BURST_SAMPLES);
+  for (size_t i = 0; i < n_samples; ++i) {
+    CHECK_EQUAL(samples[i].counters[0], 100 * i);
+    CHECK_EQUAL(samples[i].counters[3], 100 * i + 3);
+  }
+
+  CHECK_EQUAL(odometer.read_fifo(samples, 2, n_samples), 0);
+  CHECK_EQUAL(n_samples, 2);
+  CHECK_EQUAL(samples[0].counters[0], 700);
+  CHECK_EQUAL(samples[1].counters[0], 800);
+
+  Status status;
+  CHECK_EQUAL(odometer.read_status(status), 0);
+  CHECK_EQUAL(status.fifo_count, 1);
+  CHECK_EQUAL(status.fifo_lost, 0);
+
+  CHECK_EQUAL(odometer.read_fifo(samples, 10, n_samples), 0);
+  CHECK_EQUAL(n_samples, 1);
+  CHECK_EQUAL(samples[0].counters[0], 900);
+  CHECK_EQUAL(odometer.read_fifo(samples, 10, n_samples), 0);
+  CHECK_EQUAL(n_samples, 0);
+}
+
+// A full FIFO counts the lost samples.
+static void test_fifo_lost() {
+  FakeDevice device;
+  Odometer odometer(device);
+  CHECK_EQUAL(odometer.write_sample_period(10), 0);
+  for (int i = 0; i < 40; ++i) { device.take_sample(); }
+  Status status;
+  CHECK_EQUAL(odometer.read_status(status), 0);
+  CHECK_EQUAL(status.fifo_count, 32);
+  CHECK_EQUAL(status.fifo_lost, 8);
+  CHECK_EQUAL(status.sample_period_ms, 10);
+}
+
+
+// --- Deltas -----------------------------------------------------------------
+// Deltas that don't fit into the width saturate, the rest is returned by
+// the next read.
+static void test_delta_saturation() {
+  FakeDevice device;
+  Odometer odometer(device);
+  CHECK_EQUAL(odometer.write_delta_width(1), 0);
+  device.counters[0] = 300;
+  device.counters[1] = -200;
+  device.counters[2] = 5;
+
+  int32_t deltas[N_COUNTERS];
+  CHECK_EQUAL(odometer.read_deltas(deltas), 0);
+  CHECK_EQUAL(deltas[0], 127);
+  CHECK_EQUAL(deltas[1], -128);
+  CHECK_EQUAL(deltas[2], 5);
+  CHECK_EQUAL(deltas[3], 0);
+
+  CHECK_EQUAL(odometer.read_deltas(deltas), 0);
+  CHECK_EQUAL(deltas[0], 127);
+  CHECK_EQUAL(deltas[1], -72);
+  CHECK_EQUAL(deltas[2], 0);
+
+  CHECK_EQUAL(odometer.read_deltas(deltas), 0);
+  CHECK_EQUAL(deltas[0], 46);
+  CHECK_EQUAL(deltas[1], 0);
+
+  // 2 bytes saturate at 16 bits, 4 bytes don't.
+  CHECK_EQUAL(odometer.write_delta_width(2), 0);
+  device.counters[0] += 40000;
+  device.counters[3] = -70000;
+  CHECK_EQUAL(odometer.read_deltas(deltas), 0);
+  CHECK_EQUAL(deltas[0], 32767);
+  CHECK_EQUAL(deltas[3], -32768);
+  CHECK_EQUAL(odometer.write_delta_width(4), 0);
+  CHECK_EQUAL(odometer.read_deltas(deltas), 0);
+  CHECK_EQUAL(deltas[0], 40000 - 32767);
+  CHECK_EQUAL(deltas[3], -70000 + 32768);
+
+  CHECK_EQUAL(odometer.write_delta_width(3), -EINVAL);
+}
+
+// The deltas are decoded with the width that the board sends, not with the
+// width that this host has set.
+static void test_delta_width_of_board() {
+  FakeDevice device;
+  Odometer odometer(device);
+  Odometer other(device);
+  CHECK_EQUAL(odometer.write_delta_width(1), 0);
+  CHECK_EQUAL(other.write_delta_width(4), 0);
+  device.counters[0] = 100000;
+  device.counters[3] = -3;
+
+  int32_t deltas[N_COUNTERS];
+  CHECK_EQUAL(odometer.read_deltas(deltas), 0);
+  CHECK_EQUAL(deltas[0], 100000);
+  CHECK_EQUAL(deltas[1], 0);
+  CHECK_EQUAL(deltas[3], -3);
+}
+
+
+// --- Latch ------------------------------------------------------------------
+// The general call latches all boards on the bus at the same moment.
+static void test_latch_general_call() {
+  FakeBus bus;
+  FakeDevice device_1(ADDRESS_BASE);
+  FakeDevice device_2(ADDRESS_BASE + 1);
+  CHECK_EQUAL(Odometer::latch_all(bus), -ENXIO);
+  CHECK_EQUAL(bus.add(device_1), 0);
+  CHECK_EQUAL(bus.add(device_2), 0);
+
+  device_1.time_us = 1000;
+  device_1.counters[0] = 11;
+  device_1.counters[3] = -14;
+  device_2.time_us = 2000;
+  device_2.counters[0] = 21;
+  CHECK_EQUAL(Odometer::latch_all(bus), 0);
+  device_1.counters[0] = 99;
+  device_2.counters[0] = 99;
+
+  Odometer odometer_1(bus, ADDRESS_BASE);
+  Odometer odometer_2(bus, ADDRESS_BASE + 1);
+  Latched latched;
+  CHECK_EQUAL(odometer_1.read_latched(latched, N_COUNTERS), 0);
+  CHECK_EQUAL(latched.time_us, 1000);
+  CHECK_EQUAL(latched.counters[0], 11);
+  CHECK_EQUAL(latched.counters[3], -14);
+  CHECK_EQUAL(odometer_2.read_latched(latched, N_QUAD_ENC_COUNTERS), 0);
+  CHECK_EQUAL(latched.time_us, 2000);
+  CHECK_EQUAL(latched.counters[0], 21);
+
+  // A board latches alone.
+  CHECK_EQUAL(odometer_2.latch(), 0);
+  CHECK_EQUAL(odometer_1.read_latched(latched, N_COUNTERS), 0);
+  CHECK_EQUAL(latched.counters[0], 11);
+  CHECK_EQUAL(odometer_2.read_latched(latched, N_COUNTERS), 0);
+  CHECK_EQUAL(latched.counters[0], 99);
+}
+
+
+// --- Configuration ----------------------------------------------------------
+// A written configuration reads back with a valid CRC. The device ignores
+// invalid blocks, a damaged block reads as missing.
+static void test_config_crc() {
+  FakeDevice device;
+  Odometer odometer(device);
+  Config config;
+  uint8_t unwritten = 99;
+  CHECK_EQUAL(odometer.read_config(config, unwritten), -ENODATA);
+
+  Config const written = {0x30, {3, 2, 1, 0}, 0, 1, 20};
+  CHECK_EQUAL(odometer.write_config(written), 0);
+  CHECK_EQUAL(odometer.read_config(config, unwritten), 0);
+  CHECK_EQUAL(unwritten, 0);
+  CHECK_EQUAL(config.address, 0x30);
+  CHECK(memcmp(config.channel_map, written.channel_map, N_COUNTERS) == 0);
+  CHECK_EQUAL(config.count_mode, 1);
+  CHECK_EQUAL(config.filter_time_us, 20);
+  CHECK_EQUAL(get_uint16(&device.config_block[CONFIG_LENGTH - 2]),
+              config_crc(device.config_block));
+
+  // The CRC of avr-libc's `_crc16_update`, start value 0xFFFF.
+  uint8_t const block[CONFIG_LENGTH] = {'1', '2', '3', '4', '5', '6', '7',
+                                        '8', '9'};
+  CHECK_EQUAL(config_crc(block), 0x4B37);
+
+  // Not a permutation of the inputs: ignored.
+  Config invalid = written;
+  invalid.channel_map[0] = 2;
+  CHECK_EQUAL(odometer.write_config(invalid), 0);
+  CHECK_EQUAL(odometer.read_config(config, unwritten), 0);
+  CHECK_EQUAL(config.channel_map[0], 3);
+
+  device.config_block[4] ^= 0x01;
+  CHECK_EQUAL(odometer.read_config(config, unwritten), -ENODATA);
+}
+
+
+// --- Errors -----------------------------------------------------------------
+// Errors of the transport are returned as they are, as negative `errno`.
+static void test_errors() {
+  FakeDevice device;
+  Odometer odometer(device);
+  device.fail_error = EIO;
+
+  char whoami[WHOAMI_LENGTH];
+  Status status;
+  uint32_t time_us;
+  int32_t counters[N_COUNTERS];
+  EdgeTime edge_times[N_COUNTERS];
+  Periods periods;
+  Burst burst;
+  Sample samples[FIFO_BURST_SAMPLES];
+  size_t n_samples = 99;
+  int32_t deltas[N_COUNTERS];
+  Latched latched;
+  uint8_t value;
+  Config config;
+  uint32_t counts[TIMING_BUCKETS];
+  Diagnostics diagnostics;
+  CHECK_EQUAL(odometer.read_whoami(whoami), -EIO);
+  CHECK_EQUAL(odometer.read_status(status), -EIO);
+  CHECK_EQUAL(odometer.read_time(time_us), -EIO);
+  CHECK_EQUAL(odometer.read_counters(counters, N_COUNTERS), -EIO);
+  CHECK_EQUAL(odometer.read_edge_times(edge_times), -EIO);
+  CHECK_EQUAL(odometer.read_periods(periods), -EIO);
+  CHECK_EQUAL(odometer.read_burst(burst), -EIO);
+  CHECK_EQUAL(odometer.read_fifo(samples, FIFO_BURST_SAMPLES, n_samples),
+              -EIO);
+  CHECK_EQUAL(n_samples, 0);
+  CHECK_EQUAL(odometer.read_deltas(deltas), -EIO);
+  CHECK_EQUAL(odometer.read_latched(latched, N_COUNTERS), -EIO);
+  CHECK_EQUAL(odometer.read_filter_time(value), -EIO);
+  CHECK_EQUAL(odometer.read_count_mode(value), -EIO);
+  CHECK_EQUAL(odometer.read_config(config, value), -EIO);
+  CHECK_EQUAL(odometer.read_timing(TIMING_LOOP, counts), -EIO);
+  CHECK_EQUAL(odometer.read_diagnostics(diagnostics, N_COUNTERS), -EIO);
+  CHECK_EQUAL(odometer.reset_counters(0), -EIO);
+  CHECK_EQUAL(odometer.latch(), -EIO);
+
+  device.fail_error = ETIMEDOUT;
+  CHECK_EQUAL(odometer.read_counters(counters, N_COUNTERS), -ETIMEDOUT);
+  device.fail_error = 0;
+  CHECK_EQUAL(odometer.read_counters(counters, N_COUNTERS), 0);
+  CHECK_EQUAL(odometer.read_counters(counters, N_COUNTERS + 1), -EINVAL);
+
+  // No board at the address: not acknowledged.
+  Odometer absent(device, ADDRESS_BASE + 1);
+  CHECK_EQUAL(absent.read_status(status), -ENXIO);
+}
+
+
+// --- Ring -------------------------------------------------------------------
+// A reader starts with the newest sample, or waits for the first one.
+static void test_ring_reader_start() {
+  static Ring ring;
+  RingWriter writer(ring);
+  RingSample sample = {};
+  RingReader empty_reader(ring);
+  CHECK_EQUAL(empty_reader.read(sample), RingReader::EMPTY);
+
+  for (int i = 1; i <= 3; ++i) {
+    sample.counters[0] = i;
+    writer.write(sample);
+  }
+  RingReader reader(ring);
+  CHECK_EQUAL(empty_reader.read(sample), RingReader::OK);
+  CHECK_EQUAL(sample.counters[0], 1);
+  CHECK_EQUAL(reader.read(sample), RingReader::OK);
+  CHECK_EQUAL(sample.counters[0], 3);
+  CHECK_EQUAL(reader.read(sample), RingReader::EMPTY);
+
+  sample.counters[0] = 4;
+  writer.write(sample);
+  CHECK_EQUAL(reader.read(sample), RingReader::OK);
+  CHECK_EQUAL(sample.counters[0], 4);
+  CHECK_EQUAL(reader.get_lost(), 0);
+}
+
+
+int main() {
+  test_fifo_burst_limits();
+  test_fifo_lost();
+  test_delta_saturation();
+  test_delta_width_of_board();
+  test_latch_general_call();
+  test_config_crc();
+  test_errors();
+  test_ring_reader_start();
+  if (n_failures) {
+    fprintf(stderr, "%d checks failed\n", n_failures);
+    return 1;
+  }
+  printf("All checks passed\n");
+  return 0;
+}
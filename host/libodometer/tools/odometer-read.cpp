@@ -0,0 +1,198 @@
+// ============================================================================
+//          Read the Counters of an Odometer
+// ============================================================================
+
+// Reads the who-am-I register and the configuration in the EEPROM, then
+// the counters periodically, and prints them with the duration of each
+// read. At the end it prints the minimum,
+// mean and maximum duration of the reads, and the diagnostics of the
+// odometer: the situations in which it can lose counts. With `-H` also the
+// timing histograms of the odometer during the reads.
+//
+//     odometer-read [-d /dev/i2c-1] [-a 0x28] [-c 4] [-n 100] [-i 50] [-q]
+//                   [-H]
+//     odometer-read -f
+//
+// Options:
+//     -d <device>  I2C bus, default /dev/i2c-1.
+//     -a <addr>    Address of the odometer, default 0x28.
+//     -c <n>       Number of counters: 4 (simple pulse), 2 (quadrature
+//                  encoder). Default 4.
+//     -n <n>       Number of reads, 0 for ever. Default 100.
+//     -i <ms>      Interval between the reads, default 50.
+//     -q           Print only the durations at the end.
+//     -H           Clear the timing histograms (`REG_TIMING`) at the start,
+//                  print them at the end. Simple pulse firmware built 
+//                  with `RECORD_TIMING` only.
+//     -f           Use a fake odometer in this process, instead of I2C.
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "odometer/fake_device.h"
+#include "odometer/i2c_dev_transport.h"
+#include "odometer/odometer.h"
+
+static double now_us() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec * 1e6 + time.tv_nsec * 1e-3;
+}
+
+static void usage(char const * program) {
+  fprintf(stderr, "Usage: %s [-d device] [-a address] [-c counters] "
+          "[-n reads] [-i ms] [-q] [-H] [-f]\n", program);
+  exit(2);
+}
+
+int main(int argc, char ** argv) {
+  char const * device = "/dev/i2c-1";
+  uint8_t address = odometer::ADDRESS_BASE;
+  size_t n_counters = odometer::N_COUNTERS;
+  unsigned long n_reads = 100;
+  unsigned interval_ms = 50;
+  bool quiet = false;
+  bool timing = false;
+  bool fake = false;
+  int option;
+  while ((option = getopt(argc, argv, "d:a:c:n:i:qHf")) != -1) {
+    switch (option) {
+      case 'd': device = optarg; break;
+      case 'a': address = strtoul(optarg, nullptr, 0); break;
+      case 'c': n_counters = strtoul(optarg, nullptr, 0); break;
+      case 'n': n_reads = strtoul(optarg, nullptr, 0); break;
+      case 'i': interval_ms = strtoul(optarg, nullptr, 0); break;
+      case 'q': quiet = true; break;
+      case 'H': timing = true; break;
+      case 'f': fake = true; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc || n_counters > odometer::N_COUNTERS) { usage(argv[0]); }
+
+  odometer::I2cDevTransport bus;
+  odometer::FakeDevice fake_device(address);
+  odometer::Transport * transport = &fake_device;
+  if (!fake) {
+    int const error = bus.open(device);
+    if (error) {
+      fprintf(stderr, "%s: %s\n", device, strerror(-error));
+      return 1;
+    }
+    transport = &bus;
+  }
+  odometer::Odometer odometer(*transport, address);
+
+  char whoami[odometer::WHOAMI_LENGTH];
+  int error = odometer.read_whoami(whoami);
+  if (error) {
+    fprintf(stderr, "Who am I: %s\n", strerror(-error));
+    return 1;
+  }
+  printf("Who am I: %s\n", whoami);
+
+  odometer::Config config;
+  uint8_t unwritten;
+  error = odometer.read_config(config, unwritten);
+  if (error == -ENODATA) {
+    printf("Configuration: none, jumpers and defaults\n");
+  }
+  else if (error) {
+    fprintf(stderr, "Configuration: %s\n", strerror(-error));
+    return 1;
+  }
+  else {
+    printf("Configuration: address 0x%02X, channel map %u %u %u %u, "
+           "inverted 0x%X, count mode %u, filter %u us, %u bytes unwritten\n",
+           config.address, config.channel_map[0], config.channel_map[1],
+           config.channel_map[2], config.channel_map[3], config.inverted,
+           config.count_mode, config.filter_time_us, unwritten);
+  }
+
+  if (timing) {
+    error = odometer.clear_timing();
+    if (error) {
+      fprintf(stderr, "Timing: %s\n", strerror(-error));
+      return 1;
+    }
+  }
+
+  double min_us = 1e99;
+  double max_us = 0;
+  double sum_us = 0;
+  unsigned long n_done = 0;
+  for (; n_reads == 0 || n_done < n_reads; ++n_done) {
+    // The fake odometer moves: each counter with a different speed.
+    for (size_t i = 0; i < odometer::N_COUNTERS; ++i) {
+      fake_device.counters[i] += i + 1;
+    }
+
+    int32_t counters[odometer::N_COUNTERS];
+    double const start_us = now_us();
+    error = odometer.read_counters(counters, n_counters);
+    double const duration_us = now_us() - start_us;
+    if (error) {
+      fprintf(stderr, "Counters: %s\n", strerror(-error));
+      return 1;
+    }
+
+    if (duration_us < min_us) { min_us = duration_us; }
+    if (duration_us > max_us) { max_us = duration_us; }
+    sum_us += duration_us;
+    if (!quiet) {
+      printf("Counters:");
+      for (size_t i = 0; i < n_counters; ++i) {
+        printf(" %" PRId32, counters[i]);
+      }
+      printf(" (%.0f us)\n", duration_us);
+    }
+    if (interval_ms) { usleep(interval_ms * 1000); }
+  }
+
+  if (n_done > 0) {
+    printf("%lu reads, duration: min %.1f us, mean %.1f us, max %.1f us\n",
+           n_done, min_us, sum_us / n_done, max_us);
+  }
+
+  odometer::Diagnostics diagnostics;
+  error = odometer.read_diagnostics(diagnostics, n_counters);
+  if (error) {
+    fprintf(stderr, "Diagnostics: %s\n", strerror(-error));
+    return 1;
+  }
+  printf("Diagnostics: %u overruns, longest loop %u us, missed edges:",
+         diagnostics.overruns, diagnostics.max_loop_us);
+  for (size_t i = 0; i < n_counters; ++i) {
+    printf(" %u", diagnostics.missed[i]);
+  }
+  printf("\n");
+
+  if (timing) {
+    static char const * const NAMES[odometer::TIMING_HISTOGRAMS] = {
+      "Loop periods", "Receive callback", "Request callback"};
+    for (uint8_t h = 0; h < odometer::TIMING_HISTOGRAMS; ++h) {
+      uint32_t counts[odometer::TIMING_BUCKETS];
+      error = odometer.read_timing(h, counts);
+      if (error) {
+        fprintf(stderr, "Timing: %s\n", strerror(-error));
+        return 1;
+      }
+      // The buckets in microseconds, from 16 MHz CPU cycles.
+      printf("%s:\n", NAMES[h]);
+      for (size_t i = 0; i < odometer::TIMING_BUCKETS; ++i) {
+        if (counts[i] == 0) { continue; }
+        double const low_us = i == 0
+          ? 0 : (1UL << (i + odometer::TIMING_MIN_LOG2)) / 16.0;
+        printf("  %s%9.1f us: %" PRIu32 "\n",
+               i + 1 == odometer::TIMING_BUCKETS ? ">=" : "  ",
+               low_us, counts[i]);
+      }
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,88 @@
+// ============================================================================
+//          Print the Samples that odometerd Publishes
+// ============================================================================
+
+// A consumer of the shared memory of `odometerd`: Prints the new samples of
+// one bus (ring), and the samples it lost because it was too slow.
+//
+//     odometer-monitor [-n shm_name] [-r ring] [-c count]
+//
+// Options:
+//     -n <name>   Name of the shared memory, default /odometer.
+//     -r <ring>   Index of the bus, in the order of the command line of
+//                 `odometerd`, default 0.
+//     -c <count>  Stop after this number of samples, default: never.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "odometer/sample_ring.h"
+
+static void usage(char const * program) {
+  fprintf(stderr, "Usage: %s [-n shm_name] [-r ring] [-c count]\n", program);
+  exit(2);
+}
+
+int main(int argc, char ** argv) {
+  char const * shm_name = odometer::DEFAULT_SHM_NAME;
+  uint32_t ring_index = 0;
+  unsigned long max_samples = 0;
+  int option;
+  while ((option = getopt(argc, argv, "n:r:c:")) != -1) {
+    switch (option) {
+      case 'n': shm_name = optarg; break;
+      case 'r': ring_index = strtoul(optarg, nullptr, 0); break;
+      case 'c': max_samples = strtoul(optarg, nullptr, 0); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (optind != argc) { usage(argv[0]); }
+
+  odometer::SharedRings rings;
+  int const error = rings.open(shm_name);
+  if (error) {
+    fprintf(stderr, "Error: Shared memory %s: %s\n", shm_name,
+            strerror(-error));
+    return 1;
+  }
+  if (ring_index >= rings.get_n_rings()) {
+    fprintf(stderr, "Error: There are only %u buses.\n", rings.get_n_rings());
+    return 1;
+  }
+  odometer::Ring const & ring = rings.get(ring_index);
+  printf("Bus %s, period %u us\n", ring.bus_name, rings.get_period_us());
+
+  odometer::RingReader reader(ring);
+  unsigned long n_samples = 0;
+  uint64_t last_lost = 0;
+  while (max_samples == 0 || n_samples < max_samples) {
+    odometer::RingSample sample;
+    switch (reader.read(sample)) {
+      case odometer::RingReader::OK:
+        ++n_samples;
+        printf("%" PRIu64 ".%06" PRIu64 " 0x%02X:",
+               sample.time_ns / 1000000000, sample.time_ns / 1000 % 1000000,
+               sample.address);
+        if (sample.error) {
+          printf(" error: %s\n", strerror(sample.error));
+          break;
+        }
+        for (size_t i = 0; i < sample.n_counters; ++i) {
+          printf(" %" PRId32, sample.counters[i]);
+        }
+        printf("\n");
+        break;
+      case odometer::RingReader::LOST:
+        printf("Lost %" PRIu64 " samples\n", reader.get_lost() - last_lost);
+        last_lost = reader.get_lost();
+        break;
+      case odometer::RingReader::EMPTY:
+        usleep(rings.get_period_us() / 2);
+        break;
+    }
+  }
+  return 0;
+}
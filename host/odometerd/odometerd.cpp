@@ -0,0 +1,405 @@
+// ============================================================================
+//          Polling Daemon for Several Odometers
+// ============================================================================
+
+// Polls the counters of up to four odometers per I2C bus (addresses 0x28 -
+// 0x2B, set with the address jumpers, or configured in the EEPROM of the
+// boards, see `REG_CONFIG`) on a fixed schedule, and publishes
+// timestamped samples in shared memory (`odometer/sample_ring.h`). Planning,
+// logging and telemetry processes read the samples from there, without
+// I2C traffic of their own.
+//
+// Each bus has its own thread with real-time priority (`SCHED_FIFO`), which
+// polls the boards of the bus one after another, and then sleeps until the
+// next period. Each bus has its own ring buffer in the shared memory.
+//
+//     odometerd [-p period_us] [-n shm_name] [-P priority] [-t seconds] [-s]
+//               [-l] [-g us] [-m edges] <bus>:<address>[,<address>...] ...
+//     odometerd -p 5000 /dev/i2c-1:0x28,0x29 /dev/i2c-3:0x28
+//
+// Options:
+//     -p <us>        Poll period, default 10000 (100 Hz).
+//     -n <name>      Name of the shared memory, default /odometer.
+//     -P <priority>  SCHED_FIFO priority of the poll threads, default 50,
+//                    0 for normal scheduling.
+//     -t <seconds>   Stop after this time, default: run until SIGINT or
+//                    SIGTERM.
+//     -s             Simulate the buses with fake odometers, for tests
+//                    without hardware. The counters of the fake odometers
+//                    move with constant speeds.
+//     -l             Latch all boards of a bus at the same moment with the
+//                    general call, then read their shadow registers
+//                    (`REG_LATCH`). All samples of a period have the time of
+//                    the latch, instead of the time of each read.
+//     -g <us>        Minimum stable time of the glitch filter of the simple
+//                    pulse boards (`REG_FILTER`), set at startup. Default:
+//                    The setting of the boards (after power on from their
+//                    configuration, otherwise off).
+//     -m <edges>     Counted edges per cycle of all boards
+//                    (`REG_COUNT_MODE`), set at startup: 1 or 2 for the
+//                    simple pulse boards (rising or both edges), 1, 2 or 4
+//                    for the quadrature encoder boards. Fewer edges save CPU
+//                    time of the boards at high speed, the counters keep
+//                    their unit. Default: The setting of the boards (after
+//                    power on from their configuration, otherwise all
+//                    edges).
+//
+// The type of each board is read from its who-am-I register at startup:
+// The quadrature encoder firmware has 2 counters, the simple pulse firmware
+// has 4.
+
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <vector>
+
+#include "odometer/fake_device.h"
+#include "odometer/i2c_dev_transport.h"
+#include "odometer/odometer.h"
+#include "odometer/sample_ring.h"
+
+// --- Configuration ----------------------------------------------------------
+struct Board {
+  uint8_t address;
+  size_t n_counters;
+};
+
+struct Bus {
+  char const * path;
+  std::vector<Board> boards;
+  // The real bus, or fake odometers.
+  odometer::I2cDevTransport i2c;
+  odometer::FakeBus fake_bus;
+  std::vector<odometer::FakeDevice> fake_devices;
+  odometer::Transport * transport;
+  odometer::Ring * ring;
+  pthread_t thread;
+  uint64_t n_samples = 0;
+};
+
+static uint32_t period_us = 10000;
+static char const * shm_name = odometer::DEFAULT_SHM_NAME;
+static int priority = 50;
+static bool simulate = false;
+static bool use_latch = false;
+// Minimum stable time of the glitch filter, -1 to keep the setting.
+static int filter_time_us = -1;
+// Counted edges per cycle, -1 to keep the setting.
+static int count_edges = -1;
+static std::atomic<bool> stop_requested(false);
+
+static uint64_t const NS_PER_S = 1000000000;
+
+
+// --- Helpers ----------------------------------------------------------------
+static uint64_t to_ns(timespec const & time) {
+  return time.tv_sec * NS_PER_S + time.tv_nsec;
+}
+
+static timespec from_ns(uint64_t ns) {
+  timespec time;
+  time.tv_sec = ns / NS_PER_S;
+  time.tv_nsec = ns % NS_PER_S;
+  return time;
+}
+
+static uint64_t now_ns() {
+  timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return to_ns(time);
+}
+
+// Parse "<bus>:<address>[,<address>...]". Returns false for errors.
+static bool parse_bus(char * argument, Bus & bus) {
+  char * const colon = strrchr(argument, ':');
+  if (!colon) { return false; }
+  *colon = '\0';
+  bus.path = argument;
+  for (char * token = strtok(colon + 1, ","); token;
+       token = strtok(nullptr, ",")) {
+    char * end;
+    unsigned long const address = strtoul(token, &end, 0);
+    if (*end != '\0' || address > 0x7F
+        || bus.boards.size() == odometer::N_ADDRESSES) {
+      return false;
+    }
+    bus.boards.push_back(Board{(uint8_t)address, odometer::N_COUNTERS});
+  }
+  return !bus.boards.empty();
+}
+
+
+// --- Polling ----------------------------------------------------------------
+// The poll thread of one bus.
+static void * poll_bus(void * argument) {
+  Bus & bus = *static_cast<Bus *>(argument);
+  odometer::RingWriter writer(*bus.ring);
+  // Created before the loop, polling allocates no memory.
+  std::vector<odometer::Odometer> odometers;
+  for (Board const & board : bus.boards) {
+    odometers.emplace_back(*bus.transport, board.address);
+  }
+
+  uint64_t const period_ns = (uint64_t)period_us * 1000;
+  uint64_t next_ns = now_ns();
+  while (!stop_requested.load(std::memory_order_relaxed)) {
+    if (simulate) {
+      // Each board and counter has its own speed.
+      for (size_t i = 0; i < bus.fake_devices.size(); ++i) {
+        for (size_t j = 0; j < odometer::N_COUNTERS; ++j) {
+          bus.fake_devices[i].counters[j] += (i + 1) * (j + 1);
+        }
+      }
+    }
+
+    uint64_t latch_ns = 0;
+    int latch_error = 0;
+    if (use_latch) {
+      uint64_t const start_ns = now_ns();
+      latch_error = odometer::Odometer::latch_all(*bus.transport);
+      latch_ns = start_ns + (now_ns() - start_ns) / 2;
+    }
+
+    for (size_t i = 0; i < bus.boards.size(); ++i) {
+      odometer::RingSample sample = {};
+      sample.address = bus.boards[i].address;
+      sample.n_counters = bus.boards[i].n_counters;
+      int error;
+      if (use_latch) {
+        odometer::Latched latched = {};
+        error = latch_error;
+        if (!error) {
+          error = odometers[i].read_latched(latched, sample.n_counters);
+        }
+        memcpy(sample.counters, latched.counters,
+               sample.n_counters * sizeof(int32_t));
+        sample.time_ns = latch_ns;
+      }
+      else {
+        uint64_t const start_ns = now_ns();
+        error = odometers[i].read_counters(sample.counters,
+                                           sample.n_counters);
+        sample.time_ns = start_ns + (now_ns() - start_ns) / 2;
+      }
+      if (error) {
+        sample.error = -error;
+        memset(sample.counters, 0, sizeof(sample.counters));
+        bus.ring->n_errors.fetch_add(1, std::memory_order_relaxed);
+      }
+      writer.write(sample);
+      ++bus.n_samples;
+    }
+
+    // Keep the schedule. Periods that are completely missed are skipped.
+    next_ns += period_ns;
+    uint64_t const now = now_ns();
+    if (now > next_ns) {
+      uint64_t const missed = (now - next_ns) / period_ns + 1;
+      bus.ring->n_missed_deadlines.fetch_add(missed,
+                                             std::memory_order_relaxed);
+      next_ns += missed * period_ns;
+    }
+    timespec const next = from_ns(next_ns);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, nullptr)
+           == EINTR) {}
+  }
+  return nullptr;
+}
+
+// Start the poll thread of `bus`, with real-time priority if possible.
+static int start_thread(Bus & bus) {
+  pthread_attr_t attributes;
+  pthread_attr_init(&attributes);
+  if (priority > 0) {
+    sched_param parameters = {};
+    parameters.sched_priority = priority;
+    pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(&attributes, SCHED_FIFO);
+    pthread_attr_setschedparam(&attributes, &parameters);
+  }
+  int error = pthread_create(&bus.thread, &attributes, poll_bus, &bus);
+  if (error == EPERM && priority > 0) {
+    fprintf(stderr, "Warning: No permission for real-time priority, %s is "
+            "polled with normal priority.\n", bus.path);
+    pthread_attr_setinheritsched(&attributes, PTHREAD_INHERIT_SCHED);
+    error = pthread_create(&bus.thread, &attributes, poll_bus, &bus);
+  }
+  pthread_attr_destroy(&attributes);
+  return -error;
+}
+
+// Set the counted edges per cycle of a board, and read them back: The
+// firmware ignores the values that it does not support.
+static void set_count_mode(odometer::Odometer & odometer, Bus const & bus,
+                           Board const & board) {
+  uint8_t edges = 0;
+  int error = odometer.write_count_mode(count_edges);
+  if (!error) { error = odometer.read_count_mode(edges); }
+  if (error) {
+    fprintf(stderr, "Warning: %s, 0x%02X: Count mode: %s\n", bus.path,
+            board.address, strerror(-error));
+  }
+  else if (edges == 0) {
+    fprintf(stderr, "Warning: %s, 0x%02X: The board can't switch the "
+            "counted edges per cycle.\n", bus.path, board.address);
+  }
+  else if (edges != count_edges) {
+    fprintf(stderr, "Warning: %s, 0x%02X: The board does not count %d "
+            "edges per cycle, it counts %u.\n", bus.path, board.address,
+            count_edges, edges);
+  }
+}
+
+// Open the bus, and find out the number of counters of each board.
+static int open_bus(Bus & bus) {
+  if (simulate) {
+    for (Board const & board : bus.boards) {
+      bus.fake_devices.emplace_back(board.address);
+    }
+    for (odometer::FakeDevice & device : bus.fake_devices) {
+      bus.fake_bus.add(device);
+    }
+    bus.transport = &bus.fake_bus;
+  }
+  else {
+    int const error = bus.i2c.open(bus.path);
+    if (error) {
+      fprintf(stderr, "Error: %s: %s\n", bus.path, strerror(-error));
+      return error;
+    }
+    bus.transport = &bus.i2c;
+  }
+
+  for (Board & board : bus.boards) {
+    odometer::Odometer odometer(*bus.transport, board.address);
+    char whoami[odometer::WHOAMI_LENGTH];
+    int const error = odometer.read_whoami(whoami);
+    if (error) {
+      // The board may be connected later, poll it anyway.
+      fprintf(stderr, "Warning: %s, 0x%02X: %s\n", bus.path, board.address,
+              strerror(-error));
+      continue;
+    }
+    if (!strcmp(whoami, "odqe01")) {
+      board.n_counters = odometer::N_QUAD_ENC_COUNTERS;
+    }
+    else if (filter_time_us >= 0) {
+      int const filter_error = odometer.write_filter_time(filter_time_us);
+      if (filter_error) {
+        fprintf(stderr, "Warning: %s, 0x%02X: Glitch filter: %s\n", bus.path,
+                board.address, strerror(-filter_error));
+      }
+    }
+    if (count_edges >= 0) { set_count_mode(odometer, bus, board); }
+    printf("%s, 0x%02X: %s, %zu counters\n", bus.path, board.address, whoami,
+           board.n_counters);
+  }
+  return 0;
+}
+
+
+// --- Main -------------------------------------------------------------------
+static void usage(char const * program) {
+  fprintf(stderr, "Usage: %s [-p period_us] [-n shm_name] [-P priority] "
+          "[-t seconds] [-s] [-l] [-g us] [-m edges] "
+          "<bus>:<address>[,<address>...] ...\n", program);
+  exit(2);
+}
+
+int main(int argc, char ** argv) {
+  unsigned long run_seconds = 0;
+  int option;
+  while ((option = getopt(argc, argv, "p:n:P:t:slg:m:")) != -1) {
+    switch (option) {
+      case 'p': period_us = strtoul(optarg, nullptr, 0); break;
+      case 'n': shm_name = optarg; break;
+      case 'P': priority = strtol(optarg, nullptr, 0); break;
+      case 't': run_seconds = strtoul(optarg, nullptr, 0); break;
+      case 's': simulate = true; break;
+      case 'l': use_latch = true; break;
+      case 'g': filter_time_us = strtol(optarg, nullptr, 0); break;
+      case 'm': count_edges = strtol(optarg, nullptr, 0); break;
+      default: usage(argv[0]);
+    }
+  }
+  size_t const n_buses = argc - optind;
+  if (n_buses == 0 || n_buses > odometer::MAX_RINGS || period_us == 0
+      || filter_time_us > 255 || count_edges > 4) {
+    usage(argv[0]);
+  }
+
+  // The buses are not moved after this: the threads use them.
+  std::vector<Bus> buses(n_buses);
+  for (size_t i = 0; i < n_buses; ++i) {
+    if (!parse_bus(argv[optind + i], buses[i])) { usage(argv[0]); }
+  }
+
+  // Page faults would delay the real-time threads.
+  if (priority > 0 && mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+    fprintf(stderr, "Warning: mlockall: %s\n", strerror(errno));
+  }
+
+  odometer::SharedRings rings;
+  int error = rings.create(shm_name, n_buses, period_us);
+  if (error) {
+    fprintf(stderr, "Error: Shared memory %s: %s\n", shm_name,
+            strerror(-error));
+    return 1;
+  }
+  for (size_t i = 0; i < n_buses; ++i) {
+    buses[i].ring = &rings.get(i);
+    snprintf(buses[i].ring->bus_name, sizeof(buses[i].ring->bus_name), "%s",
+             buses[i].path);
+    if (open_bus(buses[i])) { return 1; }
+  }
+
+  // The signals are handled by `sigwait` in this thread, the poll threads
+  // inherit the blocked signals.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+  size_t n_started = 0;
+  for (; n_started < n_buses; ++n_started) {
+    error = start_thread(buses[n_started]);
+    if (error) {
+      fprintf(stderr, "Error: Thread for %s: %s\n", buses[n_started].path,
+              strerror(-error));
+      break;
+    }
+  }
+
+  if (n_started == n_buses) {
+    if (run_seconds) {
+      timespec const timeout = {(time_t)run_seconds, 0};
+      sigtimedwait(&signals, nullptr, &timeout);
+    }
+    else {
+      int signal;
+      sigwait(&signals, &signal);
+    }
+  }
+  stop_requested = true;
+  for (size_t i = 0; i < n_started; ++i) {
+    pthread_join(buses[i].thread, nullptr);
+  }
+
+  for (Bus const & bus : buses) {
+    printf("%s: %llu samples, %llu errors, %llu missed periods\n", bus.path,
+           (unsigned long long)bus.n_samples,
+           (unsigned long long)bus.ring->n_errors.load(),
+           (unsigned long long)bus.ring->n_missed_deadlines.load());
+  }
+  odometer::SharedRings::unlink(shm_name);
+  return n_started == n_buses ? 0 : 1;
+}
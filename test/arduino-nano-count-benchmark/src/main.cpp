@@ -0,0 +1,191 @@
+// ============================================================================
+//        Cycle Benchmark for the Counting Algorithms of Simple Pulse
+// ============================================================================
+
+// Measures how many CPU cycles one iteration of the counting code takes, for
+// the old `digitalRead` algorithm and for the new port snapshot algorithm of
+// `firmware/arduino-nano-simp-pulse`, also with its glitch filter (vertical
+// counter, minimum stable time 12 us). The results are printed on the serial
+// port, read them on the host with:
+//
+//     pio device monitor
+//
+// The counting code is copied from the firmware. The pulse pins are switched
+// to outputs, so that the benchmark can toggle them itself: `PIND` and
+// `digitalRead` also return the level of output pins. Timer1 runs with the
+// CPU clock and measures the cycles.
+
+#include <Arduino.h>
+
+// Pulse counter pins, the same as in the firmware.
+byte const PLUG_1_PIN_1 = 3;
+byte const PLUG_1_PIN_2 = 5;
+byte const PLUG_2_PIN_1 = 2;
+byte const PLUG_2_PIN_2 = 4;
+byte const PLUG_1_PIN_1_MASK = _BV(PLUG_1_PIN_1);
+byte const PLUG_1_PIN_2_MASK = _BV(PLUG_1_PIN_2);
+byte const PLUG_2_PIN_1_MASK = _BV(PLUG_2_PIN_1);
+byte const PLUG_2_PIN_2_MASK = _BV(PLUG_2_PIN_2);
+byte const PLUG_PINS_MASK = PLUG_1_PIN_1_MASK | PLUG_1_PIN_2_MASK
+                          | PLUG_2_PIN_1_MASK | PLUG_2_PIN_2_MASK;
+
+// Number of iterations per measurement.
+// Must be small enough that Timer1 (16 bit) does not overflow.
+unsigned int const N_ITERATIONS = 100;
+
+// --- State of the counting algorithms ---------------------------------------
+// `digitalRead` algorithm
+bool pin_state_1_1 = false;
+bool pin_state_1_2 = false;
+bool pin_state_2_1 = false;
+bool pin_state_2_2 = false;
+// Port snapshot algorithm
+byte pin_states = 0;
+// Glitch filter: period of its clock in ticks of Timer0 (12 us), the last
+// clock, and the vertical counter.
+byte filter_period = 2;
+byte filter_clock = 0;
+byte filter_count_0 = 0;
+byte filter_count_1 = 0;
+// The counters, shared by both algorithms.
+int32_t counter_1_1 = 0;
+int32_t counter_1_2 = 0;
+int32_t counter_2_1 = 0;
+int32_t counter_2_2 = 0;
+
+
+// --- Algorithms -------------------------------------------------------------
+// The functions must not be inlined, the firmware calls `loop()` too.
+
+// Empty iteration, to measure the overhead of the benchmark itself.
+__attribute__((noinline)) void count_nothing() {
+  asm volatile ("");
+}
+
+// The old algorithm: read each pin with `digitalRead`.
+__attribute__((noinline)) void count_digital_read() {
+  bool curr_state;
+  curr_state = digitalRead(PLUG_1_PIN_1);
+  if (pin_state_1_1 != curr_state) {
+    pin_state_1_1 = curr_state;
+    ++counter_1_1;
+  }
+  curr_state = digitalRead(PLUG_1_PIN_2);
+  if (pin_state_1_2 != curr_state) {
+    pin_state_1_2 = curr_state;
+    ++counter_1_2;
+  }
+  curr_state = digitalRead(PLUG_2_PIN_1);
+  if (pin_state_2_1 != curr_state) {
+    pin_state_2_1 = curr_state;
+    ++counter_2_1;
+  }
+  curr_state = digitalRead(PLUG_2_PIN_2);
+  if (pin_state_2_2 != curr_state) {
+    pin_state_2_2 = curr_state;
+    ++counter_2_2;
+  }
+}
+
+// The new algorithm: read the whole port, find changed pins with XOR.
+__attribute__((noinline)) void count_port_snapshot() {
+  byte curr_states = PIND & PLUG_PINS_MASK;
+  byte changed = pin_states ^ curr_states;
+  if (changed) {
+    pin_states = curr_states;
+    if (changed & PLUG_1_PIN_1_MASK) { ++counter_1_1; }
+    if (changed & PLUG_1_PIN_2_MASK) { ++counter_1_2; }
+    if (changed & PLUG_2_PIN_1_MASK) { ++counter_2_1; }
+    if (changed & PLUG_2_PIN_2_MASK) { ++counter_2_2; }
+  }
+}
+
+// The port snapshot with the glitch filter of the firmware.
+__attribute__((noinline)) void count_port_snapshot_filtered() {
+  byte curr_states = PIND & PLUG_PINS_MASK;
+  byte const differs = pin_states ^ curr_states;
+  byte count_0 = filter_count_0 & differs;
+  byte count_1 = filter_count_1 & differs;
+  byte const now = TCNT0;
+  if ((byte)(now - filter_clock) >= filter_period) {
+    filter_clock = now;
+    count_1 ^= count_0;
+    count_0 = ~count_0 & differs;
+  }
+  byte const changed = count_0 & count_1;
+  filter_count_0 = count_0 & ~changed;
+  filter_count_1 = count_1 & ~changed;
+  if (changed) {
+    pin_states ^= changed;
+    if (changed & PLUG_1_PIN_1_MASK) { ++counter_1_1; }
+    if (changed & PLUG_1_PIN_2_MASK) { ++counter_1_2; }
+    if (changed & PLUG_2_PIN_1_MASK) { ++counter_2_1; }
+    if (changed & PLUG_2_PIN_2_MASK) { ++counter_2_2; }
+  }
+}
+
+
+// --- Measurement ------------------------------------------------------------
+// Run `algorithm` `N_ITERATIONS` times and return the number of cycles.
+// Between the iterations the pins in `toggle_mask` are toggled.
+unsigned int measure(void (*algorithm)(), byte toggle_mask) {
+  noInterrupts();
+  TCNT1 = 0;
+  for (unsigned int i = 0; i < N_ITERATIONS; ++i) {
+    // Writing a 1 into PINx toggles the output.
+    PIND = toggle_mask;
+    algorithm();
+  }
+  unsigned int cycles = TCNT1;
+  interrupts();
+  return cycles;
+}
+
+// Measure `algorithm`, subtract the overhead, and print the result.
+void report(char const * name, void (*algorithm)(), byte toggle_mask) {
+  unsigned int const overhead = measure(count_nothing, toggle_mask);
+  unsigned int const cycles = measure(algorithm, toggle_mask) - overhead;
+  // Each level needs one iteration: A pulse needs two iterations.
+  unsigned long const max_freq =
+      (F_CPU * N_ITERATIONS) / (2UL * (cycles + overhead));
+
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print((float)cycles / N_ITERATIONS);
+  Serial.print(" cycles/iteration, max. pulse rate with call overhead: ");
+  Serial.print(max_freq);
+  Serial.println(" Hz");
+}
+
+
+void setup() {
+  Serial.begin(115200);
+
+  pinMode(PLUG_1_PIN_1, OUTPUT);
+  pinMode(PLUG_1_PIN_2, OUTPUT);
+  pinMode(PLUG_2_PIN_1, OUTPUT);
+  pinMode(PLUG_2_PIN_2, OUTPUT);
+
+  // Timer1: normal mode, CPU clock, no prescaler.
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+}
+
+void loop() {
+  Serial.println("--- Pins are constant ---");
+  report("digitalRead   ", count_digital_read, 0);
+  report("port snapshot ", count_port_snapshot, 0);
+  report("glitch filter ", count_port_snapshot_filtered, 0);
+  Serial.println("--- All pins toggle in each iteration ---");
+  report("digitalRead   ", count_digital_read, PLUG_PINS_MASK);
+  report("port snapshot ", count_port_snapshot, PLUG_PINS_MASK);
+  // The filter rejects the toggles, they are glitches.
+  report("glitch filter ", count_port_snapshot_filtered, PLUG_PINS_MASK);
+  // Use the counters, so that the compiler can't remove the algorithms.
+  Serial.print("(Sum of counters: ");
+  Serial.print(counter_1_1 + counter_1_2 + counter_2_1 + counter_2_2);
+  Serial.println(")");
+  Serial.println();
+
+  delay(2000);
+}
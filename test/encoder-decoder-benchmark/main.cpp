@@ -0,0 +1,238 @@
+// ============================================================================
+//      Speed of the Quadrature Decoders of the Encoder Library, on the Host
+// ============================================================================
+
+// Compares two implementations of `Encoder::update()` on pin samples of a
+// simulated wheel:
+// * switch: The previous C++ version, a switch over the 16 states.
+// * table: The branch free version with the constexpr transition table
+//   (`utility/quadrature_table.h`), which the library uses now.
+// Both must end at the true position of the wheel. The AVR assembly can't
+// run on the host.
+//
+// On the ATmega328, the assembly is faster than the table version, so the
+// library keeps it (`ENCODER_PORTABLE_UPDATE` selects the table version). 
+// CPU cycles of one update, from the cycles per instruction of the 
+// instruction set manual, without the call or interrupt entry:
+//
+//     movement                  0      +-1       +-2
+//     assembly                 43    55-57        67
+//     table (C++)              92       92       102
+//
+// The assembly was run on a model of the instructions for all 16 states.
+// The table version was compiled with LLVM 14 (`llc -O2 -mcpu=atmega328p`,
+// from the equivalent IR, the table read with `lpm`), avr-gcc was not 
+// available. It sign extends the movement with 7 shifts, avr-gcc needs 2 
+// instructions for that, which would still leave about 80 cycles. The 
+// host times of this benchmark don't carry over to the AVR, which has no 
+// 32 bit registers and reads the table from flash.
+//
+// Waveforms, the first two with changes of direction:
+// * 4x: A sample after every edge, like with interrupts on both pins.
+// * pin1: A sample after every edge of pin 1 and at random polls, like the
+//   quad-enc firmware with one interrupt pin per encoder. Missed edges of
+//   pin 2 are inferred.
+// * jitter: A wheel that stands at an edge of pin 2, which bounces.
+//
+//     make
+//     ./encoder-decoder-benchmark [-n samples] [-r repeats] [recording]
+//
+// A recording is a text file with one sample per line: pin 1 and pin 2,
+// e.g. `01`. Its true position is unknown, only the decoders are compared.
+// The exit status is 1 when a decoder is wrong.
+
+#include <chrono>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <vector>
+
+#include "utility/quadrature_table.h"
+
+struct DecoderState {
+  uint8_t state;
+  int32_t position;
+};
+
+// A sample of the pins: bit 0 pin 1, bit 1 pin 2.
+typedef std::vector<uint8_t> Samples;
+
+struct Waveform {
+  char const * name;
+  Samples samples;
+  // True position at the end, in steps (edges).
+  int32_t position;
+  bool position_known;
+};
+
+
+// --- Decoders ---------------------------------------------------------------
+__attribute__((noinline))
+static void update_switch(DecoderState * arg, uint8_t pins) {
+  uint8_t state = arg->state & 3;
+  if (pins & 1) state |= 4;
+  if (pins & 2) state |= 8;
+  arg->state = (state >> 2);
+  switch (state) {
+    case 1: case 7: case 8: case 14:
+      arg->position++;
+      return;
+    case 2: case 4: case 11: case 13:
+      arg->position--;
+      return;
+    case 3: case 12:
+      arg->position += 2;
+      return;
+    case 6: case 9:
+      arg->position -= 2;
+      return;
+  }
+}
+
+__attribute__((noinline))
+static void update_table(DecoderState * arg, uint8_t pins) {
+  uint8_t const state = (arg->state & 3) | (pins << 2);
+  arg->state = (state >> 2);
+  arg->position += encoder_table_read(encoder_delta_table, state);
+}
+
+
+// --- Waveforms --------------------------------------------------------------
+// The pins at a position of the wheel. The positive direction is 00, 10,
+// 11, 01 (pin 2, pin 1).
+static uint8_t pins_at(int32_t position) {
+  static uint8_t const PINS[4] = {0, 2, 3, 1};
+  return PINS[position & 3];
+}
+
+// The wheel moves by one edge per step, and changes its direction now and
+// then. `sample_pin2` is the probability that an edge of pin 2 is sampled.
+static Waveform make_motion(char const * name, size_t n_samples,
+                            double sample_pin2) {
+  Waveform waveform = {name, Samples(), 0, true};
+  int32_t position = 0;
+  int direction = 1;
+  // The decoder starts with the first sample.
+  waveform.samples.push_back(pins_at(position));
+  while (waveform.samples.size() < n_samples) {
+    if (rand() % 1000 < 3) { direction = -direction; }
+    position += direction;
+    uint8_t const pins = pins_at(position);
+    bool const pin1_edge = (pins ^ pins_at(position - direction)) & 1;
+    if (pin1_edge || rand() < sample_pin2 * RAND_MAX) {
+      waveform.samples.push_back(pins);
+    }
+  }
+  // The last edges must be seen.
+  waveform.samples.push_back(pins_at(position));
+  waveform.position = position;
+  return waveform;
+}
+
+// The wheel stands at an edge of pin 2, which bounces.
+static Waveform make_jitter(size_t n_samples) {
+  Waveform waveform = {"jitter", Samples(), 0, true};
+  int32_t position = 0;
+  waveform.samples.push_back(pins_at(position));
+  while (waveform.samples.size() < n_samples) {
+    position = (position == 0) ? 1 : 0;
+    if (rand() % 100 == 0) { continue; }
+    waveform.samples.push_back(pins_at(position));
+  }
+  waveform.samples.push_back(pins_at(position));
+  waveform.position = position;
+  return waveform;
+}
+
+static bool read_recording(char const * path, Waveform & waveform) {
+  FILE * file = fopen(path, "r");
+  if (!file) { return false; }
+  waveform.name = path;
+  waveform.position_known = false;
+  char line[16];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] != '0' && line[0] != '1') { continue; }
+    waveform.samples.push_back((line[0] - '0') | (line[1] == '1') << 1);
+  }
+  fclose(file);
+  return !waveform.samples.empty();
+}
+
+
+// --- Benchmark --------------------------------------------------------------
+template <void (*Update)(DecoderState *, uint8_t)>
+static double run(Samples const & samples, int repeats, int32_t & position) {
+  DecoderState state = {samples[0], 0};
+  auto const start = std::chrono::steady_clock::now();
+  for (int r = 0; r < repeats; ++r) {
+    state.state = samples[0];
+    state.position = 0;
+    for (size_t i = 0; i < samples.size(); ++i) {
+      Update(&state, samples[i]);
+    }
+  }
+  std::chrono::duration<double, std::nano> const time =
+      std::chrono::steady_clock::now() - start;
+  position = state.position;
+  return time.count() / ((double)samples.size() * repeats);
+}
+
+static void usage(char const * program) {
+  fprintf(stderr, "Usage: %s [-n samples] [-r repeats] [recording]\n",
+          program);
+  exit(2);
+}
+
+int main(int argc, char ** argv) {
+  size_t n_samples = 1000000;
+  int repeats = 20;
+  int option;
+  while ((option = getopt(argc, argv, "n:r:")) != -1) {
+    switch (option) {
+      case 'n': n_samples = strtoul(optarg, NULL, 0); break;
+      case 'r': repeats = atoi(optarg); break;
+      default: usage(argv[0]);
+    }
+  }
+  if (argc - optind > 1 || n_samples == 0 || repeats <= 0) { usage(argv[0]); }
+
+  std::vector<Waveform> waveforms;
+  if (optind < argc) {
+    Waveform recording;
+    if (!read_recording(argv[optind], recording)) {
+      fprintf(stderr, "Error: No samples in %s\n", argv[optind]);
+      return 2;
+    }
+    waveforms.push_back(recording);
+  }
+  else {
+    srand(1);
+    waveforms.push_back(make_motion("4x", n_samples, 1.0));
+    waveforms.push_back(make_motion("pin1", n_samples, 0.3));
+    waveforms.push_back(make_jitter(n_samples));
+  }
+
+  bool wrong = false;
+  printf("%-10s %10s %14s %14s\n", "waveform", "samples", "switch ns", "table ns");
+  for (Waveform const & waveform : waveforms) {
+    int32_t position_switch, position_table;
+    double const ns_switch = run<update_switch>(waveform.samples, repeats,
+                                                position_switch);
+    double const ns_table = run<update_table>(waveform.samples, repeats,
+                                              position_table);
+    printf("%-10s %10zu %14.2f %14.2f", waveform.name,
+           waveform.samples.size(), ns_switch, ns_table);
+    if (position_switch != position_table
+        || (waveform.position_known && position_table != waveform.position)) {
+      printf("  wrong position: switch %ld, table %ld", (long)position_switch,
+             (long)position_table);
+      if (waveform.position_known) {
+        printf(", true %ld", (long)waveform.position);
+      }
+      wrong = true;
+    }
+    printf("\n");
+  }
+  return wrong ? 1 : 0;
+}
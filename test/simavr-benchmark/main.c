@@ -0,0 +1,618 @@
+// ============================================================================
+//      Maximum Pulse Rate of the Odometer Firmwares, Measured with simavr
+// ============================================================================
+
+// Runs the real firmware image (the ELF file, that PlatformIO builds for the
+// Arduino Nano) in simavr, a cycle accurate simulator of the ATmega328. No
+// hardware is involved, the results are reproducible for every change of
+// the firmware.
+//
+// The benchmark drives all counter inputs with waveforms of the same
+// frequency, while an emulated I2C master reads the counters (`REG_COUNT`)
+// back to back. After the waveforms stop, it reads the counters once more
+// and compares them with the number of edges that it generated. The
+// frequency is doubled until counts are lost, then the highest frequency
+// without lost counts is searched by bisection.
+//
+// It reports:
+// * The highest frequency (per input) without lost counts.
+// * The longest period of the main loop, measured on a debug pin that is
+//   high while `loop()` runs. The simple pulse firmware has this pin with
+//   `DEBUG_RL_PINS` (D6), see the `simavr` environment of its
+//   `platformio.ini`.
+// * The longest interrupt handler, from the vector jump to `reti`.
+// Both are measured at the highest frequency without lost counts.
+//
+//     make
+//     cd ../../firmware/arduino-nano-simp-pulse
+//     pio run -e simavr
+//     ../../test/simavr-benchmark/simavr-benchmark simp-pulse .pio/build/simavr/firmware.elf
+//
+// Options:
+//     -t <ms>     Duration of the waveforms for each frequency, default 200.
+//     -b <hz>     Clock of the I2C bus, default 100000.
+//     -r <hz>     Rate of the I2C reads, default 0: back to back.
+//     -l <pin>    Debug pin of the main loop, -1 for none. Default: D6 for
+//                 simp-pulse, none for quad-enc.
+//     -a <addr>   I2C address of the firmware, default 0x28.
+//     -m <edges>  Counted edges per cycle (`REG_COUNT_MODE`), written 
+//                 before the waveforms start: 1 or 2 for simp-pulse, 1, 2
+//                 or 4 for quad-enc. The counters keep their unit, they may
+//                 differ by the lower resolution from the generated edges.
+//                 Default: the setting of the firmware (all edges).
+//     -v          Print the result of each frequency.
+//
+// Results: None yet. The benchmark has not been run: simavr and the AVR
+// toolchain were not available where it was written, its syntax was only
+// checked against stand-in headers. The highest frequencies, and the 
+// longest loop and interrupt handler in cycles, remain to be measured.
+// Until then, `firmware/native/src/benchmark.cpp` lists estimates of the
+// host-native build, with guessed costs.
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_time.h"
+#include "avr_ioport.h"
+#include "avr_twi.h"
+
+// --- Constants --------------------------------------------------------------
+#define F_CPU 16000000UL
+#define MAX_INPUTS 4
+// Register addresses of the TWI on the ATmega328 (data space).
+#define TWDR_ADDRESS 0xBB
+#define TWCR_ADDRESS 0xBC
+#define TWINT_MASK 0x80
+// Registers of the counters and of the counted edges per cycle, the same
+// in both firmwares.
+#define REG_COUNT 0x10
+#define REG_COUNT_MODE 0x65
+
+// Time after reset, before the waveforms start: `setup()` must be done.
+#define SETUP_US 100000
+// Time after the waveforms stop, before the counters are compared.
+#define SETTLE_US 10000
+// Time after which the firmware must have handled an I2C byte.
+#define I2C_TIMEOUT_US 20000
+// Bisection stops when the interval is smaller than 1 / this.
+#define SEARCH_RESOLUTION 50
+// Lowest and highest frequency of the search.
+#define MIN_FREQUENCY 100
+#define MAX_FREQUENCY 2000000
+
+// --- Firmware Profiles ------------------------------------------------------
+// One counter input: a square wave on one pin, or a quadrature signal on two.
+typedef struct {
+  uint8_t pin_1;
+  uint8_t pin_2;
+  bool quadrature;
+} Input;
+
+typedef struct {
+  char const * name;
+  // The inputs in the order of the counters of `REG_COUNT`.
+  Input inputs[MAX_INPUTS];
+  int n_inputs;
+  // Pins with jumpers, they are driven high (open jumper).
+  uint8_t jumper_pins[4];
+  int n_jumper_pins;
+  // Debug pin that is high while `loop()` runs, -1 for none.
+  int loop_pin;
+} Profile;
+
+static Profile const PROFILES[] = {
+  {
+    "simp-pulse",
+    {{3, 3, false}, {5, 5, false}, {2, 2, false}, {4, 4, false}}, 4,
+    {6, 7, 11, 12}, 4,
+    6,
+  },
+  {
+    "quad-enc",
+    {{2, 4, true}, {3, 5, true}}, 2,
+    {6, 7, 11, 12}, 4,
+    -1,
+  },
+};
+
+// --- Options ----------------------------------------------------------------
+static Profile profile;
+static elf_firmware_t firmware;
+static uint32_t duration_ms = 200;
+static uint32_t i2c_bitrate = 100000;
+static uint32_t i2c_rate = 0;
+static uint8_t i2c_address = 0x28;
+// Counted edges per cycle, 0 to keep the setting of the firmware.
+static uint8_t count_edges = 0;
+static bool verbose = false;
+
+
+// --- Waveforms --------------------------------------------------------------
+typedef struct {
+  Input input;
+  // Frequency in millihertz, the inputs are slightly detuned against each
+  // other, so that their edges don't coincide.
+  uint64_t frequency_mhz;
+  avr_cycle_count_t start;
+  uint64_t edges;
+  bool running;
+} Wave;
+
+static Wave waves[MAX_INPUTS];
+
+// The IRQ of an Arduino pin: D0 - D7 are on port D, D8 - D13 on port B,
+// A0 - A5 (14 - 19) on port C.
+static avr_irq_t * pin_irq(avr_t * avr, uint8_t pin) {
+  char const port = pin < 8 ? 'D' : pin < 14 ? 'B' : 'C';
+  uint8_t const bit = pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14;
+  return avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit);
+}
+
+static void drive_pin(avr_t * avr, uint8_t pin, int level) {
+  avr_raise_irq(pin_irq(avr, pin), level);
+}
+
+static avr_cycle_count_t wave_edge_time(Wave const * wave, uint64_t edge) {
+  uint64_t const edges_per_cycle = wave->input.quadrature ? 4 : 2;
+  return wave->start
+       + edge * F_CPU * 1000 / (edges_per_cycle * wave->frequency_mhz);
+}
+
+// Cycle timer: the next edge of a waveform. The pins start high, like
+// pulled up inputs. A quadrature signal changes pin 2 first, the Encoder
+// library counts this up.
+static avr_cycle_count_t wave_edge(avr_t * avr, avr_cycle_count_t when,
+                                   void * param) {
+  Wave * wave = (Wave *)param;
+  if (!wave->running) { return 0; }
+  uint64_t const edge = ++wave->edges;
+  if (wave->input.quadrature) {
+    int const level = 1 - ((edge + 1) / 2) % 2;
+    drive_pin(avr, edge % 2 ? wave->input.pin_2 : wave->input.pin_1, level);
+  }
+  else {
+    drive_pin(avr, wave->input.pin_1, 1 - edge % 2);
+  }
+  return wave_edge_time(wave, edge + 1);
+}
+
+
+// --- I2C Master -------------------------------------------------------------
+// Transactions on the bus: the master writes the register address, then
+// reads the counters, as two transactions. A configuration is written in
+// one transaction, the register address and the value. Each step sends a condition to
+// the TWI of the firmware, and waits until the firmware has handled it
+// (TWINT was set and cleared again), but at least for the time of one byte
+// on the bus. The firmware does not need to handle stop conditions, but
+// the master waits a little for it.
+typedef enum {
+  STEP_IDLE,
+  STEP_WRITE_ADDRESS,
+  STEP_WRITE_REGISTER,
+  STEP_WRITE_STOP,
+  STEP_READ_ADDRESS,
+  STEP_READ_DATA,
+  STEP_READ_STOP,
+} Step;
+
+typedef struct {
+  avr_t * avr;
+  avr_irq_t * input;
+  Step step;
+  // The step waits for the firmware: TWINT was set, TWINT was cleared.
+  bool waiting;
+  bool twint_seen;
+  // The firmware may ignore the step (stop condition).
+  bool optional;
+  avr_cycle_count_t step_end;
+  avr_cycle_count_t timeout;
+  // Bytes to write after the address, and the bytes written so far. Without
+  // `n_expected`, the transaction ends after the write.
+  uint8_t write_data[2];
+  int n_write;
+  int n_written;
+  // Bytes read so far, and the result of the last completed read.
+  uint8_t data[4 * MAX_INPUTS];
+  int n_read;
+  int n_expected;
+  uint8_t result[4 * MAX_INPUTS];
+  uint32_t completed;
+  // Start transactions periodically (or back to back), otherwise only
+  // single ones.
+  bool periodic;
+  avr_cycle_count_t next_start;
+  bool failed;
+} Master;
+
+static Master master;
+
+static avr_cycle_count_t byte_cycles() {
+  return 9 * F_CPU / i2c_bitrate;
+}
+
+static void master_send(uint8_t condition, uint8_t address, uint8_t data) {
+  master.waiting = true;
+  master.twint_seen = false;
+  master.optional = condition & TWI_COND_STOP;
+  master.step_end = master.avr->cycle + byte_cycles();
+  master.timeout = master.optional
+                 ? master.step_end + byte_cycles()
+                 : master.avr->cycle + avr_usec_to_cycles(master.avr,
+                                                          I2C_TIMEOUT_US);
+  avr_raise_irq(master.input, avr_twi_irq_msg(condition, address, data));
+}
+
+static void master_start_transaction() {
+  master.step = STEP_WRITE_ADDRESS;
+  master.write_data[0] = REG_COUNT;
+  master.n_write = 1;
+  master.n_written = 0;
+  master.n_read = 0;
+  master.n_expected = 4 * profile.n_inputs;
+  master_send(TWI_COND_START | TWI_COND_ADDR, i2c_address << 1, 0);
+}
+
+// Write `value` into the register `reg`.
+static void master_start_write(uint8_t reg, uint8_t value) {
+  master.step = STEP_WRITE_ADDRESS;
+  master.write_data[0] = reg;
+  master.write_data[1] = value;
+  master.n_write = 2;
+  master.n_written = 0;
+  master.n_expected = 0;
+  master_send(TWI_COND_START | TWI_COND_ADDR, i2c_address << 1, 0);
+}
+
+// The firmware has handled the current step, start the next one.
+static void master_next_step() {
+  avr_t * const avr = master.avr;
+  switch (master.step) {
+    case STEP_WRITE_ADDRESS:
+    case STEP_WRITE_REGISTER:
+      if (master.n_written < master.n_write) {
+        master.step = STEP_WRITE_REGISTER;
+        master_send(TWI_COND_WRITE, i2c_address << 1,
+                    master.write_data[master.n_written++]);
+      }
+      else {
+        master.step = STEP_WRITE_STOP;
+        master_send(TWI_COND_STOP, i2c_address << 1, 0);
+      }
+      break;
+    case STEP_WRITE_STOP:
+      if (master.n_expected == 0) {
+        ++master.completed;
+        master.step = STEP_IDLE;
+        break;
+      }
+      master.step = STEP_READ_ADDRESS;
+      master_send(TWI_COND_START | TWI_COND_ADDR, i2c_address << 1 | 1, 0);
+      break;
+    case STEP_READ_ADDRESS:
+    case STEP_READ_DATA:
+      // The firmware has put the next byte into TWDR and released the bus.
+      master.data[master.n_read++] = avr->data[TWDR_ADDRESS];
+      master.step = STEP_READ_DATA;
+      if (master.n_read < master.n_expected) {
+        master_send(TWI_COND_READ | TWI_COND_ACK, i2c_address << 1 | 1, 0);
+      }
+      else {
+        // Not acknowledged: the last byte.
+        master.step = STEP_READ_STOP;
+        master_send(TWI_COND_READ, i2c_address << 1 | 1, 0);
+      }
+      break;
+    case STEP_READ_STOP:
+      master_send(TWI_COND_STOP, i2c_address << 1 | 1, 0);
+      memcpy(master.result, master.data, master.n_expected);
+      ++master.completed;
+      master.step = STEP_IDLE;
+      break;
+    case STEP_IDLE:
+      break;
+  }
+}
+
+// Called after each instruction of the firmware.
+static void master_poll() {
+  avr_t * const avr = master.avr;
+  if (master.step == STEP_IDLE && !master.waiting) {
+    if (master.periodic && avr->cycle >= master.next_start) {
+      if (i2c_rate) { master.next_start += F_CPU / i2c_rate; }
+      master_start_transaction();
+    }
+    return;
+  }
+  if (master.waiting) {
+    bool const twint = avr->data[TWCR_ADDRESS] & TWINT_MASK;
+    if (twint) { master.twint_seen = true; }
+    if (master.twint_seen && !twint) { master.waiting = false; }
+    else if (avr->cycle > master.timeout) {
+      if (!master.optional) { master.failed = true; }
+      master.waiting = false;
+    }
+    return;
+  }
+  if (avr->cycle >= master.step_end) { master_next_step(); }
+}
+
+
+// --- Timing Measurements ----------------------------------------------------
+typedef struct {
+  // Longest period between two starts of `loop()`.
+  avr_cycle_count_t max_loop;
+  avr_cycle_count_t loop_start;
+  // Longest interrupt handler and its vector.
+  avr_cycle_count_t max_isr;
+  int max_isr_vector;
+  avr_cycle_count_t isr_start;
+  int isr_vector;
+} Timing;
+
+static Timing timing;
+
+static void loop_pin_changed(avr_irq_t * irq, uint32_t value, void * param) {
+  avr_t * const avr = (avr_t *)param;
+  if (!value) { return; }
+  if (timing.loop_start) {
+    avr_cycle_count_t const period = avr->cycle - timing.loop_start;
+    if (period > timing.max_loop) { timing.max_loop = period; }
+  }
+  timing.loop_start = avr->cycle;
+}
+
+// Called after each instruction of the firmware. Nested interrupts are
+// measured as part of the outer one.
+static void timing_poll(avr_t * avr) {
+  uint8_t const running = avr->interrupts.running_ptr;
+  if (running && !timing.isr_start) {
+    timing.isr_start = avr->cycle;
+    timing.isr_vector = avr->interrupts.running[0]->vector;
+  }
+  else if (!running && timing.isr_start) {
+    avr_cycle_count_t const length = avr->cycle - timing.isr_start;
+    if (length > timing.max_isr) {
+      timing.max_isr = length;
+      timing.max_isr_vector = timing.isr_vector;
+    }
+    timing.isr_start = 0;
+  }
+}
+
+
+// --- Simulation -------------------------------------------------------------
+static avr_t * create_avr() {
+  avr_t * avr = avr_make_mcu_by_name("atmega328p");
+  if (!avr) {
+    fprintf(stderr, "Error: simavr does not know the ATmega328P.\n");
+    exit(2);
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+  avr->frequency = F_CPU;
+  avr->log = LOG_ERROR;
+  return avr;
+}
+
+// Run the firmware until `cycle`.
+static void run_until(avr_t * avr, avr_cycle_count_t cycle) {
+  while (avr->cycle < cycle) {
+    int const state = avr_run(avr);
+    if (state == cpu_Done || state == cpu_Crashed) {
+      fprintf(stderr, "Error: The firmware crashed at cycle %llu.\n",
+              (unsigned long long)avr->cycle);
+      exit(2);
+    }
+    timing_poll(avr);
+    master_poll();
+    if (master.failed) {
+      fprintf(stderr, "Error: The firmware does not answer on I2C.\n");
+      exit(2);
+    }
+  }
+}
+
+// Wait for the transaction that was just started.
+static void wait_for_transaction(avr_t * avr, uint32_t completed) {
+  while (master.completed == completed || master.waiting) {
+    run_until(avr, avr->cycle + 1);
+  }
+}
+
+// Wait for the running transaction, and do a last one.
+static void read_counters(avr_t * avr) {
+  master.periodic = false;
+  while (master.step != STEP_IDLE || master.waiting) {
+    run_until(avr, avr->cycle + 1);
+  }
+  uint32_t const completed = master.completed;
+  master_start_transaction();
+  wait_for_transaction(avr, completed);
+}
+
+// Expected count of an input after its waveform stopped.
+static int32_t expected_count(Wave const * wave) {
+  return (int32_t)wave->edges;
+}
+
+// Difference of a count from the generated edges, that is no lost count:
+// With fewer edges per cycle the counters step by more than 1.
+static int64_t count_tolerance(Wave const * wave) {
+  int64_t const edges_per_cycle = wave->input.quadrature ? 4 : 2;
+  return count_edges ? edges_per_cycle / count_edges - 1 : 0;
+}
+
+// Run the firmware with all inputs at `frequency`. Returns the number of
+// lost counts.
+static int64_t run_frequency(uint32_t frequency) {
+  avr_t * const avr = create_avr();
+  memset(&timing, 0, sizeof(timing));
+  memset(&master, 0, sizeof(master));
+  master.avr = avr;
+  master.input = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT);
+
+  for (int i = 0; i < profile.n_jumper_pins; ++i) {
+    drive_pin(avr, profile.jumper_pins[i], 1);
+  }
+  for (int i = 0; i < profile.n_inputs; ++i) {
+    drive_pin(avr, profile.inputs[i].pin_1, 1);
+    drive_pin(avr, profile.inputs[i].pin_2, 1);
+  }
+  if (profile.loop_pin >= 0) {
+    avr_irq_register_notify(pin_irq(avr, profile.loop_pin),
+                            loop_pin_changed, avr);
+  }
+  run_until(avr, avr_usec_to_cycles(avr, SETUP_US));
+  if (count_edges) {
+    master_start_write(REG_COUNT_MODE, count_edges);
+    wait_for_transaction(avr, 0);
+    master.completed = 0;
+  }
+  // Only the timing under load is of interest.
+  memset(&timing, 0, sizeof(timing));
+
+  avr_cycle_count_t const start = avr->cycle;
+  for (int i = 0; i < profile.n_inputs; ++i) {
+    Wave * wave = &waves[i];
+    wave->input = profile.inputs[i];
+    wave->frequency_mhz = (uint64_t)frequency * (1000 + 7 * i);
+    wave->start = start;
+    wave->edges = 0;
+    wave->running = true;
+    avr_cycle_timer_register(avr, wave_edge_time(wave, 1) - start,
+                             wave_edge, wave);
+  }
+  master.periodic = true;
+  master.next_start = start;
+  run_until(avr, start + avr_usec_to_cycles(avr, duration_ms * 1000));
+
+  for (int i = 0; i < profile.n_inputs; ++i) {
+    waves[i].running = false;
+    avr_cycle_timer_cancel(avr, wave_edge, &waves[i]);
+  }
+  Timing const load_timing = timing;
+  run_until(avr, avr->cycle + avr_usec_to_cycles(avr, SETTLE_US));
+  read_counters(avr);
+  timing = load_timing;
+
+  int64_t lost = 0;
+  for (int i = 0; i < profile.n_inputs; ++i) {
+    uint8_t const * data = &master.result[4 * i];
+    int32_t const count = (int32_t)((uint32_t)data[0] << 24
+                                  | (uint32_t)data[1] << 16
+                                  | (uint32_t)data[2] << 8
+                                  | (uint32_t)data[3]);
+    int64_t difference = (int64_t)expected_count(&waves[i]) - count;
+    if (difference < 0) { difference = -difference; }
+    if (difference > count_tolerance(&waves[i])) {
+      lost += difference - count_tolerance(&waves[i]);
+    }
+  }
+  if (verbose) {
+    printf("%9lu Hz: lost %lld, %u I2C reads, loop %llu cycles, "
+           "interrupt %llu cycles\n",
+           (unsigned long)frequency, (long long)lost, master.completed,
+           (unsigned long long)timing.max_loop,
+           (unsigned long long)timing.max_isr);
+  }
+  avr_terminate(avr);
+  free(avr);
+  return lost;
+}
+
+
+// --- Main -------------------------------------------------------------------
+static void usage(char const * program) {
+  fprintf(stderr,
+          "Usage: %s [-t ms] [-b hz] [-r hz] [-l pin] [-a address] "
+          "[-m edges] [-v] simp-pulse|quad-enc <firmware.elf>\n", program);
+  exit(2);
+}
+
+int main(int argc, char ** argv) {
+  int loop_pin = -2;
+  int option;
+  while ((option = getopt(argc, argv, "t:b:r:l:a:m:v")) != -1) {
+    switch (option) {
+      case 't': duration_ms = strtoul(optarg, NULL, 0); break;
+      case 'b': i2c_bitrate = strtoul(optarg, NULL, 0); break;
+      case 'r': i2c_rate = strtoul(optarg, NULL, 0); break;
+      case 'l': loop_pin = strtol(optarg, NULL, 0); break;
+      case 'a': i2c_address = strtoul(optarg, NULL, 0); break;
+      case 'm': count_edges = strtoul(optarg, NULL, 0); break;
+      case 'v': verbose = true; break;
+      default: usage(argv[0]);
+    }
+  }
+  if (argc - optind != 2 || (count_edges != 0 && count_edges != 1
+                              && count_edges != 2 && count_edges != 4)) {
+    usage(argv[0]);
+  }
+
+  size_t const n_profiles = sizeof(PROFILES) / sizeof(PROFILES[0]);
+  size_t i_profile = 0;
+  while (i_profile < n_profiles
+         && strcmp(PROFILES[i_profile].name, argv[optind])) {
+    ++i_profile;
+  }
+  if (i_profile == n_profiles) { usage(argv[0]); }
+  profile = PROFILES[i_profile];
+  if (loop_pin != -2) { profile.loop_pin = loop_pin; }
+
+  char const * const elf_name = argv[optind + 1];
+  if (elf_read_firmware(elf_name, &firmware)) {
+    fprintf(stderr, "Error: Can't read %s\n", elf_name);
+    return 2;
+  }
+  strcpy(firmware.mmcu, "atmega328p");
+  firmware.frequency = F_CPU;
+
+  // Double the frequency until counts are lost, then bisect.
+  uint32_t good = 0;
+  uint32_t bad = MIN_FREQUENCY;
+  Timing good_timing = {0};
+  while (bad <= MAX_FREQUENCY && run_frequency(bad) == 0) {
+    good = bad;
+    good_timing = timing;
+    bad *= 2;
+  }
+  if (good == 0) {
+    printf("%s: counts are lost already at %u Hz.\n", elf_name,
+           MIN_FREQUENCY);
+    return 1;
+  }
+  while (bad <= MAX_FREQUENCY
+         && (bad - good) * SEARCH_RESOLUTION > good) {
+    uint32_t const middle = good + (bad - good) / 2;
+    if (run_frequency(middle) == 0) {
+      good = middle;
+      good_timing = timing;
+    }
+    else {
+      bad = middle;
+    }
+  }
+
+  printf("%s (%s, I2C %lu Hz, %s", elf_name, profile.name,
+         (unsigned long)i2c_bitrate,
+         i2c_rate ? "periodic reads" : "back to back reads");
+  if (count_edges) { printf(", %u edges per cycle", count_edges); }
+  printf("):\n");
+  printf("  Highest frequency without lost counts: %lu Hz per input\n",
+         (unsigned long)good);
+  if (profile.loop_pin >= 0) {
+    printf("  Longest loop period: %llu cycles (%.1f us)\n",
+           (unsigned long long)good_timing.max_loop,
+           good_timing.max_loop * 1e6 / F_CPU);
+  }
+  printf("  Longest interrupt: %llu cycles (%.1f us), vector %d\n",
+         (unsigned long long)good_timing.max_isr,
+         good_timing.max_isr * 1e6 / F_CPU, good_timing.max_isr_vector);
+  return 0;
+}
@@ -11,8 +11,23 @@ import Adafruit_PureIO.smbus
 
 address = 0x28
 reg_who = 0x01
+reg_status = 0x08
+reg_sample_period = 0x0B
+reg_time = 0x0C
 reg_reset = 0x0C
 reg_counts = 0x10
+reg_edge_times = 0x20
+reg_periods = 0x40
+reg_fifo_data = 0x60
+reg_delta = 0x61
+reg_latch = 0x62
+reg_diagnostics = 0x63
+reg_filter = 0x64
+reg_count_mode = 0x65
+reg_config = 0x66
+reg_timing = 0x67
+config_version = 1
+general_call = 0x00
 
 i2c = Adafruit_PureIO.smbus.SMBus(1)
 
@@ -30,6 +45,166 @@ def read_reg_counters():
     counter_1, counter_2, counter_3, counter_4 = struct.unpack('!4i', buf)
     print('Counters 1:', counter_1, ', 2:', counter_2, ', 3:', counter_3, ', 4:', counter_4)
 
+def read_reg_edge_times():
+    """Read the edge time registers (Simple Pulse firmware only)."""
+    buf = i2c.read_i2c_block_data(address, reg_edge_times, 32)
+    times = struct.unpack('!8I', buf)
+    for i in range(4):
+        age_us, period_us = times[2 * i], times[2 * i + 1]
+        # The wheel is slower than the last period suggests, if the last edge
+        # is older than the period.
+        period_us = max(period_us, age_us)
+        freq = 1e6 / period_us if period_us > 0 else 0
+        print('Counter', i + 1, ': last edge', age_us, 'us ago, period', 
+              period_us, 'us, frequency', round(freq, 1), 'Hz')
+
+def read_reg_periods():
+    """Read the periods measured on ICP1 (Simple Pulse firmware only)."""
+    buf = i2c.read_i2c_block_data(address, reg_periods, 32)
+    n_edges, *periods = struct.unpack('!8I', buf)
+    # Periods are in CPU cycles of the 16 MHz Arduino Nano, 0 is invalid.
+    periods_us = [p / 16 for p in periods if p > 0]
+    print('ICP1 edges:', n_edges, ', periods [us]:', periods_us)
+
+def read_reg_burst():
+    """Read status, time, counters and edge times in one transaction 
+    (Simple Pulse firmware only)."""
+    buf = i2c.read_i2c_block_data(address, reg_status, 56)
+    status, time_us, *values = struct.unpack('!B3xI4i8I', buf)
+    counters, edge_times = values[:4], values[4:]
+    print('Status:', hex(status), ', time:', time_us, 'us, counters:', counters,
+          ', edge times:', edge_times)
+
+def write_reg_sample_period(period_ms):
+    """Start sampling into the FIFO, 0 stops it (Simple Pulse firmware only)."""
+    i2c.write_i2c_block_data(address, reg_sample_period, [period_ms])
+
+def read_reg_fifo_data(max_samples=7):
+    """Read up to `max_samples` samples from the FIFO. Each sample contains 
+    the lower 16 bits of the 4 counters (Simple Pulse firmware only)."""
+    # Limit the number of samples, the device removes all samples it sends.
+    i2c.write_i2c_block_data(address, reg_fifo_data, [max_samples])
+    buf = i2c.read_i2c_block_data(address, reg_fifo_data, 1 + 8 * max_samples)
+    n_samples = buf[0]
+    samples = [struct.unpack_from('!4H', buf, 1 + 8 * i) 
+               for i in range(n_samples)]
+    print('FIFO samples:', samples)
+    return samples
+
+def write_reg_delta_width(max_width):
+    """Set the maximum width of the deltas: 1, 2, 4 bytes 
+    (Simple Pulse firmware only)."""
+    i2c.write_i2c_block_data(address, reg_delta, [max_width])
+
+def read_reg_delta(max_width=2):
+    """Read the changes of the counters since the previous read 
+    (Simple Pulse firmware only)."""
+    buf = i2c.read_i2c_block_data(address, reg_delta, 1 + 4 * max_width)
+    width = buf[0]
+    fmt = {1: '!4b', 2: '!4h', 4: '!4i'}[width]
+    deltas = struct.unpack(fmt, bytes(buf[1:1 + 4 * width]))
+    print('Deltas:', deltas)
+    return deltas
+
+def latch_all():
+    """Latch the time and the counters of all boards on the bus at the same 
+    moment, with a write to the general call address."""
+    i2c.write_i2c_block_data(general_call, reg_latch, [1])
+
+def read_reg_latch():
+    """Read the time and the counters of the last latch."""
+    buf = i2c.read_i2c_block_data(address, reg_latch, 20)
+    time_us, *counters = struct.unpack('!I4i', bytes(buf))
+    print('Latched at', time_us, 'us, counters:', counters)
+    return time_us, counters
+
+def read_reg_diagnostics(n_counters=4):
+    """Read the overruns, the longest loop in microseconds, and for each 
+    counter the edges that were probably missed. The counters wrap at 16 
+    bits. Use 4 counters for the Simple Pulse firmware, 2 for the 
+    Quadrature Encoder firmware."""
+    buf = i2c.read_i2c_block_data(address, reg_diagnostics, 4 + 2 * n_counters)
+    overruns, max_loop_us, *missed = struct.unpack(
+        '!2H%dH' % n_counters, bytes(buf))
+    print('Overruns:', overruns, ', longest loop:', max_loop_us, 
+          'us, missed edges:', missed)
+    return overruns, max_loop_us, missed
+
+def write_reg_filter(time_us):
+    """Set the minimum stable time of the glitch filter in microseconds, 
+    0 switches it off (Simple Pulse firmware only)."""
+    i2c.write_i2c_block_data(address, reg_filter, [time_us])
+
+def read_reg_filter():
+    """Read the minimum stable time of the glitch filter."""
+    time_us = i2c.read_i2c_block_data(address, reg_filter, 1)[0]
+    print('Glitch filter:', time_us, 'us')
+    return time_us
+
+def write_reg_count_mode(edges):
+    """Set the counted edges per cycle: 1 or 2 (Simple Pulse firmware), 
+    1, 2 or 4 (Quadrature Encoder firmware). Other values are ignored."""
+    i2c.write_i2c_block_data(address, reg_count_mode, [edges])
+
+def read_reg_count_mode():
+    """Read the counted edges per cycle."""
+    edges = i2c.read_i2c_block_data(address, reg_count_mode, 1)[0]
+    print('Counted edges per cycle:', edges)
+    return edges
+
+def config_crc(data):
+    """CRC-16 of the configuration, like `_crc16_update` of avr-libc, with 
+    the start value 0xFFFF."""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte
+        for _ in range(8):
+            crc = (crc >> 1) ^ 0xA001 if crc & 1 else crc >> 1
+    return crc
+
+def write_reg_config(i2c_address=0, channel_map=(0, 1, 2, 3), inverted=0, 
+                     count_mode=0, filter_time_us=0):
+    """Store the configuration in the EEPROM, it is used at the next start.
+    `i2c_address` 0 is the jumper address. The channel map is the position
+    of each input in the counters (for the Quadrature Encoder firmware the
+    first two, of the encoders), `inverted` the inverted encoders (bit 0 
+    encoder 1). 0 is the default count mode."""
+    data = bytes([config_version, i2c_address] + list(channel_map) 
+                 + [inverted, count_mode, filter_time_us])
+    buf = data + struct.pack('!H', config_crc(data))
+    i2c.write_i2c_block_data(address, reg_config, buf)
+
+def read_reg_config():
+    """Read the stored configuration, and the bytes that are not yet 
+    written into the EEPROM."""
+    buf = bytes(i2c.read_i2c_block_data(address, reg_config, 12))
+    crc, = struct.unpack('!H', buf[9:11])
+    if buf[0] != config_version or crc != config_crc(buf[:9]):
+        print('No valid configuration')
+        return None
+    print('Configuration: address', hex(buf[1]), ', channel map', 
+          list(buf[2:6]), ', inverted', buf[6], ', count mode', buf[7], 
+          ', filter', buf[8], 'us, unwritten bytes', buf[11])
+    return buf[:9]
+
+def clear_reg_timing():
+    """Clear the timing histograms (Simple Pulse firmware only)."""
+    i2c.write_i2c_block_data(address, reg_timing, [0x80])
+
+def read_reg_timing(histogram=0):
+    """Read a timing histogram: 0 loop periods, 1 receive callback, 
+    2 request callback. Bucket i counts the times from 2**(i + 4) to 
+    2**(i + 5) - 1 CPU cycles, the first and the last bucket also the 
+    shorter and the longer times."""
+    i2c.write_i2c_block_data(address, reg_timing, [histogram])
+    buf = bytes(i2c.read_i2c_block_data(address, reg_timing, 61))
+    counts = struct.unpack('!15I', buf[1:])
+    for i, count in enumerate(counts):
+        if count:
+            print('Histogram', buf[0], ': from', (2**(i + 4) if i else 0) / 16,
+                  'us:', count)
+    return counts
+
 def write_reg_reset(val):
     """Write the reset register."""
     buf = struct.pack("!i", val)